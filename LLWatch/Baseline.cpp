@@ -0,0 +1,312 @@
+// ------------------------------------------------------------------------------------------------
+// Baseline.cpp - Golden snapshot compared with each frame
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+#include "Baseline.h"
+#include "FrameOps.h"
+#include "Colorize.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+// Identity of the snapshot file when its index was written. Modify and change times
+// in nanoseconds with the file id tell a rewrite apart without reading the snapshot,
+// the hash of a sample of its blocks covers rewrites within the file system clock tick.
+struct BaselineStamp
+{
+	uint64_t fileSize;
+	uint64_t fileId;		// inode, Windows file index
+	int64_t  modifyNs;
+	int64_t  changeNs;		// ctime, Windows ChangeTime
+	uint64_t sampleHash;
+};
+
+// Sidecar index, header followed by the line offsets and the line hashes.
+struct BaselineIndexHeader
+{
+	char     magic[8];
+	BaselineStamp stamp;
+	uint64_t lineCnt;
+};
+
+static const char s_indexMagic[8] = { 'L', 'L', 'W', 'B', 'I', 'D', 'X', '3' };
+
+static const size_t SAMPLE_BLOCKS = 16;
+static const size_t SAMPLE_BYTES = 4096;
+
+// ======================================================================================
+// Hash of SAMPLE_BLOCKS blocks spread over data (first and last included), all of it
+// when smaller.
+static uint64_t SampleHash(const char* data, size_t len)
+{
+	if (len <= SAMPLE_BLOCKS * SAMPLE_BYTES)
+		return HashBytes(data, len);
+	uint64_t hash = HashBytes(data, 0);
+	size_t step = (len - SAMPLE_BYTES) / (SAMPLE_BLOCKS - 1);
+	for (size_t block = 0; block != SAMPLE_BLOCKS; block++)
+		hash = HashBytes(data + block * step, SAMPLE_BYTES, hash);
+	return hash;
+}
+
+// ======================================================================================
+// Stamp of path with the sample hash of its text, false if it does not exist.
+static bool FileStamp(const char* path, const char* data, size_t len, BaselineStamp& stamp)
+{
+	memset(&stamp, 0, sizeof(stamp));
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	BY_HANDLE_FILE_INFORMATION info;
+	FILE_BASIC_INFO basic;
+	bool ok = GetFileInformationByHandle(file, &info)
+		&& GetFileInformationByHandleEx(file, FileBasicInfo, &basic, sizeof(basic));
+	CloseHandle(file);
+	if (!ok)
+		return false;
+	stamp.fileSize = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+	stamp.fileId = ((uint64_t)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+	stamp.modifyNs = basic.LastWriteTime.QuadPart * 100;
+	stamp.changeNs = basic.ChangeTime.QuadPart * 100;
+#else
+	struct stat fileStat;
+	if (stat(path, &fileStat) != 0)
+		return false;
+	stamp.fileSize = (uint64_t)fileStat.st_size;
+	stamp.fileId = (uint64_t)fileStat.st_ino;
+#ifdef __APPLE__
+	stamp.modifyNs = (int64_t)fileStat.st_mtimespec.tv_sec * 1000000000 + fileStat.st_mtimespec.tv_nsec;
+	stamp.changeNs = (int64_t)fileStat.st_ctimespec.tv_sec * 1000000000 + fileStat.st_ctimespec.tv_nsec;
+#else
+	stamp.modifyNs = (int64_t)fileStat.st_mtim.tv_sec * 1000000000 + fileStat.st_mtim.tv_nsec;
+	stamp.changeNs = (int64_t)fileStat.st_ctim.tv_sec * 1000000000 + fileStat.st_ctim.tv_nsec;
+#endif
+#endif
+	stamp.sampleHash = SampleHash(data, len);
+	return stamp.fileSize == len;
+}
+
+// ======================================================================================
+// Offsets and hashes of the lines of frame.
+static void BuildIndex(const char* frame, size_t len, std::vector<uint64_t>& offsets, std::vector<uint64_t>& hashes)
+{
+	std::vector<size_t> lines;
+	LineOffsets(frame, len, lines);
+	offsets.assign(lines.begin(), lines.end());
+	hashes.resize(lines.size() - 1);
+	for (size_t idx = 0; idx + 1 < lines.size(); idx++)
+		hashes[idx] = Baseline::LineHash(frame + lines[idx], lines[idx + 1] - lines[idx]);
+}
+
+// ======================================================================================
+static bool WriteIndex(const std::string& indexPath, const BaselineStamp& stamp,
+	const std::vector<uint64_t>& offsets, const std::vector<uint64_t>& hashes)
+{
+	FILE* file = fopen(indexPath.c_str(), "wb");
+	if (file == NULL)
+		return false;
+	BaselineIndexHeader header;
+	memcpy(header.magic, s_indexMagic, sizeof(header.magic));
+	header.stamp = stamp;
+	header.lineCnt = hashes.size();
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), file) == offsets.size()
+		&& fwrite(hashes.data(), sizeof(uint64_t), hashes.size(), file) == hashes.size();
+	return fclose(file) == 0 && ok;
+}
+
+// ======================================================================================
+uint64_t Baseline::LineHash(const char* line, size_t len)
+{
+	if (len != 0 && line[len - 1] == '\n')
+		len--;
+	return HashBytes(line, len);
+}
+
+// ======================================================================================
+Baseline::Baseline() :
+	m_open(false),
+	m_indexLoaded(false),
+	m_lineCnt(0),
+	m_offsets(NULL),
+	m_hashes(NULL)
+{ }
+
+// ======================================================================================
+bool Baseline::Save(const char* path, const char* frame, size_t len, std::string& error)
+{
+	FILE* file = fopen(path, "wb");
+	bool ok = file != NULL && fwrite(frame, 1, len, file) == len;
+	if (file != NULL && fclose(file) != 0)
+		ok = false;
+	BaselineStamp stamp;
+	if (!ok || !FileStamp(path, frame, len, stamp))
+	{
+		error = std::string("Failed to write baseline ") + path;
+		return false;
+	}
+
+	std::vector<uint64_t> offsets;
+	std::vector<uint64_t> hashes;
+	BuildIndex(frame, len, offsets, hashes);
+	std::string indexPath = std::string(path) + ".idx";
+	if (!WriteIndex(indexPath, stamp, offsets, hashes))
+	{
+		error = "Failed to write baseline index " + indexPath;
+		return false;
+	}
+	return true;
+}
+
+// ======================================================================================
+// Index matching the snapshot stamp, used in place from its mapping.
+bool Baseline::LoadIndex(const std::string& indexPath, const BaselineStamp& stamp)
+{
+	if (!m_index.Open(indexPath.c_str()) || m_index.Size() < sizeof(BaselineIndexHeader))
+		return false;
+	const BaselineIndexHeader* header = (const BaselineIndexHeader*)m_index.Data();
+	if (memcmp(header->magic, s_indexMagic, sizeof(header->magic)) != 0
+		|| memcmp(&header->stamp, &stamp, sizeof(stamp)) != 0
+		|| m_index.Size() != sizeof(BaselineIndexHeader) + (header->lineCnt * 2 + 1) * sizeof(uint64_t))
+	{
+		m_index.Close();
+		return false;
+	}
+	m_lineCnt = (size_t)header->lineCnt;
+	m_offsets = (const uint64_t*)(header + 1);
+	m_hashes = m_offsets + m_lineCnt + 1;
+	return m_offsets[m_lineCnt] == stamp.fileSize;
+}
+
+// ======================================================================================
+bool Baseline::Open(const char* path, std::string& error)
+{
+	if (!m_file.Open(path))
+	{
+		error = std::string("Failed to open baseline ") + path;
+		return false;
+	}
+
+	// Stat and a sample of the snapshot, far less than rebuilding the index.
+	BaselineStamp stamp;
+	std::string indexPath = std::string(path) + ".idx";
+	m_indexLoaded = FileStamp(path, m_file.Data(), m_file.Size(), stamp) && LoadIndex(indexPath, stamp);
+	if (!m_indexLoaded)
+	{
+		// Missing or stale, built once and kept for the next start.
+		m_index.Close();
+		BuildIndex(m_file.Data(), m_file.Size(), m_builtOffsets, m_builtHashes);
+		m_lineCnt = m_builtHashes.size();
+		m_offsets = m_builtOffsets.data();
+		m_hashes = m_builtHashes.data();
+		if (stamp.fileSize == m_file.Size())
+			WriteIndex(indexPath, stamp, m_builtOffsets, m_builtHashes);
+	}
+	m_open = true;
+	return true;
+}
+
+// ======================================================================================
+// fn(matched, text, textLen, baseLine, baseLen) in frame order: runs of lines which
+// match the baseline with matched true, each deviating line with the baseline line at
+// its position (empty past the last one) with matched false.
+template <typename Fn>
+Baseline::Deviation Baseline::ForEachLine(const char* frame, size_t len, Fn fn) const
+{
+	Deviation deviation;
+	memset(&deviation, 0, sizeof(deviation));
+	const char* base = m_file.Data();
+	const char* end = frame + len;
+	const char* line = frame;
+	const char* matchStart = frame;
+	while (line != end)
+	{
+		const char* eol = (const char*)memchr(line, '\n', end - line);
+		const char* next = (eol == NULL) ? end : eol + 1;
+		size_t idx = deviation.lines++;
+		if (idx < m_lineCnt)
+		{
+			size_t baseLen = (size_t)(m_offsets[idx + 1] - m_offsets[idx]);
+			size_t textLen = (size_t)(((eol == NULL) ? end : eol) - line);
+			size_t baseText = (baseLen != 0 && base[m_offsets[idx + 1] - 1] == '\n') ? baseLen - 1 : baseLen;
+			if (textLen == baseText && LineHash(line, textLen) == m_hashes[idx])
+			{
+				line = next;
+				continue;
+			}
+			deviation.changed++;
+			fn(true, matchStart, (size_t)(line - matchStart), (const char*)NULL, (size_t)0);
+			fn(false, line, (size_t)(next - line), base + m_offsets[idx], baseLen);
+		}
+		else
+		{
+			deviation.added++;
+			fn(true, matchStart, (size_t)(line - matchStart), (const char*)NULL, (size_t)0);
+			fn(false, line, (size_t)(next - line), "", (size_t)0);
+		}
+		line = matchStart = next;
+	}
+	fn(true, matchStart, (size_t)(end - matchStart), (const char*)NULL, (size_t)0);
+	if (deviation.lines < m_lineCnt)
+		deviation.missing = m_lineCnt - deviation.lines;
+	return deviation;
+}
+
+// ======================================================================================
+Baseline::Deviation Baseline::Show(const char* frame, size_t len, std::ostream& out)
+{
+	return ForEachLine(frame, len, [&out](bool matched, const char* text, size_t textLen, const char* baseLine, size_t baseLen)
+		{
+			if (textLen == 0)
+				return;
+			if (matched)
+			{
+				Colorize::write(out, MATCH_COLOR);
+				Colorize::write(out, text, (unsigned)textLen);
+			}
+			else
+			{
+				showLineDiff(text, textLen, baseLine, baseLen, out);
+			}
+		});
+}
+
+// ======================================================================================
+Baseline::Deviation Baseline::Compare(const char* frame, size_t len) const
+{
+	return ForEachLine(frame, len, [](bool, const char*, size_t, const char*, size_t) { });
+}
@@ -0,0 +1,109 @@
+// ------------------------------------------------------------------------------------------------
+// Baseline.h - Golden snapshot compared with each frame
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "MappedFile.h"
+
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct BaselineStamp;
+
+// ======================================================================================
+// Known good snapshot of the kept lines (llwatch --baseline / --save-baseline).
+// The snapshot file is memory mapped, its line offsets and line hashes are read from
+// a sidecar index <file>.idx so a frame is compared line by line against the hashes
+// without reading or hashing the baseline each tick. Only lines whose hash or length
+// differ touch the baseline text, to highlight the characters which differ.
+//
+// The sidecar records the size, file id, modify and change times of the snapshot and
+// the hash of a sample of its blocks, a stale or missing index is rebuilt once when
+// the baseline is opened (and written back if possible).
+class Baseline
+{
+public:
+	// Lines of the last frame compared.
+	struct Deviation
+	{
+		size_t lines;			// frame lines
+		size_t changed;			// differ from the baseline line at the same position
+		size_t added;			// past the last baseline line
+		size_t missing;			// baseline lines past the last frame line
+	};
+
+	Baseline();
+
+	// Save frame as baseline path with its index.
+	static bool Save(const char* path, const char* frame, size_t len, std::string& error);
+
+	// Map baseline path and its index.
+	bool Open(const char* path, std::string& error);
+
+	bool IsOpen() const
+	{ return m_open; }
+
+	size_t Lines() const
+	{ return m_lineCnt; }
+
+	// True if the index was read from the sidecar (not rebuilt).
+	bool IndexLoaded() const
+	{ return m_indexLoaded; }
+
+	// Write frame highlighting characters which deviate from the baseline.
+	Deviation Show(const char* frame, size_t len, std::ostream& out = std::cout);
+
+	// Compare only, nothing written.
+	Deviation Compare(const char* frame, size_t len) const;
+
+	// Hash of a line, without its newline.
+	static uint64_t LineHash(const char* line, size_t len);
+
+private:
+	Baseline(const Baseline&);
+	Baseline& operator=(const Baseline&);
+
+	template <typename Fn>
+	Deviation ForEachLine(const char* frame, size_t len, Fn fn) const;
+
+	bool LoadIndex(const std::string& indexPath, const BaselineStamp& stamp);
+
+	MappedFile m_file;
+	MappedFile m_index;
+	bool     m_open;
+	bool     m_indexLoaded;
+	size_t   m_lineCnt;
+	const uint64_t* m_offsets;		// lineCnt + 1 line starts, into m_index or m_builtOffsets
+	const uint64_t* m_hashes;		// lineCnt line hashes
+	std::vector<uint64_t> m_builtOffsets;
+	std::vector<uint64_t> m_builtHashes;
+};
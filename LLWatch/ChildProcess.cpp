@@ -0,0 +1,69 @@
+// ---------------------------------------------------------------------------
+// ChildProcess.cpp - Platform neutral child process interface
+// 
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ---------------------------------------------------------------------------
+
+#include "ChildProcess.h"
+
+#ifdef _WIN32
+#include "WinProcess.h"
+#include <Windows.h>
+#else
+#include "PosixProcess.h"
+#include <errno.h>
+#include <string.h>
+#endif
+
+// ======================================================================================
+ChildProcess* ChildProcess::Create()
+{
+#ifdef _WIN32
+	return new WinProcess();
+#else
+	return new PosixProcess();
+#endif
+}
+
+// ======================================================================================
+bool ChildProcess::LimitSelf(const RunLimits& limits, std::string& error)
+{
+#ifdef _WIN32
+	HANDLE self = GetCurrentProcess();
+	if (limits.nice != 0 && !SetPriorityClass(self, (limits.nice < 10) ? BELOW_NORMAL_PRIORITY_CLASS : IDLE_PRIORITY_CLASS))
+		error = "SetPriorityClass failed";
+	else if (limits.lowIo && !SetPriorityClass(self, PROCESS_MODE_BACKGROUND_BEGIN))
+		error = "Background mode failed";
+	else if (limits.affinity != 0 && !SetProcessAffinityMask(self, (DWORD_PTR)limits.affinity))
+		error = "SetProcessAffinityMask failed";
+#else
+	const char* failed = PosixProcess::SetPriority(limits);
+	if (failed != NULL)
+		error = std::string(failed) + " failed: " + strerror(errno);
+#endif
+	return error.empty();
+}
@@ -0,0 +1,137 @@
+// ---------------------------------------------------------------------------
+// ChildProcess.h - Platform neutral child process interface
+// 
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ---------------------------------------------------------------------------
+
+#pragma once
+
+#include "RunUsage.h"
+
+#include <chrono>
+#include <functional>
+#include <string>
+
+// ======================================================================================
+// Child process whose stdout and stderr are captured by the watcher.
+// WinProcess (Windows) and PosixProcess (Linux, macOS) implement it.
+class ChildProcess
+{
+public:
+	ChildProcess() :
+		m_exitCode(0), m_bytesRead(0), m_firstByteMs(-1),
+		m_usePty(false), m_ptyCols(80), m_ptyRows(24), m_passthrough(false), m_headless(false)
+	{ }
+	virtual ~ChildProcess() { }
+
+	// Capture through a pseudo terminal (ConPTY / openpty) instead of a pipe.
+	// The child sees a terminal of cols x rows and line buffers its output.
+	void SetPty(bool usePty, unsigned cols = 80, unsigned rows = 24)
+	{
+		m_usePty = usePty;
+		m_ptyCols = cols;
+		m_ptyRows = rows;
+	}
+
+	// Start commandLine, return false if it could not be started.
+	virtual bool CreateChildProcess(const std::string& commandLine, unsigned long waitMsec = 10) = 0;
+
+	// Read child output until it exits, echo it to our stdout and/or append it to pBuffer.
+	virtual void ReadFromPipe(bool echo, std::string* pBuffer = NULL) = 0;
+
+	// Output is only echoed to our stdout, never captured (llwatch -d).
+	// Windows hands our stdout to the child, no bytes pass through the watcher
+	// and m_bytesRead stays 0. POSIX moves the bytes with splice (Linux).
+	void SetPassthrough(bool passthrough)
+	{ m_passthrough = passthrough; }
+
+	// No console (llwatch --daemon), children do not get a console window (Windows)
+	// and a command which can not be started is only reported by returning false.
+	void SetHeadless(bool headless)
+	{ m_headless = headless; }
+
+	// Priority, affinity and caps of each child.
+	void SetLimits(const RunLimits& limits)
+	{ m_limits = limits; }
+
+	// Apply the priority and affinity of limits to llwatch itself, before it starts
+	// threads so they all get them. Children inherit them as well (POSIX).
+	static bool LimitSelf(const RunLimits& limits, std::string& error);
+
+	// Child stdout and stderr go to this file (truncated), empty for a pipe.
+	// ReadFromPipe then only waits for the child to exit.
+	void SetCaptureFile(const std::string& path)
+	{ m_captureFile = path; }
+
+	// Optional receiver of each block of output as it is read, ex: streaming display.
+	typedef std::function<void (const char* data, size_t len)> DataSink;
+	void SetDataSink(const DataSink& sink)
+	{ m_dataSink = sink; }
+
+	// Release process resources, waiting for the child if still running.
+	virtual void CloseProcess() = 0;
+
+	unsigned long m_exitCode;	// exit code of last run, 128+signal if killed (POSIX)
+	size_t m_bytesRead;			// bytes read by last ReadFromPipe
+	double m_firstByteMs;		// start of CreateChildProcess to first output byte, -1 if none
+	RunUsage m_usage;			// resources of last run, valid once CloseProcess returns
+
+	// Default process backend of this platform.
+	static ChildProcess* Create();
+
+protected:
+	typedef std::chrono::steady_clock Clock;
+
+	void StartClock()
+	{
+		m_startTime = Clock::now();
+		m_firstByteMs = -1;
+		m_usage = RunUsage();
+	}
+
+	// Count bytes read, remember when the first one arrived, pass them to the sink.
+	void NoteRead(const char* data, size_t len)
+	{
+		if (len == 0)
+			return;
+		if (m_firstByteMs < 0)
+			m_firstByteMs = std::chrono::duration<double, std::milli>(Clock::now() - m_startTime).count();
+		m_bytesRead += len;
+		if (m_dataSink)
+			m_dataSink(data, len);
+	}
+
+	bool     m_usePty;
+	unsigned m_ptyCols;
+	unsigned m_ptyRows;
+	bool     m_passthrough;
+	bool     m_headless;
+	RunLimits m_limits;
+	std::string m_captureFile;
+	Clock::time_point m_startTime;
+	DataSink m_dataSink;
+};
@@ -31,8 +31,17 @@
 #define _CRT_SECURE_NO_WARNINGS
 #include "Colorize.h"
 
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
 Colorize::colorFg Colorize::sFgColor = Colorize::whiteFg;
 Colorize::colorBg Colorize::sBgColor = Colorize::blackBg;
+
+#ifdef _WIN32
 static WORD sDefColor = 0xff0f;   // White text on black background;
 
 void init(HANDLE hConsoleOutput)
@@ -58,6 +67,33 @@ std::ostream& Colorize::setColor(std::ostream& out, Colorize::colorFg fg, Colori
     }
     return out;
 }
+#else
+// ------------------------------------------------------------------------------------------------
+// Convert Windows attribute bits (1=blue,2=green,4=red) to ANSI color index (1=red,2=green,4=blue)
+static unsigned AnsiColor(unsigned winColor)
+{
+    return ((winColor & 4) ? 1 : 0) | (winColor & 2) | ((winColor & 1) ? 4 : 0);
+}
+
+// ------------------------------------------------------------------------------------------------
+std::ostream& Colorize::setColor(std::ostream& out, Colorize::colorFg fg, Colorize::colorBg bg)
+{
+    int fd = -1;
+    if ((void*)std::cout.rdbuf() == (void*)out.rdbuf())
+        fd = STDOUT_FILENO;
+    else if ((void*)std::cerr.rdbuf() == (void*)out.rdbuf())
+        fd = STDERR_FILENO;
+    if (fd != -1 && isatty(fd))
+    {
+        sFgColor = fg;
+        sBgColor = bg;
+        unsigned bgColor = (unsigned)bg >> 4;
+        out << "\033[" << ((fg & FOREGROUND_INTENSITY) ? 90 : 30) + AnsiColor(fg)
+            << ";" << ((bgColor & 8) ? 100 : 40) + AnsiColor(bgColor) << "m";
+    }
+    return out;
+}
+#endif
 
 // ------------------------------------------------------------------------------------------------
 // Output console text with inline colorization via encoding: !BF (B=background, F=foreground)
@@ -30,7 +30,19 @@
 
 #pragma once
 
+#ifdef _WIN32
 #include <Windows.h>
+#else
+// Same bit layout as Windows console attributes, mapped to ANSI sequences.
+#define FOREGROUND_BLUE      0x0001
+#define FOREGROUND_GREEN     0x0002
+#define FOREGROUND_RED       0x0004
+#define FOREGROUND_INTENSITY 0x0008
+#define BACKGROUND_BLUE      0x0010
+#define BACKGROUND_GREEN     0x0020
+#define BACKGROUND_RED       0x0040
+#endif
+
 #include <iostream>
 #include <sstream>
 
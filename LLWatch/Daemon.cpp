@@ -0,0 +1,524 @@
+// ------------------------------------------------------------------------------------------------
+// Daemon.cpp - Headless watch of many jobs
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "Daemon.h"
+#include "ChildProcess.h"
+#include "FrameOps.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fstream>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+// ======================================================================================
+// UTC time stamp, 2016-01-23T10:20:30Z
+static void FormatTime(char* buf, size_t bufLen)
+{
+	time_t now = time(NULL);
+	struct tm utc;
+#ifdef _WIN32
+	gmtime_s(&utc, &now);
+#else
+	gmtime_r(&now, &utc);
+#endif
+	strftime(buf, bufLen, "%Y-%m-%dT%H:%M:%SZ", &utc);
+}
+
+// Positive decimal setting.
+static bool ParseNumber(const lstring& value, unsigned& number)
+{
+	char* end;
+	unsigned long num = strtoul(value.c_str(), &end, 10);
+	if (value.empty() || *end != '\0' || num > 0xfffffff)
+		return false;
+	number = (unsigned)num;
+	return true;
+}
+
+// ======================================================================================
+Daemon::Daemon() :
+	m_running(0),
+	m_concurrency(8),
+	m_jitterPercent(10),
+	m_random((uint32_t)time(NULL)),
+	m_log(NULL)
+{ }
+
+// Pool is joined first, workers still reference the jobs.
+Daemon::~Daemon()
+{
+	m_pool.reset();
+	if (m_log != NULL && m_log != stderr)
+		fclose(m_log);
+}
+
+// ======================================================================================
+Daemon::SinkFile* Daemon::GetSinkFile(const std::string& path)
+{
+	for (size_t idx = 0; idx != m_sinkFiles.size(); idx++)
+	{
+		if (m_sinkFiles[idx]->path == path)
+			return m_sinkFiles[idx].get();
+	}
+	m_sinkFiles.push_back(std::unique_ptr<SinkFile>(new SinkFile()));
+	m_sinkFiles.back()->path = path;
+	return m_sinkFiles.back().get();
+}
+
+// ======================================================================================
+bool Daemon::Load(const char* configFile, std::string& error)
+{
+	std::ifstream in(configFile);
+	if (!in)
+	{
+		error = std::string(configFile) + ": can not open";
+		return false;
+	}
+
+	// Settings before the first job are defaults of all jobs.
+	Job defaults;
+	defaults.seconds = 2;
+	defaults.isGrep = false;
+	defaults.topLines = 0;
+	defaults.bottomLines = 0;
+	Job* job = &defaults;
+
+	std::string line;
+	unsigned lineNum = 0;
+	char where[32];
+	while (std::getline(in, line))
+	{
+		lineNum++;
+		snprintf(where, sizeof(where), ":%u: ", lineNum);
+		lstring text(line);
+		text.trim();
+		if (text.empty() || text[0] == '#')
+			continue;
+
+		if (text[0] == '[')
+		{
+			size_t end = text.find(']');
+			if (end == std::string::npos || end == 1)
+			{
+				error = configFile + (where + ("bad job name " + text));
+				return false;
+			}
+			m_jobs.push_back(std::unique_ptr<Job>(new Job(defaults)));
+			job = m_jobs.back().get();
+			job->name = text.substr(1, end - 1);
+			continue;
+		}
+
+		size_t eq = text.find('=');
+		if (eq == std::string::npos)
+		{
+			error = configFile + (where + ("expected name = value, " + text));
+			return false;
+		}
+		lstring key(text.substr(0, eq));
+		lstring value(text.substr(eq + 1));
+		key.trim();
+		value.trim();
+
+		bool ok = true;
+		if (key == "concurrency" || key == "jitter" || key == "log")
+		{
+			if (job != &defaults)
+			{
+				error = configFile + (where + (key + " must be set before the first job"));
+				return false;
+			}
+			if (key == "concurrency")
+				ok = ParseNumber(value, m_concurrency) && m_concurrency != 0;
+			else if (key == "jitter")
+				ok = ParseNumber(value, m_jitterPercent) && m_jitterPercent <= 100;
+			else
+				m_logFile = value;
+		}
+		else if (key == "command")
+			job->command = value;
+		else if (key == "interval")
+			ok = ParseNumber(value, job->seconds);
+		else if (key == "top")
+			ok = ParseNumber(value, job->topLines);
+		else if (key == "bottom")
+			ok = ParseNumber(value, job->bottomLines);
+		else if (key == "replace")
+			job->replaceStr = value;
+		else if (key == "grep")
+		{
+			try
+			{
+				job->grepLinePat = std::regex(value);
+				job->isGrep = true;
+			}
+			catch (const std::regex_error& ex)
+			{
+				error = configFile + (where + ("bad grep pattern, " + std::string(ex.what())));
+				return false;
+			}
+		}
+		else if (key == "mask")
+		{
+			std::string maskError;
+			if (!job->mask.Add(value, maskError))
+			{
+				error = configFile + (where + maskError);
+				return false;
+			}
+		}
+		else if (key == "sink")
+		{
+			size_t sp = value.find_first_of(" \t");
+			lstring type(value.substr(0, sp));
+			lstring path((sp == std::string::npos) ? "" : value.substr(sp + 1));
+			path.trim();
+			Sink sink;
+			sink.type = (type == "file") ? SINK_FILE : ((type == "record") ? SINK_RECORD : SINK_EVENTS);
+			ok = !path.empty() && (type == "file" || type == "record" || type == "events");
+			if (ok)
+			{
+				sink.file = GetSinkFile(path);
+				job->sinks.push_back(sink);
+			}
+		}
+		else
+		{
+			error = configFile + (where + ("unknown setting " + key));
+			return false;
+		}
+
+		if (!ok)
+		{
+			error = configFile + (where + ("bad value for " + key + ", " + value));
+			return false;
+		}
+	}
+
+	if (m_jobs.empty())
+	{
+		error = std::string(configFile) + ": no [job] sections";
+		return false;
+	}
+	for (size_t idx = 0; idx != m_jobs.size(); idx++)
+	{
+		Job& j = *m_jobs[idx];
+		if (j.command.empty())
+		{
+			error = std::string(configFile) + ": job " + j.name + " has no command";
+			return false;
+		}
+		j.seconds = (std::max)(j.seconds, 1u);
+		j.frameHash = 0;
+		j.exitCode = 0;
+		j.runCnt = j.changeCnt = j.skipCnt = j.failCnt = 0;
+		j.runMs = j.totalMs = j.maxMs = 0;
+		j.baseTick = 0;
+	}
+	return true;
+}
+
+// ======================================================================================
+void Daemon::Log(const char* fmt, ...)
+{
+	char stamp[32];
+	FormatTime(stamp, sizeof(stamp));
+	std::lock_guard<std::mutex> lock(m_logMutex);
+	fprintf(m_log, "%s ", stamp);
+	va_list args;
+	va_start(args, fmt);
+	vfprintf(m_log, fmt, args);
+	va_end(args);
+	fputc('\n', m_log);
+	fflush(m_log);
+}
+
+// ======================================================================================
+TimerWheel::Tick Daemon::NowTick() const
+{
+	return (TimerWheel::Tick)std::chrono::duration_cast<std::chrono::milliseconds>(
+		Clock::now() - m_startTime).count() / TICK_MSEC;
+}
+
+// ======================================================================================
+// Put job in the wheel for its baseTick plus random jitter, caller holds m_mutex.
+void Daemon::Schedule(unsigned idx)
+{
+	Job& job = *m_jobs[idx];
+	TimerWheel::Tick due = job.baseTick;
+	TimerWheel::Tick maxJitter = (TimerWheel::Tick)job.seconds * 1000 / TICK_MSEC * m_jitterPercent / 100;
+	if (maxJitter != 0)
+	{
+		m_random = m_random * 1664525u + 1013904223u;
+		due += (m_random >> 8) % (maxJitter + 1);
+	}
+	TimerWheel::Tick now = m_wheel->Now();
+	m_wheel->Schedule(idx, (due > now) ? due - now : 1);
+}
+
+// ======================================================================================
+// Worker, run the job once, write its sinks if the kept lines changed.
+void Daemon::RunJob(unsigned idx)
+{
+	Job& job = *m_jobs[idx];
+	static thread_local lstring s_output;	// capture buffer reused by each worker
+	lstring& output = s_output;
+	output.clear();
+
+	Clock::time_point start = Clock::now();
+	std::unique_ptr<ChildProcess> process(ChildProcess::Create());
+	process->SetHeadless(true);
+	process->SetLimits(m_limits);
+	bool started = process->CreateChildProcess(job.command);
+	if (started)
+		process->ReadFromPipe(false, &output);
+	process->CloseProcess();
+
+	if (job.isGrep)
+		RegexTrim(output, job.grepLinePat, job.replaceStr);
+	TrimTopBottom(output, job.topLines, job.bottomLines);
+	double runMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	// Lines changed against the previous frame, by line hash so only 8 bytes per
+	// line are kept between runs. Hashed with volatile tokens masked.
+	static thread_local lstring s_key;
+	const lstring& key = job.mask.Empty() ? output : s_key;
+	if (!job.mask.Empty())
+		job.mask.Key(output.c_str(), output.length(), s_key);
+	uint64_t frameHash = HashBytes(key.c_str(), key.length());
+	bool changed = (job.runCnt == 0 || frameHash != job.frameHash);
+	if (changed && started)
+	{
+		std::vector<uint64_t> lineHashes;
+		lineHashes.reserve(job.lineHashes.size());
+		unsigned changedLines = 0;
+		for (size_t off = 0; off < key.length(); )
+		{
+			size_t eol = key.find('\n', off);
+			size_t end = (eol == std::string::npos) ? key.length() : eol + 1;
+			size_t lineIdx = lineHashes.size();
+			lineHashes.push_back(HashBytes(key.c_str() + off, end - off));
+			if (lineIdx >= job.lineHashes.size() || job.lineHashes[lineIdx] != lineHashes.back())
+				changedLines++;
+			off = end;
+		}
+		if (job.lineHashes.size() > lineHashes.size())
+			changedLines += (unsigned)(job.lineHashes.size() - lineHashes.size());
+		job.lineHashes.swap(lineHashes);
+		job.frameHash = frameHash;
+		WriteSinks(job, output, process->m_exitCode, changedLines, runMs);
+	}
+	if (output.capacity() > (1u << 24))
+		lstring().swap(output);				// do not keep a huge buffer per worker
+	if (s_key.capacity() > (1u << 24))
+		lstring().swap(s_key);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	job.exitCode = process->m_exitCode;
+	job.runCnt++;
+	job.changeCnt += (changed && started) ? 1 : 0;
+	job.failCnt = started ? 0 : job.failCnt + 1;
+	job.runMs = runMs;
+	job.totalMs += runMs;
+	job.maxMs = (std::max)(job.maxMs, runMs);
+	if (!started && job.failCnt == 1)
+		Log("%s: failed to start %s", job.name.c_str(), job.command.c_str());
+	if (process->m_usage.breached != 0)
+		Log("%s: run %u hit limit %s", job.name.c_str(), job.runCnt, process->m_usage.Breaches().c_str());
+	m_running--;
+	m_finished.push_back(idx);
+	m_changed.notify_one();
+}
+
+// ======================================================================================
+// Rename over an existing file, readers see the old or the new frame, never a partial one.
+static bool MoveOver(const std::string& fromPath, const std::string& toPath)
+{
+#ifdef _WIN32
+	return MoveFileExA(fromPath.c_str(), toPath.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(fromPath.c_str(), toPath.c_str()) == 0;
+#endif
+}
+
+// ======================================================================================
+// Worker, frame changed. Sink files are locked while written, jobs may share them.
+void Daemon::WriteSinks(Job& job, const lstring& frame, unsigned long exitCode, unsigned changedLines, double runMs)
+{
+	char stamp[32];
+	FormatTime(stamp, sizeof(stamp));
+	bool newline = !frame.empty() && frame[frame.length() - 1] != '\n';
+
+	for (size_t idx = 0; idx != job.sinks.size(); idx++)
+	{
+		const Sink& sink = job.sinks[idx];
+		std::lock_guard<std::mutex> lock(sink.file->mutex);
+		std::string path = sink.file->path;
+		if (sink.type == SINK_FILE)
+			path += ".tmp";
+		FILE* out = fopen(path.c_str(), (sink.type == SINK_FILE) ? "wb" : "ab");
+		if (out == NULL)
+		{
+			Log("%s: can not write %s, %s", job.name.c_str(), path.c_str(), strerror(errno));
+			continue;
+		}
+
+		switch (sink.type)
+		{
+		case SINK_FILE:
+			fwrite(frame.c_str(), 1, frame.length(), out);
+			break;
+		case SINK_RECORD:
+			fprintf(out, "==== %s %s exit %lu %.0fms\n", stamp, job.name.c_str(), exitCode, runMs);
+			fwrite(frame.c_str(), 1, frame.length(), out);
+			if (newline)
+				fputc('\n', out);
+			break;
+		case SINK_EVENTS:
+			fprintf(out, "%s %s exit=%lu changed=%u lines=%u ms=%.0f\n",
+				stamp, job.name.c_str(), exitCode, changedLines, (unsigned)job.lineHashes.size(), runMs);
+			break;
+		}
+
+		bool ok = (fclose(out) == 0);
+		if (sink.type == SINK_FILE && (!ok || !MoveOver(path, sink.file->path)))
+			Log("%s: can not replace %s", job.name.c_str(), sink.file->path.c_str());
+	}
+}
+
+// ======================================================================================
+void Daemon::Summary()
+{
+	unsigned runs = 0, changes = 0, skips = 0;
+	for (size_t idx = 0; idx != m_jobs.size(); idx++)
+	{
+		const Job& job = *m_jobs[idx];
+		runs += job.runCnt;
+		changes += job.changeCnt;
+		skips += job.skipCnt;
+		Log("%s: runs=%u changes=%u skipped=%u exit=%lu avgMs=%.0f maxMs=%.0f",
+			job.name.c_str(), job.runCnt, job.changeCnt, job.skipCnt, job.exitCode,
+			job.runCnt ? job.totalMs / job.runCnt : 0.0, job.maxMs);
+	}
+	double secs = std::chrono::duration<double>(Clock::now() - m_startTime).count();
+	Log("stopped after %.0fs, %u jobs, %u runs, %u changes, %u skipped",
+		secs, (unsigned)m_jobs.size(), runs, changes, skips);
+}
+
+// ======================================================================================
+void Daemon::Run(unsigned maxRunCnt, volatile bool& stop)
+{
+	if (m_jobs.empty())
+		return;
+	m_log = stderr;
+	if (!m_logFile.empty() && (m_log = fopen(m_logFile.c_str(), "a")) == NULL)
+	{
+		m_log = stderr;
+		Log("can not open log %s, %s", m_logFile.c_str(), strerror(errno));
+	}
+
+	unsigned jobCnt = (unsigned)m_jobs.size();
+	m_concurrency = (std::min)(m_concurrency, jobCnt);
+	m_wheel.reset(new TimerWheel(jobCnt));
+	m_pool.reset(new ThreadPool(m_concurrency));
+	m_startTime = Clock::now();
+	Log("started %u jobs, concurrency %u, jitter %u%%", jobCnt, m_concurrency, m_jitterPercent);
+
+	// Wake at least once a second to notice stop.
+	const TimerWheel::Tick stopTicks = 1000 / TICK_MSEC;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	// With jitter, first starts are spread over each job's interval by its name so
+	// they do not all start together and keep their place across restarts.
+	for (unsigned idx = 0; idx != jobCnt; idx++)
+	{
+		Job& job = *m_jobs[idx];
+		job.baseTick = (m_jitterPercent != 0) ? HashBytes(job.name.c_str(), job.name.length()) % IntervalTicks(job) : 0;
+		Schedule(idx);
+	}
+
+	std::vector<unsigned> expired;
+	while (!stop)
+	{
+		TimerWheel::Tick now = NowTick();
+		expired.clear();
+		m_wheel->Advance(now, expired);
+		m_ready.insert(m_ready.end(), expired.begin(), expired.end());
+
+		// Next start at the job's fixed rate, starts missed while it ran or waited
+		// for a worker are skipped. Jobs which failed to start back off.
+		for (size_t idx = 0; idx != m_finished.size(); idx++)
+		{
+			Job& job = *m_jobs[m_finished[idx]];
+			if (job.runCnt >= maxRunCnt)
+				continue;
+			TimerWheel::Tick interval = IntervalTicks(job) << (std::min)(job.failCnt, 4u);
+			job.baseTick += interval;
+			if (job.baseTick <= now)
+			{
+				TimerWheel::Tick missed = (now - job.baseTick) / interval + 1;
+				job.baseTick += missed * interval;
+				job.skipCnt += (unsigned)missed;
+			}
+			Schedule(m_finished[idx]);
+		}
+		m_finished.clear();
+
+		while (m_running < m_concurrency && !m_ready.empty())
+		{
+			unsigned idx = m_ready.front();
+			m_ready.pop_front();
+			m_running++;
+			m_pool->Submit([this, idx]() { RunJob(idx); });
+		}
+
+		if (m_running == 0 && m_ready.empty() && m_wheel->Count() == 0)
+			break;
+		TimerWheel::Tick ticks = m_wheel->TicksToNext();
+		ticks = (ticks == 0 || ticks > stopTicks) ? stopTicks : ticks;
+		m_changed.wait_until(lock, m_startTime + std::chrono::milliseconds((now + ticks) * TICK_MSEC));
+	}
+	lock.unlock();
+
+	// Let running commands finish.
+	m_pool.reset();
+	Summary();
+}
@@ -0,0 +1,178 @@
+// ------------------------------------------------------------------------------------------------
+// Daemon.h - Headless watch of many jobs
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+
+#pragma once
+
+#include "llstring.h"
+#include "RunUsage.h"
+#include "ThreadPool.h"
+#include "TimerWheel.h"
+#include "TokenMask.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// ======================================================================================
+// Headless watch of many jobs from a config file (llwatch --daemon jobs.conf).
+// Jobs are kept in a timer wheel, due jobs wait in a ready queue until one of the
+// 'concurrency' workers is free. Jobs run at a fixed rate, a job is never queued or
+// running twice: when a run (or its wait for a worker) overruns the next start the
+// missed starts are skipped and counted (backpressure), a command which can not be
+// started backs off up to 16 intervals. First starts are spread over the interval
+// and each start is delayed a random jitter so jobs do not line up. Each changed
+// frame goes to the job's sinks, files are opened only while writing so 1000 jobs
+// do not hold 1000 files.
+//
+// Config, lines starting with '#' are comments, settings before the first [job] are
+// defaults of all jobs:
+//   concurrency = 8        children running at once
+//   jitter = 10            percent of the interval, at most, added to each start
+//   log = llwatch.log      daemon messages and summary, default stderr
+//   [name]                 start of a job
+//   command = df -h
+//   interval = 30          seconds between starts (default 2)
+//   grep = <pattern>       replace = <text>     top = #lines     bottom = #lines
+//   mask = <pattern>       volatile tokens (or @time @date @number @hex @uuid) which
+//                          do not count as changes, repeat for more rules
+//   sink = file <path>     latest frame, replaced on each change
+//   sink = record <path>   each changed frame appended with a header line
+//   sink = events <path>   one line per change (jobs may share the file)
+class Daemon
+{
+public:
+	Daemon();
+	~Daemon();
+
+	// Read jobs, false with error set (file:line: message) if the config is bad.
+	bool Load(const char* configFile, std::string& error);
+
+	size_t Jobs() const
+	{ return m_jobs.size(); }
+
+	// Priority and caps of every job's runs, breaches are logged.
+	void SetLimits(const RunLimits& limits)
+	{ m_limits = limits; }
+
+	// Run until stop is set or each job ran maxRunCnt times.
+	void Run(unsigned maxRunCnt, volatile bool& stop);
+
+	// Scheduling resolution.
+	static const unsigned TICK_MSEC = 100;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	// Output file shared by the jobs naming the same path.
+	struct SinkFile
+	{
+		std::string path;
+		std::mutex mutex;
+	};
+
+	enum SinkType { SINK_FILE, SINK_RECORD, SINK_EVENTS };
+
+	struct Sink
+	{
+		SinkType type;
+		SinkFile* file;
+	};
+
+	struct Job
+	{
+		std::string name;
+		std::string command;
+		unsigned seconds;
+		bool     isGrep;
+		std::regex grepLinePat;
+		lstring  replaceStr;
+		unsigned topLines;
+		unsigned bottomLines;
+		TokenMask mask;
+		std::vector<Sink> sinks;
+
+		// Worker state, only touched by the worker running the job.
+		uint64_t frameHash;
+		std::vector<uint64_t> lineHashes;	// previous frame, counts changed lines
+
+		// Guarded by m_mutex.
+		unsigned long exitCode;
+		unsigned runCnt;
+		unsigned changeCnt;
+		unsigned skipCnt;				// due while running, coalesced
+		unsigned failCnt;				// failed to start in a row, backs off
+		double   runMs;					// last run
+		double   totalMs;
+		double   maxMs;
+		TimerWheel::Tick baseTick;		// start without jitter, next starts follow it
+	};
+
+	void RunJob(unsigned idx);
+	void WriteSinks(Job& job, const lstring& frame, unsigned long exitCode, unsigned changedLines, double runMs);
+	TimerWheel::Tick IntervalTicks(const Job& job) const
+	{ return (TimerWheel::Tick)job.seconds * 1000 / TICK_MSEC; }
+	void Schedule(unsigned idx);
+	TimerWheel::Tick NowTick() const;
+	void Log(const char* fmt, ...);
+	void Summary();
+	SinkFile* GetSinkFile(const std::string& path);
+
+	Daemon(const Daemon&);
+	Daemon& operator=(const Daemon&);
+
+	std::vector<std::unique_ptr<Job> > m_jobs;
+	std::vector<std::unique_ptr<SinkFile> > m_sinkFiles;
+	std::unique_ptr<ThreadPool> m_pool;
+	std::unique_ptr<TimerWheel> m_wheel;
+	Clock::time_point m_startTime;		// tick 0 of the wheel
+
+	std::mutex m_mutex;
+	std::condition_variable m_changed;	// a job finished
+	std::deque<unsigned> m_ready;		// due, waiting for a worker
+	std::vector<unsigned> m_finished;	// ran, to be rescheduled
+	unsigned m_running;
+
+	unsigned m_concurrency;
+	unsigned m_jitterPercent;
+	RunLimits m_limits;
+	uint32_t m_random;
+	std::string m_logFile;
+	FILE*    m_log;
+	std::mutex m_logMutex;
+};
@@ -0,0 +1,309 @@
+// ------------------------------------------------------------------------------------------------
+// Dashboard.cpp - Several watched commands in tiled panes
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+
+#include "Dashboard.h"
+#include "ChildProcess.h"
+#include "Colorize.h"
+#include "FrameOps.h"
+#include "WinCursor.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// ======================================================================================
+Dashboard::Dashboard() :
+	m_grepLinePat(NULL),
+	m_topLines(0),
+	m_bottomLines(0),
+	m_highlight(true),
+	m_usePty(false),
+	m_screenCols(0),
+	m_screenRows(0)
+{ }
+
+// Pool is joined first, workers still reference the panes.
+Dashboard::~Dashboard()
+{
+	m_pool.reset();
+}
+
+// ======================================================================================
+void Dashboard::AddCommand(const std::string& command, unsigned seconds)
+{
+	std::unique_ptr<Pane> pane(new Pane());
+	pane->command = command;
+	pane->seconds = seconds;
+	pane->process.reset(ChildProcess::Create());
+	pane->exitCode = 0;
+	pane->runMs = 0;
+	pane->runCnt = 0;
+	pane->running = false;
+	pane->dirty = true;
+	pane->x = pane->y = pane->cols = pane->rows = 0;
+	m_panes.push_back(std::move(pane));
+}
+
+// ======================================================================================
+// Worker, run the command once and publish its kept lines. cols x rows is the
+// tile size when it was started (pty size).
+void Dashboard::RunPane(Pane& pane, unsigned cols, unsigned rows)
+{
+	Clock::time_point start = Clock::now();
+	pane.output.clear();
+	if (m_usePty)
+		pane.process->SetPty(true, (std::max)(cols, 20u), (std::max)(rows - 1, 2u));
+	pane.process->SetLimits(m_limits);
+	if (pane.process->CreateChildProcess(pane.command))
+		pane.process->ReadFromPipe(false, &pane.output);
+	pane.process->CloseProcess();
+
+	if (m_grepLinePat)
+		RegexTrim(pane.output, *m_grepLinePat, m_replaceStr);
+	TrimTopBottom(pane.output, m_topLines, m_bottomLines);
+	if (m_bottomLines != 0 && !pane.output.empty() && pane.output[0] == '\n')
+		pane.output.erase(0, 1);		// bottom lines start at the newline before them
+
+	Clock::time_point end = Clock::now();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		pane.prevFrame.swap(pane.frame);
+		pane.frame.swap(pane.output);
+		pane.exitCode = pane.process->m_exitCode;
+		pane.breaches = pane.process->m_usage.Breaches();
+		pane.runMs = std::chrono::duration<double, std::milli>(end - start).count();
+		pane.runCnt++;
+		pane.running = false;
+		pane.dirty = true;
+		pane.nextRun = end + std::chrono::seconds(pane.seconds);
+	}
+	m_changed.notify_one();
+}
+
+// ======================================================================================
+// Tile the console, about as many columns as rows of panes. The last console row is
+// left empty so painting never scrolls. Returns true if the console size changed
+// (everything needs repainting).
+bool Dashboard::Layout()
+{
+	unsigned cols, rows;
+	if (!WinCursor::GetConsoleSize(cols, rows))
+	{
+		cols = 80;
+		rows = 24;
+	}
+	if (cols == m_screenCols && rows == m_screenRows)
+		return false;
+	m_screenCols = cols;
+	m_screenRows = rows;
+
+	unsigned paneCnt = (unsigned)m_panes.size();
+	unsigned gridCols = (unsigned)ceil(sqrt((double)paneCnt));
+	unsigned gridRows = (paneCnt + gridCols - 1) / gridCols;
+	unsigned tileCols = (cols - (gridCols - 1)) / gridCols;	// 1 column separator
+	unsigned tileRows = (std::max)(2u, (rows - 1) / gridRows);
+	for (unsigned idx = 0; idx != paneCnt; idx++)
+	{
+		Pane& pane = *m_panes[idx];
+		pane.x = (idx % gridCols) * (tileCols + 1);
+		pane.y = (idx / gridCols) * tileRows;
+		pane.cols = tileCols;
+		pane.rows = tileRows;
+		pane.dirty = true;
+	}
+	return true;
+}
+
+// ======================================================================================
+// One row of a pane, padded to cols. Control characters are shown as spaces so
+// they can not move the cursor out of the tile.
+void Dashboard::PaintLine(const char* line, size_t len, const char* prevLine, size_t prevLen, unsigned cols)
+{
+	len = (std::min)(len, (size_t)cols);
+	m_lineBuf.assign(line, len);
+	m_lineBuf.resize(cols, ' ');
+	for (size_t idx = 0; idx != len; idx++)
+	{
+		if ((unsigned char)m_lineBuf[idx] < ' ')
+			m_lineBuf[idx] = ' ';
+	}
+
+	// Characters past the end of the previous line are new.
+	size_t endIdx = (std::min)(len, prevLen);
+	size_t startIdx = 0;
+	bool match = true;
+	while (startIdx != len)
+	{
+		size_t idx = (startIdx < endIdx) ? NextDiffRun(line, prevLine, startIdx, endIdx, match) : len;
+		if (idx != startIdx)
+		{
+			Colorize::setColor(std::cout, match ? Colorize::whiteFg : Colorize::yellowIFg, Colorize::blackBg);
+			std::cout.write(m_lineBuf.c_str() + startIdx, idx - startIdx);
+		}
+		startIdx = idx;
+		match = !match;
+	}
+	Colorize::setColor(std::cout, Colorize::whiteFg, Colorize::blackBg);
+	std::cout.write(m_lineBuf.c_str() + len, cols - len);
+}
+
+// ======================================================================================
+// Title row then the frame lines, the last rows when keeping bottom lines.
+void Dashboard::Paint(Pane& pane, unsigned idx)
+{
+	char title[256];
+	snprintf(title, sizeof(title), "[%u] every %us #%u exit %lu %.0fms%s%s%s %s",
+		idx + 1, pane.seconds, pane.runCnt, pane.exitCode, pane.runMs,
+		pane.breaches.empty() ? "" : " LIMIT ", pane.breaches.c_str(),
+		pane.running ? " *" : "", pane.command.c_str());
+	WinCursor::SetCursorPosition(pane.x, pane.y);
+	Colorize::setColor(std::cout, Colorize::blackFg, Colorize::whiteBg);
+	m_lineBuf.assign(title, (std::min)(strlen(title), (size_t)pane.cols));
+	m_lineBuf.resize(pane.cols, ' ');
+	std::cout.write(m_lineBuf.c_str(), m_lineBuf.length());
+
+	// Line start offsets of both frames.
+	unsigned lineRows = pane.rows - 1;
+	std::vector<size_t> lines, prevLines;
+	for (int which = 0; which != 2; which++)
+	{
+		const lstring& frame = which ? pane.prevFrame : pane.frame;
+		std::vector<size_t>& offsets = which ? prevLines : lines;
+		for (size_t off = 0; off < frame.length(); )
+		{
+			offsets.push_back(off);
+			size_t eol = frame.find('\n', off);
+			off = (eol == std::string::npos) ? frame.length() : eol + 1;
+		}
+		offsets.push_back(frame.length());
+	}
+	size_t lineCnt = lines.size() - 1;
+	size_t first = (m_bottomLines != 0 && lineCnt > lineRows) ? lineCnt - lineRows : 0;
+	bool highlight = m_highlight && pane.runCnt > 1;
+
+	for (unsigned row = 0; row != lineRows; row++)
+	{
+		size_t lineIdx = first + row;
+		const char* line = "";
+		size_t len = 0;
+		if (lineIdx < lineCnt)
+		{
+			line = pane.frame.c_str() + lines[lineIdx];
+			len = lines[lineIdx + 1] - lines[lineIdx];
+			if (len != 0 && line[len - 1] == '\n')
+				len--;
+			if (len != 0 && line[len - 1] == '\r')
+				len--;
+		}
+		const char* prevLine = line;
+		size_t prevLen = len;
+		if (highlight)
+		{
+			prevLine = "";
+			prevLen = 0;
+			if (lineIdx + 1 < prevLines.size())
+			{
+				prevLine = pane.prevFrame.c_str() + prevLines[lineIdx];
+				prevLen = prevLines[lineIdx + 1] - prevLines[lineIdx];
+			}
+		}
+
+		WinCursor::SetCursorPosition(pane.x, pane.y + 1 + row);
+		PaintLine(line, len, prevLine, prevLen, pane.cols);
+	}
+	pane.dirty = false;
+}
+
+// ======================================================================================
+void Dashboard::Run(unsigned maxRunCnt, volatile bool& stop)
+{
+	if (m_panes.empty())
+		return;
+	m_pool.reset(new ThreadPool((unsigned)m_panes.size()));
+
+	WinCursor::ClearScreen(" ");
+	Clock::time_point now = Clock::now();
+	for (size_t idx = 0; idx != m_panes.size(); idx++)
+		m_panes[idx]->nextRun = now;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!stop)
+	{
+		// Start due panes, sleep until the next one is due (or a run ends),
+		// waking at least every 100msec to notice Ctrl-C and console resize.
+		if (Layout())
+			WinCursor::ClearScreen(" ");
+
+		now = Clock::now();
+		Clock::time_point wake = now + std::chrono::milliseconds(100);
+		bool active = false;
+		for (size_t idx = 0; idx != m_panes.size(); idx++)
+		{
+			Pane& pane = *m_panes[idx];
+			if (!pane.running && pane.runCnt < maxRunCnt)
+			{
+				if (now >= pane.nextRun)
+				{
+					pane.running = true;
+					pane.dirty = true;
+					unsigned cols = pane.cols;
+					unsigned rows = pane.rows;
+					m_pool->Submit([this, &pane, cols, rows]() { RunPane(pane, cols, rows); });
+				}
+				else
+				{
+					wake = (std::min)(wake, pane.nextRun);
+				}
+			}
+			active = active || pane.running || pane.runCnt < maxRunCnt;
+		}
+
+		for (size_t idx = 0; idx != m_panes.size(); idx++)
+		{
+			if (m_panes[idx]->dirty)
+				Paint(*m_panes[idx], (unsigned)idx);
+		}
+		std::cout.flush();
+
+		if (!active)
+			break;
+		m_changed.wait_until(lock, wake);
+	}
+	lock.unlock();
+
+	// Let running commands finish, leave the cursor below the panes.
+	m_pool.reset();
+	WinCursor::SetCursorPosition(0, m_screenRows - 1);
+	Colorize::setColor(std::cout, Colorize::whiteFg, Colorize::blackBg);
+	std::cout << std::endl;
+}
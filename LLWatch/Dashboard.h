@@ -0,0 +1,140 @@
+// ------------------------------------------------------------------------------------------------
+// Dashboard.h - Several watched commands in tiled panes
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+#pragma once
+
+#include "llstring.h"
+#include "RunUsage.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ChildProcess;
+
+// ======================================================================================
+// Watch several commands at once (llwatch -c cmd1 -c cmd2 ...). Each command runs on
+// its own interval from a shared thread pool and is shown in a tile of one console.
+// Workers only capture and filter, the render loop (caller of Run) is the only
+// writer to the console and highlights each pane against its previous frame.
+class Dashboard
+{
+public:
+	Dashboard();
+	~Dashboard();
+
+	// Watch command, run every 'seconds' after the previous run ends.
+	void AddCommand(const std::string& command, unsigned seconds);
+
+	size_t Commands() const
+	{ return m_panes.size(); }
+
+	// Keep lines matching grepLinePat (NULL for all), optionally replacing matches.
+	void SetGrep(const std::regex* grepLinePat, const lstring& replaceStr)
+	{
+		m_grepLinePat = grepLinePat;
+		m_replaceStr = replaceStr;
+	}
+
+	// Top or bottom lines of each frame, the pane shows as many as fit.
+	void SetTrim(unsigned topLines, unsigned bottomLines)
+	{
+		m_topLines = topLines;
+		m_bottomLines = bottomLines;
+	}
+
+	void SetHighlight(bool highlight)
+	{ m_highlight = highlight; }
+
+	// Capture through a pseudo terminal the size of the pane.
+	void SetPty(bool usePty)
+	{ m_usePty = usePty; }
+
+	// Priority and caps of each run, the title shows breaches.
+	void SetLimits(const RunLimits& limits)
+	{ m_limits = limits; }
+
+	// Run and show until stop is set or each command ran maxRunCnt times.
+	void Run(unsigned maxRunCnt, volatile bool& stop);
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Pane
+	{
+		std::string command;
+		unsigned seconds;
+		std::unique_ptr<ChildProcess> process;	// used by the worker running it
+		lstring  output;			// worker capture buffer
+
+		// Shared with the workers, guarded by m_mutex.
+		lstring  frame;				// latest kept lines
+		lstring  prevFrame;			// frame before it, highlight base
+		unsigned long exitCode;
+		std::string breaches;		// limits hit by the last run
+		double   runMs;
+		unsigned runCnt;
+		bool     running;
+		bool     dirty;				// needs repaint
+		Clock::time_point nextRun;
+
+		// Tile, set by Layout.
+		unsigned x, y, cols, rows;
+	};
+
+	void RunPane(Pane& pane, unsigned cols, unsigned rows);
+	bool Layout();
+	void Paint(Pane& pane, unsigned idx);
+	void PaintLine(const char* line, size_t len, const char* prevLine, size_t prevLen, unsigned cols);
+
+	Dashboard(const Dashboard&);
+	Dashboard& operator=(const Dashboard&);
+
+	std::vector<std::unique_ptr<Pane> > m_panes;
+	std::unique_ptr<ThreadPool> m_pool;
+	std::mutex m_mutex;
+	std::condition_variable m_changed;	// a pane finished a run
+
+	const std::regex* m_grepLinePat;
+	lstring  m_replaceStr;
+	unsigned m_topLines;
+	unsigned m_bottomLines;
+	bool     m_highlight;
+	bool     m_usePty;
+	RunLimits m_limits;
+	unsigned m_screenCols;
+	unsigned m_screenRows;
+	std::string m_lineBuf;				// PaintLine scratch
+};
@@ -0,0 +1,265 @@
+// ------------------------------------------------------------------------------------------------
+// FieldRates.cpp - Per tick deltas and rates of numeric fields
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+#include "FieldRates.h"
+#include "FrameOps.h"
+
+#include <algorithm>
+#include <charconv>
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// Characters between tokens.
+static inline bool IsFieldSep(char c)
+{
+	switch (c)
+	{
+	case ' ': case '\t': case '\r': case ',': case ';': case '(': case ')': case '[': case ']':
+	case '{': case '}': case '<': case '>': case '=': case '|': case '"': case '\'':
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Token [first, last) is a number, sign digits [.digits] [exponent], followed by at
+// most 3 unit letters or %.
+static bool ParseNumber(const char* first, const char* last, double& value)
+{
+	if (*first == '+')
+		first++;			// from_chars takes no plus sign
+	const char* digits = (first != last && *first == '-') ? first + 1 : first;
+	if (digits == last || !isdigit((unsigned char)*digits))
+		return false;
+	if (digits + 1 != last && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X'))
+		return false;
+
+	std::from_chars_result result = std::from_chars(first, last, value);
+	if (result.ec != std::errc() || last - result.ptr > 3)
+		return false;
+	for (const char* unit = result.ptr; unit != last; unit++)
+	{
+		if (!isalpha((unsigned char)*unit) && *unit != '%')
+			return false;
+	}
+	return true;
+}
+
+// Value with 3 digits and a K/M/G/T suffix, ex: +62.5K
+static void FormatScaled(char* buf, size_t size, double value, const char* sign, const char* suffix)
+{
+	static const char* s_units[] = { "", "K", "M", "G", "T" };
+	unsigned unit = 0;
+	while (fabs(value) >= 1000 && unit != 4)
+	{
+		value /= 1000;
+		unit++;
+	}
+	char fmt[32];
+	snprintf(fmt, sizeof(fmt), "%%%s.%s%%s%%s", sign, (fabs(value) >= 100) ? "0f" : "3g");
+	snprintf(buf, size, fmt, value, s_units[unit], suffix);
+}
+
+// ======================================================================================
+FieldRates::FieldRates(Pairing pairing) :
+	m_pairing(pairing),
+	m_cur(0),
+	m_width(0),
+	m_paired(0),
+	m_hasPrev(false)
+{ }
+
+// ======================================================================================
+size_t FieldRates::ParseFields(const char* line, size_t len, std::vector<double>& values, uint64_t* keyHash)
+{
+	size_t count = 0;
+	uint64_t hash = HashBytes(line, 0);
+	const char* end = line + len;
+	const char* text = line;		// text since the last field, part of the key
+	const char* ptr = line;
+	while (ptr != end)
+	{
+		if (IsFieldSep(*ptr))
+		{
+			ptr++;
+			continue;
+		}
+		const char* token = ptr;
+		while (ptr != end && !IsFieldSep(*ptr))
+			ptr++;
+		double value;
+		if (ParseNumber(token, ptr, value))
+		{
+			values.push_back(value);
+			count++;
+			if (keyHash != NULL)
+				hash = HashBytes(text, token - text, hash);
+			text = ptr;
+		}
+	}
+	if (keyHash != NULL)
+		*keyHash = HashBytes(text, end - text, hash);
+	return count;
+}
+
+// ======================================================================================
+// A slot per paired field, its number, delta and rate, blank if it did not change.
+// Slots have a fixed width so the highlight of the lines below does not shift.
+void FieldRates::AppendColumn(const Line& line, const Line& prevLine, double seconds)
+{
+	uint32_t count = (std::min)(line.count, prevLine.count);
+	if (count == 0)
+		return;
+	const double* values = &m_values[m_cur][line.first];
+	const double* prevValues = &m_values[m_cur ^ 1][prevLine.first];
+	m_column = " |";
+	char delta[32];
+	char rate[32];
+	char slot[80];
+	for (uint32_t field = 0; field != count; field++)
+	{
+		m_paired++;
+		double change = values[field] - prevValues[field];
+		if (change == 0)
+		{
+			m_column.append(SLOT_WIDTH, ' ');
+			continue;
+		}
+		FormatScaled(delta, sizeof(delta), change, "+", "");
+		if (seconds > 0)
+			FormatScaled(rate, sizeof(rate), change / seconds, "", "/s");
+		else
+			rate[0] = '\0';
+		int len = snprintf(slot, sizeof(slot), " #%-2u %7s %8s", field + 1, delta, rate);
+		m_column.append(slot, (std::min)((size_t)len, sizeof(slot) - 1));
+		if ((size_t)len < SLOT_WIDTH)
+			m_column.append(SLOT_WIDTH - len, ' ');
+	}
+}
+
+// ======================================================================================
+// Table of the previous lines by key, at most half full, the first line of a key wins.
+void FieldRates::IndexPrevKeys()
+{
+	const std::vector<Line>& prevLines = m_lines[m_cur ^ 1];
+	size_t size = 16;
+	while (size < prevLines.size() * 2)
+		size *= 2;
+	m_prevByKey.assign(size, 0);
+	for (uint32_t idx = 0; idx != prevLines.size(); idx++)
+	{
+		size_t slot = (size_t)prevLines[idx].key & (size - 1);
+		while (m_prevByKey[slot] != 0 && prevLines[m_prevByKey[slot] - 1].key != prevLines[idx].key)
+			slot = (slot + 1) & (size - 1);
+		if (m_prevByKey[slot] == 0)
+			m_prevByKey[slot] = idx + 1;
+	}
+}
+
+const FieldRates::Line* FieldRates::FindPrevKey(uint64_t key) const
+{
+	const std::vector<Line>& prevLines = m_lines[m_cur ^ 1];
+	size_t mask = m_prevByKey.size() - 1;
+	for (size_t slot = (size_t)key & mask; m_prevByKey[slot] != 0; slot = (slot + 1) & mask)
+	{
+		if (prevLines[m_prevByKey[slot] - 1].key == key)
+			return &prevLines[m_prevByKey[slot] - 1];
+	}
+	return NULL;
+}
+
+// ======================================================================================
+void FieldRates::Apply(const char*& data, size_t& len, Clock::time_point at)
+{
+	m_cur ^= 1;
+	std::vector<Line>& lines = m_lines[m_cur];
+	std::vector<double>& values = m_values[m_cur];
+	const std::vector<Line>& prevLines = m_lines[m_cur ^ 1];
+	lines.clear();
+	values.clear();
+	m_paired = 0;
+	double seconds = m_hasPrev ? std::chrono::duration<double>(at - m_prevAt).count() : 0;
+	if (m_hasPrev && m_pairing == BY_KEY)
+		IndexPrevKeys();
+
+	// Column after the widest line so far.
+	const char* end = data + len;
+	for (const char* line = data; line != end; )
+	{
+		const char* eol = (const char*)memchr(line, '\n', end - line);
+		if (eol == NULL)
+			eol = end;
+		m_width = (std::max)(m_width, (std::min)((size_t)(eol - line), MAX_COLUMN));
+		line = (eol == end) ? end : eol + 1;
+	}
+
+	lstring& out = m_frames[m_cur];
+	out.clear();
+	for (const char* line = data; line != end; )
+	{
+		const char* eol = (const char*)memchr(line, '\n', end - line);
+		const char* next = (eol == NULL) ? end : eol + 1;
+		if (eol == NULL)
+			eol = end;
+		const char* textEnd = (eol != line && eol[-1] == '\r') ? eol - 1 : eol;
+
+		Line entry;
+		entry.key = 0;
+		entry.first = (uint32_t)values.size();
+		entry.count = (uint32_t)ParseFields(line, textEnd - line, values, (m_pairing == BY_KEY) ? &entry.key : NULL);
+		lines.push_back(entry);
+
+		const Line* prevLine = NULL;
+		if (m_hasPrev && m_pairing == BY_LINE && lines.size() <= prevLines.size())
+			prevLine = &prevLines[lines.size() - 1];
+		else if (m_hasPrev && m_pairing == BY_KEY)
+			prevLine = FindPrevKey(entry.key);
+
+		m_column.clear();
+		if (prevLine != NULL)
+			AppendColumn(entry, *prevLine, seconds);
+		out.append(line, textEnd - line);
+		if (!m_column.empty())
+		{
+			if ((size_t)(textEnd - line) < m_width)
+				out.append(m_width - (textEnd - line), ' ');
+			out += m_column;
+		}
+		out.append(textEnd, next - textEnd);
+		line = next;
+	}
+
+	m_prevAt = at;
+	m_hasPrev = true;
+	data = out.c_str();
+	len = out.length();
+}
@@ -0,0 +1,103 @@
+// ------------------------------------------------------------------------------------------------
+// FieldRates.h - Per tick deltas and rates of numeric fields
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "llstring.h"
+
+#include <chrono>
+#include <stdint.h>
+#include <vector>
+
+// ======================================================================================
+// Numeric field deltas and rates (llwatch --rates). The numbers of each kept line are
+// parsed in place (from_chars, no copy or locale) and paired with the previous frame
+// by line and field position, or by key: the line text without its numbers, so lines
+// which move (sorted output) keep their pairing. Lines with paired fields get an
+// extra column, a slot per field with its change and per second rate:
+//
+//   eth0 RX bytes 81234567 packets 9   | #1   +125K    125K/s #2      +3       3/s
+//
+// Only the values of the previous frame are kept (8 bytes per field). The column
+// starts at the widest line seen so far (at most MAX_COLUMN) so it does not move
+// between frames. A field is a token between blanks or punctuation which is a
+// number, optionally followed by a unit (12ms, 3.5G, 45%). Tokens like eth0, 0x1f,
+// 1.2.3 or 12:30:00 are not fields.
+class FieldRates
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	enum Pairing { BY_LINE, BY_KEY };
+
+	static const size_t MAX_COLUMN = 160;
+	static const size_t SLOT_WIDTH = 21;		// column width of a field
+
+	FieldRates(Pairing pairing);
+
+	// Frame [data, data+len) captured at 'at' with the rate column added, data and len
+	// are set to the result which stays valid until the second next Apply.
+	void Apply(const char*& data, size_t& len, Clock::time_point at);
+
+	// Numeric fields of the last frame and those paired with a previous value.
+	size_t Fields() const
+	{ return m_values[m_cur].size(); }
+
+	size_t Paired() const
+	{ return m_paired; }
+
+	// Append the numeric fields of a line to values, return the count. keyHash, if not
+	// NULL, is set to the hash of the text between the fields.
+	static size_t ParseFields(const char* line, size_t len, std::vector<double>& values, uint64_t* keyHash = NULL);
+
+private:
+	struct Line
+	{
+		uint64_t key;			// BY_KEY hash of the text without its numbers
+		uint32_t first;			// fields [first, first+count) of m_values
+		uint32_t count;
+	};
+
+	void AppendColumn(const Line& line, const Line& prevLine, double seconds);
+	void IndexPrevKeys();
+	const Line* FindPrevKey(uint64_t key) const;
+
+	Pairing  m_pairing;
+	unsigned m_cur;							// frame being built, other is previous
+	std::vector<Line> m_lines[2];
+	std::vector<double> m_values[2];
+	std::vector<uint32_t> m_prevByKey;		// open addressing by key, previous line + 1
+	lstring  m_frames[2];					// results, alternate
+	lstring  m_column;
+	size_t   m_width;						// column start
+	size_t   m_paired;
+	bool     m_hasPrev;
+	Clock::time_point m_prevAt;
+};
@@ -0,0 +1,148 @@
+// ------------------------------------------------------------------------------------------------
+// FrameGovernor.cpp - Frame rate capped rendering of the latest frame
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+
+#include "FrameGovernor.h"
+#include "FrameOps.h"
+#include "TokenMask.h"
+#include "WinCursor.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+static const size_t s_latencyWindow = 1024;
+
+// ======================================================================================
+FrameGovernor::FrameGovernor(unsigned maxFps, bool highlight, std::ostream& out) :
+	m_out(out),
+	m_pool(NULL),
+	m_mask(NULL),
+	m_highlight(highlight),
+	m_homeCursor(false),
+	m_minGap(std::chrono::duration_cast<Clock::duration>(std::chrono::microseconds(1000000 / (std::max)(maxFps, 1u)))),
+	m_pending(false),
+	m_lastPaint(Clock::now() - std::chrono::hours(1)),
+	m_submitted(0),
+	m_painted(0),
+	m_nextLatency(0)
+{ }
+
+// ======================================================================================
+void FrameGovernor::Submit(lstring& frame, Clock::time_point at)
+{
+	m_submitted++;
+	m_latest.swap(frame);
+	if (m_mask != NULL)
+		m_mask->Key(m_latest.c_str(), m_latest.length(), m_latestKey);
+	if (!m_pending)
+	{
+		// First frame since the last paint, nothing to show if it did not change.
+		if (m_painted != 0 && (m_mask != NULL ? m_latestKey == m_shownKey : m_latest == m_shown))
+			return;
+		m_pending = true;
+		m_firstChange = at;
+	}
+	Service();
+}
+
+// ======================================================================================
+void FrameGovernor::Service()
+{
+	if (m_pending && Clock::now() - m_lastPaint >= m_minGap)
+		Paint();
+}
+
+void FrameGovernor::Flush()
+{
+	if (m_pending)
+		Paint();
+}
+
+// ======================================================================================
+unsigned FrameGovernor::MsecToPaint() const
+{
+	Clock::duration left = m_lastPaint + m_minGap - Clock::now();
+	if (!m_pending || left <= Clock::duration::zero())
+		return 0;
+	return (unsigned)std::chrono::duration_cast<std::chrono::milliseconds>(left + std::chrono::microseconds(999)).count();
+}
+
+// ======================================================================================
+// Latest frame against the last painted one, the highlight covers all changes since.
+void FrameGovernor::Paint()
+{
+	if (m_homeCursor)
+		WinCursor::SetCursorPosition(0, 0);
+	if (m_highlight && m_painted != 0 && m_mask != NULL)
+		showKeyDiff(m_latest.c_str(), m_latestKey.c_str(), m_latest.length(), m_shownKey.c_str(), m_shownKey.length(), m_out);
+	else if (m_highlight && m_painted != 0)
+		showDiffFast(m_latest, m_shown, m_out, m_pool);
+	else
+		m_out.write(m_latest.c_str(), m_latest.length());
+	m_out.flush();
+
+	m_lastPaint = Clock::now();
+	double latencyMs = std::chrono::duration<double, std::milli>(m_lastPaint - m_firstChange).count();
+	if (m_latencyMs.size() < s_latencyWindow)
+		m_latencyMs.push_back(latencyMs);
+	else
+		m_latencyMs[m_nextLatency] = latencyMs;
+	m_nextLatency = (m_nextLatency + 1) % s_latencyWindow;
+
+	m_shown = m_latest;
+	m_shownKey = m_latestKey;
+	m_pending = false;
+	m_painted++;
+}
+
+// ======================================================================================
+double FrameGovernor::LatencyMs(unsigned percentile) const
+{
+	if (m_latencyMs.empty())
+		return 0;
+	std::vector<double> sorted(m_latencyMs);
+	std::sort(sorted.begin(), sorted.end());
+	return sorted[(std::min)(sorted.size() - 1, sorted.size() * percentile / 100)];
+}
+
+// ======================================================================================
+void FrameGovernor::Dump(std::ostream& out) const
+{
+	double sum = 0;
+	for (size_t idx = 0; idx != m_latencyMs.size(); idx++)
+		sum += m_latencyMs[idx];
+	char buf[256];
+	snprintf(buf, sizeof(buf),
+		"---[Frames=%u Painted=%u Coalesced=%u latency ms min/avg/p50/p99/max %.1f/%.1f/%.1f/%.1f/%.1f]---\n",
+		m_submitted, m_painted, m_submitted - m_painted - (m_pending ? 1 : 0),
+		LatencyMs(0), m_latencyMs.empty() ? 0.0 : sum / m_latencyMs.size(), LatencyMs(50), LatencyMs(99), LatencyMs(100));
+	out << buf;
+}
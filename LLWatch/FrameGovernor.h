@@ -0,0 +1,119 @@
+// ------------------------------------------------------------------------------------------------
+// FrameGovernor.h - Frame rate capped rendering of the latest frame
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+
+#pragma once
+
+#include "llstring.h"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+class ThreadPool;
+class TokenMask;
+
+// ======================================================================================
+// Paint at most maxFps frames per second (llwatch --max-fps) while runs are captured
+// at their own rate. Frames submitted between two paints are coalesced, only the
+// latest is painted, highlighted against the last painted frame so every line
+// changed since then is shown. Unchanged frames are not painted again, with a
+// TokenMask frames which differ only in masked tokens are unchanged.
+//
+// Latency is measured per paint from the capture of the oldest frame it shows
+// (first change after the previous paint) to the paint written.
+class FrameGovernor
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	FrameGovernor(unsigned maxFps, bool highlight, std::ostream& out = std::cout);
+
+	// Home the cursor before each paint (-h).
+	void SetHomeCursor(bool homeCursor)
+	{ m_homeCursor = homeCursor; }
+
+	void SetPool(ThreadPool* pool)
+	{ m_pool = pool; }
+
+	// Compare frames with volatile tokens masked (--mask).
+	void SetMask(const TokenMask* mask)
+	{ m_mask = mask; }
+
+	// Kept lines of a run captured at 'at', painted now if a paint is due.
+	// frame is swapped with an internal buffer.
+	void Submit(lstring& frame, Clock::time_point at);
+
+	// Paint the pending frame if it is due.
+	void Service();
+
+	// Paint the pending frame now.
+	void Flush();
+
+	bool Pending() const
+	{ return m_pending; }
+
+	// Milliseconds until the pending frame may be painted.
+	unsigned MsecToPaint() const;
+
+	unsigned Submitted() const
+	{ return m_submitted; }
+
+	unsigned Painted() const
+	{ return m_painted; }
+
+	// Frames, paints and latency min/avg/p50/p99/max in ms.
+	void Dump(std::ostream& out) const;
+
+	// Latency percentile (0..100) of the recent paints in ms.
+	double LatencyMs(unsigned percentile) const;
+
+private:
+	void Paint();
+
+	std::ostream& m_out;
+	ThreadPool* m_pool;
+	const TokenMask* m_mask;
+	bool     m_highlight;
+	bool     m_homeCursor;
+	Clock::duration m_minGap;		// 1 / maxFps
+	lstring  m_latest;				// newest frame, not painted yet if m_pending
+	lstring  m_shown;				// last painted frame
+	lstring  m_latestKey;			// keys of both with a mask
+	lstring  m_shownKey;
+	bool     m_pending;
+	Clock::time_point m_firstChange;	// capture of the oldest unpainted change
+	Clock::time_point m_lastPaint;
+	unsigned m_submitted;
+	unsigned m_painted;
+	std::vector<double> m_latencyMs;	// recent paints, rolling
+	unsigned m_nextLatency;
+};
@@ -0,0 +1,610 @@
+// ------------------------------------------------------------------------------------------------
+//  FrameOps.cpp - Text operations on captured command output
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+#include "FrameOps.h"
+#include "Colorize.h"
+#include "PhaseStats.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <string.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+extern const char MATCH_COLOR[] = "!07";
+extern const char DIFF_COLOR[] = "!0e";
+
+// Smallest chunk worth handing to another thread.
+static const size_t s_minChunk = 256 * 1024;
+
+// ======================================================================================
+// Number of chunks to split len bytes into, 4 per thread so stealing can even out
+// the load, 0 or 1 to stay serial.
+static size_t ChunkCount(ThreadPool* pool, size_t len)
+{
+	if (pool == NULL || pool->Workers() == 0)
+		return 0;
+	return (std::min)((size_t)(pool->Workers() + 1) * 4, len / s_minChunk);
+}
+
+// ======================================================================================
+// Split data into about equal chunks, each ending after a newline (last ends at len).
+// bounds gets chunk start offsets plus len.
+static void SplitLines(const char* data, size_t len, size_t chunks, std::vector<size_t>& bounds)
+{
+	bounds.clear();
+	bounds.push_back(0);
+	for (size_t idx = 1; idx < chunks; idx++)
+	{
+		size_t pos = (std::max)(bounds.back(), len / chunks * idx);
+		const char* eol = (const char*)memchr(data + pos, '\n', len - pos);
+		if (eol == NULL)
+			break;
+		pos = eol + 1 - data;
+		if (pos != bounds.back() && pos != len)
+			bounds.push_back(pos);
+	}
+	bounds.push_back(len);
+}
+
+// Match/differ transitions of one chunk, dense chunks (many short runs) are rescanned
+// while writing instead of storing every transition.
+struct DiffChunk
+{
+	std::vector<size_t> flips;
+	bool dense;
+};
+
+// ======================================================================================
+// Parallel showDiffFast, chunks are scanned for match/differ transitions concurrently
+// then written in order making the same Colorize::write calls as the serial loop.
+static void ParallelDiff(const char* currBuffer, const char* prevBuffer, size_t endIdx,
+	size_t chunks, std::ostream& out, ThreadPool* pool)
+{
+	std::vector<size_t> bounds;
+	SplitLines(currBuffer, endIdx, chunks, bounds);
+	std::vector<DiffChunk> diffChunks(bounds.size() - 1);
+
+	pool->ParallelFor(diffChunks.size(), [&](size_t idx)
+		{
+			DiffChunk& chunk = diffChunks[idx];
+			size_t pos = bounds[idx];
+			size_t end = bounds[idx + 1];
+			size_t maxFlips = (end - pos) / 64;
+			size_t prior = (pos == 0) ? 0 : pos - 1;
+			bool match = currBuffer[prior] == prevBuffer[prior];
+			chunk.dense = false;
+			while ((pos = NextDiffRun(currBuffer, prevBuffer, pos, end, match)) != end)
+			{
+				if (chunk.flips.size() == maxFlips)
+				{
+					chunk.dense = true;
+					std::vector<size_t>().swap(chunk.flips);
+					break;
+				}
+				chunk.flips.push_back(pos);
+				match = !match;
+			}
+		});
+
+	auto writeRun = [&](const char* color, size_t start, size_t end)
+		{
+			PhaseTimer timer(PhaseStats::WRITE);
+			Colorize::write(out, color);
+			Colorize::write(out, currBuffer + start, (unsigned)(end - start));
+		};
+
+	// Serial loop starts each pass with a (first time possibly empty) match run
+	// and ends it with a (at the end possibly empty) differ run.
+	bool match = currBuffer[0] == prevBuffer[0];
+	if (!match)
+		writeRun(MATCH_COLOR, 0, 0);
+	size_t startIdx = 0;
+	for (size_t idx = 0; idx != diffChunks.size(); idx++)
+	{
+		const DiffChunk& chunk = diffChunks[idx];
+		if (chunk.dense)
+		{
+			size_t pos = bounds[idx];
+			size_t end = bounds[idx + 1];
+			while ((pos = NextDiffRun(currBuffer, prevBuffer, pos, end, match)) != end)
+			{
+				writeRun(match ? MATCH_COLOR : DIFF_COLOR, startIdx, pos);
+				startIdx = pos;
+				match = !match;
+			}
+		}
+		else
+		{
+			for (size_t flip = 0; flip != chunk.flips.size(); flip++)
+			{
+				writeRun(match ? MATCH_COLOR : DIFF_COLOR, startIdx, chunk.flips[flip]);
+				startIdx = chunk.flips[flip];
+				match = !match;
+			}
+		}
+	}
+	writeRun(match ? MATCH_COLOR : DIFF_COLOR, startIdx, endIdx);
+	if (match)
+		writeRun(DIFF_COLOR, endIdx, endIdx);
+}
+
+// ======================================================================================
+void LineOffsets(const char* frame, size_t len, std::vector<size_t>& offsets)
+{
+	offsets.clear();
+	for (size_t off = 0; off < len; )
+	{
+		offsets.push_back(off);
+		const char* eol = (const char*)memchr(frame + off, '\n', len - off);
+		off = (eol == NULL) ? len : (eol - frame) + 1;
+	}
+	offsets.push_back(len);
+}
+
+// ======================================================================================
+// Write buffer directly to stdout.
+void WriteStdOut(const char* buffer, size_t length)
+{
+#ifdef _WIN32
+	DWORD dwWritten;
+	WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), buffer, (DWORD)length, &dwWritten, NULL);
+#else
+	std::cout.write(buffer, length);
+	std::cout.flush();
+#endif
+}
+
+// ======================================================================================
+void showDiffFast(const lstring& currBuffer, const lstring& prevBuffer, std::ostream& out, ThreadPool* pool)
+{
+	showDiffFast(currBuffer.c_str(), currBuffer.length(), prevBuffer.c_str(), prevBuffer.length(), out, pool);
+}
+
+// ======================================================================================
+void showDiffFast(const char* currBuffer, size_t currLen, const char* prevBuffer, size_t prevLen, std::ostream& out, ThreadPool* pool)
+{
+	size_t endIdx = (std::min)(currLen, prevLen);
+	size_t chunks = ChunkCount(pool, endIdx);
+	if (chunks <= 1)
+	{
+		showKeyDiff(currBuffer, currBuffer, currLen, prevBuffer, prevLen, out);
+		return;
+	}
+
+	ParallelDiff(currBuffer, prevBuffer, endIdx, chunks, out, pool);
+	PhaseTimer timer(PhaseStats::WRITE);
+	Colorize::write(out, MATCH_COLOR);
+	if (currLen > endIdx)
+		Colorize::write(out, currBuffer + endIdx, (unsigned)(currLen - endIdx));
+}
+
+// ======================================================================================
+void showKeyDiff(const char* currBuffer, const char* currKey, size_t currLen, const char* prevKey, size_t prevLen, std::ostream& out)
+{
+	size_t endIdx = (std::min)(currLen, prevLen);
+	size_t startIdx = 0;
+	size_t idx = 0;
+	while (idx != endIdx)
+	{
+		while (idx != endIdx && currKey[idx] == prevKey[idx])
+			idx++;
+		{
+			PhaseTimer timer(PhaseStats::WRITE);
+			Colorize::write(out, MATCH_COLOR);
+			Colorize::write(out, currBuffer + startIdx, (unsigned)(idx - startIdx));
+		}
+		startIdx = idx;
+		while (idx != endIdx && currKey[idx] != prevKey[idx])
+			idx++;
+		{
+			PhaseTimer timer(PhaseStats::WRITE);
+			Colorize::write(out, DIFF_COLOR);
+			Colorize::write(out, currBuffer + startIdx, (unsigned)(idx - startIdx));
+		}
+		startIdx = idx;
+	}
+
+	PhaseTimer timer(PhaseStats::WRITE);
+	Colorize::write(out, MATCH_COLOR);
+	if (currLen > startIdx)
+		Colorize::write(out, currBuffer + startIdx, (unsigned)(currLen - startIdx));
+}
+
+// ======================================================================================
+void showLineDiff(const char* currLine, size_t currLen, const char* prevLine, size_t prevLen, std::ostream& out)
+{
+	// Newline is compared and written uncolored after the text.
+	bool hasEol = currLen != 0 && currLine[currLen - 1] == '\n';
+	if (hasEol)
+		currLen--;
+	if (prevLen != 0 && prevLine[prevLen - 1] == '\n')
+		prevLen--;
+
+	size_t endIdx = (std::min)(currLen, prevLen);
+	size_t startIdx = 0;
+	size_t idx = 0;
+	PhaseTimer timer(PhaseStats::WRITE);
+	while (idx != endIdx)
+	{
+		while (idx != endIdx && currLine[idx] == prevLine[idx])
+			idx++;
+		if (idx != startIdx)
+		{
+			Colorize::write(out, MATCH_COLOR);
+			Colorize::write(out, currLine + startIdx, (unsigned)(idx - startIdx));
+		}
+		startIdx = idx;
+		while (idx != endIdx && currLine[idx] != prevLine[idx])
+			idx++;
+		if (idx != startIdx)
+		{
+			Colorize::write(out, DIFF_COLOR);
+			Colorize::write(out, currLine + startIdx, (unsigned)(idx - startIdx));
+		}
+		startIdx = idx;
+	}
+
+	if (currLen > startIdx)
+	{
+		Colorize::write(out, DIFF_COLOR);
+		Colorize::write(out, currLine + startIdx, (unsigned)(currLen - startIdx));
+	}
+	Colorize::write(out, MATCH_COLOR);
+	if (hasEol)
+		out << '\n';
+}
+
+// ======================================================================================
+// Return number of lines kept.
+unsigned TrimTopBottom(lstring& currBuffer, unsigned topLines, unsigned bottomLines)
+{
+	const char* data = currBuffer.c_str();
+	size_t len = currBuffer.length();
+	unsigned lineCnt = TrimTopBottom(data, len, topLines, bottomLines);
+	size_t offset = data - currBuffer.c_str();
+	currBuffer.resize(offset + len);
+	currBuffer.erase(0, offset);
+	return lineCnt;
+}
+
+// ======================================================================================
+// Lines are compacted in place from the first one cut.
+bool ClipColumns(lstring& frame, size_t maxCols)
+{
+	char* data = &frame[0];
+	size_t len = frame.length();
+	size_t out = 0;
+	bool clipped = false;
+	for (size_t pos = 0; pos < len; )
+	{
+		const char* eol = (const char*)memchr(data + pos, '\n', len - pos);
+		size_t next = (eol == NULL) ? len : (eol - data) + 1;
+		size_t textLen = ((eol == NULL) ? len : (size_t)(eol - data)) - pos;
+		size_t keepLen = ClipLength(data + pos, textLen, maxCols);
+		if (keepLen != textLen)
+			clipped = true;
+		if (clipped)
+		{
+			memmove(data + out, data + pos, keepLen);
+			if (eol != NULL)
+				data[out + keepLen] = '\n';
+		}
+		out += keepLen + (eol != NULL ? 1 : 0);
+		pos = next;
+	}
+	frame.resize(out);
+	return clipped;
+}
+
+// ======================================================================================
+// Scanned without copying until the first line longer than maxCols.
+bool ClipColumns(const char*& data, size_t& len, lstring& result, size_t maxCols)
+{
+	const char* end = data + len;
+	const char* line = data;
+	while (line != end)
+	{
+		const char* eol = (const char*)memchr(line, '\n', end - line);
+		if (eol == NULL)
+			eol = end;
+		if ((size_t)(eol - line) > maxCols)
+			break;
+		line = (eol == end) ? end : eol + 1;
+	}
+	if (line == end)
+		return false;
+
+	if (data >= result.c_str() && data < result.c_str() + result.length())
+	{
+		size_t offset = data - result.c_str();
+		result.resize(offset + len);
+		result.erase(0, offset);
+	}
+	else
+	{
+		result.assign(data, len);
+	}
+	ClipColumns(result, maxCols);
+	data = result.c_str();
+	len = result.length();
+	return true;
+}
+
+// ======================================================================================
+// Bottom lines start at the newline which precedes them (same as erasing up to it).
+// Only the lines kept are scanned unless the frame is shorter than the limits.
+unsigned TrimTopBottom(const char*& data, size_t& len, unsigned topLines, unsigned bottomLines)
+{
+	if (bottomLines != 0)
+	{
+		// Newline number bottomLines+1 counting back from the end.
+		unsigned cnt = 0;
+		for (size_t pos = len; pos != 0; pos--)
+		{
+			if (data[pos - 1] == '\n' && ++cnt == bottomLines + 1)
+			{
+				data += pos - 1;
+				len -= pos - 1;
+				return bottomLines;
+			}
+		}
+	}
+	if (topLines != 0)
+	{
+		// Keep through newline number topLines, if there is another newline after it.
+		const char* end = data + len;
+		const char* ptr = data;
+		unsigned cnt = 0;
+		while ((ptr = (const char*)memchr(ptr, '\n', end - ptr)) != NULL)
+		{
+			ptr++;
+			if (++cnt == topLines)
+			{
+				if (memchr(ptr, '\n', end - ptr) == NULL)
+					return cnt;
+				len = ptr - data;
+				return topLines;
+			}
+		}
+		return cnt;
+	}
+
+	unsigned lineCnt = 0;
+	const char* end = data + len;
+	for (const char* ptr = data; (ptr = (const char*)memchr(ptr, '\n', end - ptr)) != NULL; ptr++)
+		lineCnt++;
+	return lineCnt;
+}
+
+#ifdef HAVE_REGEX
+// ======================================================================================
+void RegexTrim(lstring& currBuffer, const std::regex& grepLinePat, const lstring& replaceStr, ThreadPool* pool)
+{
+	lstring result;
+	RegexTrim(currBuffer.c_str(), currBuffer.length(), result, grepLinePat, replaceStr, pool);
+	currBuffer.swap(result);
+}
+
+// ======================================================================================
+// Each kept line is terminated by a newline, blank lines are dropped.
+// Lines are independent, in parallel each chunk of lines is filtered into its own
+// result and the results are joined in order.
+void RegexTrim(const char* data, size_t len, lstring& result, const std::regex& grepLinePat, const lstring& replaceStr, ThreadPool* pool)
+{
+	size_t chunks = ChunkCount(pool, len);
+	if (chunks > 1)
+	{
+		std::vector<size_t> bounds;
+		SplitLines(data, len, chunks, bounds);
+		std::vector<lstring> results(bounds.size() - 1);
+		pool->ParallelFor(results.size(), [&](size_t idx)
+			{ RegexTrim(data + bounds[idx], bounds[idx + 1] - bounds[idx], results[idx], grepLinePat, replaceStr); });
+
+		size_t total = 0;
+		for (size_t idx = 0; idx != results.size(); idx++)
+			total += results[idx].length();
+		result.clear();
+		result.reserve(total);
+		for (size_t idx = 0; idx != results.size(); idx++)
+			result += results[idx];
+		return;
+	}
+
+	result.clear();
+	bool doReplace = !replaceStr.empty();
+	lstring str;
+	const char* end = data + len;
+	while (data != end)
+	{
+		const char* eol = (const char*)memchr(data, '\n', end - data);
+		if (eol == NULL)
+			eol = end;
+		if (eol != data)
+		{
+			str.assign(data, eol);
+			bool keep;
+			if (doReplace)
+				keep = str.regReplace(grepLinePat, replaceStr);
+			else
+				keep = str.regFind(grepLinePat);
+
+			if (keep && !str.isSpace())
+			{
+				result += str;
+				result += '\n';
+			}
+		}
+		data = (eol == end) ? end : eol + 1;
+	}
+}
+#endif
+
+// ======================================================================================
+StreamFrame::StreamFrame(std::ostream& out) :
+	m_out(out),
+	m_topLines(0),
+	m_maxCols(0),
+	m_highlight(true),
+#ifdef HAVE_REGEX
+	m_grepLinePat(NULL),
+#endif
+	m_lineCnt(0),
+	m_hasPrev(false)
+{ }
+
+// ======================================================================================
+void StreamFrame::Begin()
+{
+	if (m_lineCnt != 0 || !m_curr.empty())
+	{
+		m_prev.swap(m_curr);
+		m_hasPrev = true;
+	}
+	m_curr.clear();
+	m_partial.clear();
+	m_lineCnt = 0;
+
+	m_prevLines.clear();
+	for (size_t off = 0; off < m_prev.length(); )
+	{
+		m_prevLines.push_back(off);
+		size_t eol = m_prev.find('\n', off);
+		off = (eol == std::string::npos) ? m_prev.length() : eol + 1;
+	}
+	m_prevLines.push_back(m_prev.length());
+}
+
+// ======================================================================================
+void StreamFrame::Append(const char* data, size_t len)
+{
+	const char* end = data + len;
+	while (data != end)
+	{
+		const char* eol = (const char*)memchr(data, '\n', end - data);
+		if (eol == NULL)
+		{
+			m_partial.append(data, end);
+			break;
+		}
+
+		eol++;
+		if (m_partial.empty())
+		{
+			AddLine(data, eol - data);
+		}
+		else
+		{
+			m_partial.append(data, eol);
+			AddLine(m_partial.c_str(), m_partial.length());
+			m_partial.clear();
+		}
+		data = eol;
+	}
+	m_out.flush();
+}
+
+// ======================================================================================
+unsigned StreamFrame::Finish()
+{
+	if (!m_partial.empty())
+	{
+		AddLine(m_partial.c_str(), m_partial.length());
+		m_partial.clear();
+	}
+	m_out.flush();
+	return m_lineCnt;
+}
+
+// ======================================================================================
+// Filter one line (including its \n) and write it, highlighting changes.
+void StreamFrame::AddLine(const char* line, size_t len)
+{
+	if (m_topLines != 0 && m_lineCnt >= m_topLines)
+		return;
+
+#ifdef HAVE_REGEX
+	lstring filtered;
+	if (m_grepLinePat)
+	{
+		PhaseTimer timer(PhaseStats::GREP);
+		size_t textLen = (len != 0 && line[len - 1] == '\n') ? len - 1 : len;
+		filtered.assign(line, textLen);
+		bool keep = m_replaceStr.empty() ?
+			filtered.regFind(*m_grepLinePat) :
+			filtered.regReplace(*m_grepLinePat, m_replaceStr);
+		if (!keep || filtered.isSpace())
+			return;
+		filtered += '\n';
+		line = filtered.c_str();
+		len = filtered.length();
+	}
+#endif
+
+	if (m_maxCols != 0)
+	{
+		size_t textLen = (len != 0 && line[len - 1] == '\n') ? len - 1 : len;
+		size_t keepLen = ClipLength(line, textLen, m_maxCols);
+		if (keepLen != textLen)
+		{
+			m_clipped.assign(line, keepLen);
+			if (textLen != len)
+				m_clipped += '\n';
+			line = m_clipped.c_str();
+			len = m_clipped.length();
+		}
+	}
+
+	if (PhaseStats::sActive)
+		PhaseStats::sActive->MarkFirstOut();
+
+	PhaseTimer timer(PhaseStats::DIFF, PhaseStats::WRITE);
+	if (m_highlight && m_hasPrev)
+	{
+		const char* prevLine = "";
+		size_t prevLen = 0;
+		if (m_lineCnt + 1 < m_prevLines.size())
+		{
+			prevLine = m_prev.c_str() + m_prevLines[m_lineCnt];
+			prevLen = m_prevLines[m_lineCnt + 1] - m_prevLines[m_lineCnt];
+		}
+		showLineDiff(line, len, prevLine, prevLen, m_out);
+	}
+	else
+	{
+		PhaseTimer timer(PhaseStats::WRITE);
+		m_out.write(line, len);
+	}
+
+	m_curr.append(line, len);
+	m_lineCnt++;
+}
@@ -0,0 +1,227 @@
+// ------------------------------------------------------------------------------------------------
+//  FrameOps.h - Text operations on captured command output
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "llstring.h"
+
+#include <iostream>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+class ThreadPool;
+
+// ======================================================================================
+// Frame (captured command output) operations used by the watch loop.
+//
+// Operations taking a ThreadPool split large frames on line boundaries and process
+// the chunks in parallel, output is identical to the serial path (pool NULL).
+
+// Colorize codes of unchanged and changed text.
+extern const char MATCH_COLOR[];
+extern const char DIFF_COLOR[];
+
+// First position at or after pos where the curr/prev match state differs from 'match'.
+inline size_t NextDiffRun(const char* curr, const char* prev, size_t pos, size_t end, bool match)
+{
+	if (match)
+	{
+		while (pos != end && curr[pos] == prev[pos])
+			pos++;
+	}
+	else
+	{
+		while (pos != end && curr[pos] != prev[pos])
+			pos++;
+	}
+	return pos;
+}
+
+// FNV-1a content hash of frames and lines, seed with a previous hash to continue.
+inline uint64_t HashBytes(const char* data, size_t len, uint64_t hash = 14695981039346656037ULL)
+{
+	for (size_t idx = 0; idx != len; idx++)
+	{
+		hash ^= (unsigned char)data[idx];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Start offset of each line of frame, plus len (lines = offsets.size() - 1).
+void LineOffsets(const char* frame, size_t len, std::vector<size_t>& offsets);
+
+// Runs of line positions where curr differs from prev, by position like the highlight
+// (offsets from LineOffsets). fn(at, delCnt, addEnd) per run: prev lines
+// [at, at+delCnt) are replaced by curr lines [at, addEnd).
+template <typename Fn>
+void ForEachHunk(const char* curr, const std::vector<size_t>& lines,
+	const char* prev, const std::vector<size_t>& prevLines, Fn fn)
+{
+	size_t lineCnt = lines.size() - 1;
+	size_t prevCnt = prevLines.size() - 1;
+	size_t maxCnt = (lineCnt > prevCnt) ? lineCnt : prevCnt;
+	auto sameLine = [&](size_t idx)
+	{
+		if (idx >= lineCnt || idx >= prevCnt)
+			return false;
+		size_t len = lines[idx + 1] - lines[idx];
+		return len == prevLines[idx + 1] - prevLines[idx]
+			&& memcmp(curr + lines[idx], prev + prevLines[idx], len) == 0;
+	};
+
+	size_t lineIdx = 0;
+	while (lineIdx != maxCnt)
+	{
+		if (sameLine(lineIdx))
+		{
+			lineIdx++;
+			continue;
+		}
+		size_t at = lineIdx++;
+		while (lineIdx != maxCnt && !sameLine(lineIdx))
+			lineIdx++;
+		size_t delCnt = ((lineIdx < prevCnt) ? lineIdx : prevCnt) - ((at < prevCnt) ? at : prevCnt);
+		fn(at, delCnt, (lineIdx < lineCnt) ? lineIdx : lineCnt);
+	}
+}
+
+// Write buffer directly to stdout (console handle on Windows).
+void WriteStdOut(const char* buffer, size_t length);
+
+// Write currBuffer, highlighting characters which differ from prevBuffer.
+// In parallel the chunks are compared concurrently, output is written in order.
+void showDiffFast(const lstring& currBuffer, const lstring& prevBuffer, std::ostream& out = std::cout, ThreadPool* pool = NULL);
+void showDiffFast(const char* curr, size_t currLen, const char* prev, size_t prevLen, std::ostream& out = std::cout, ThreadPool* pool = NULL);
+
+// Write curr, highlighting characters where its key (curr with volatile tokens masked,
+// see TokenMask) differs from prevKey. Serial.
+void showKeyDiff(const char* curr, const char* currKey, size_t currLen, const char* prevKey, size_t prevLen, std::ostream& out = std::cout);
+
+// Write one line, highlighting characters which differ from the same column of prevLine.
+// Characters past the end of prevLine are new and highlighted.
+void showLineDiff(const char* currLine, size_t currLen, const char* prevLine, size_t prevLen, std::ostream& out = std::cout);
+
+// Keep top or bottom lines, return number of lines kept.
+unsigned TrimTopBottom(lstring& currBuffer, unsigned topLines, unsigned bottomLines);
+
+// Same on a read only frame (ex: memory mapped), narrows data and len to the kept lines.
+unsigned TrimTopBottom(const char*& data, size_t& len, unsigned topLines, unsigned bottomLines);
+
+// Length of a line of len bytes cut to at most maxCols bytes, backed off so a UTF-8
+// character is not split.
+inline size_t ClipLength(const char* line, size_t len, size_t maxCols)
+{
+	if (len <= maxCols)
+		return len;
+	while (maxCols != 0 && (line[maxCols] & 0xc0) == 0x80)
+		maxCols--;
+	return maxCols;
+}
+
+// Cut lines longer than maxCols (--fit), return true if any line was cut.
+bool ClipColumns(lstring& frame, size_t maxCols);
+
+// Same on a read only frame, if a line is cut the clipped frame is built in result
+// (data may point into result) and data and len are set to it.
+bool ClipColumns(const char*& data, size_t& len, lstring& result, size_t maxCols);
+
+#ifdef HAVE_REGEX
+// Keep lines matching grepLinePat, optionally replacing matches with replaceStr.
+void RegexTrim(lstring& currBuffer, const std::regex& grepLinePat, const lstring& replaceStr, ThreadPool* pool = NULL);
+
+// Same on a read only frame, kept lines are stored in result.
+void RegexTrim(const char* data, size_t len, lstring& result, const std::regex& grepLinePat, const lstring& replaceStr, ThreadPool* pool = NULL);
+#endif
+
+// ======================================================================================
+// Frame built incrementally while the command runs. Each complete line is filtered
+// (grep, top lines), compared with the same line of the previous frame and written
+// as soon as it arrives. Finish completes a trailing partial line.
+// Bottom line trimming needs the whole frame and is not supported.
+class StreamFrame
+{
+public:
+	StreamFrame(std::ostream& out = std::cout);
+
+	void SetTopLines(unsigned topLines)
+	{ m_topLines = topLines; }
+
+	// Highlight changes against previous frame, otherwise lines are written as is.
+	void SetHighlight(bool highlight)
+	{ m_highlight = highlight; }
+
+	// Cut lines to maxCols (0 for no limit).
+	void SetMaxCols(unsigned maxCols)
+	{ m_maxCols = maxCols; }
+
+#ifdef HAVE_REGEX
+	// Keep lines matching grepLinePat (NULL for all), optionally replacing matches.
+	void SetGrep(const std::regex* grepLinePat, const lstring& replaceStr)
+	{
+		m_grepLinePat = grepLinePat;
+		m_replaceStr = replaceStr;
+	}
+#endif
+
+	// Start a new frame, current frame becomes previous.
+	void Begin();
+
+	// Child output as read, may end in a partial line.
+	void Append(const char* data, size_t len);
+
+	// End of output, write any partial line, return number of lines kept.
+	unsigned Finish();
+
+	// Kept lines of current frame.
+	const lstring& Frame() const
+	{ return m_curr; }
+
+private:
+	void AddLine(const char* line, size_t len);
+
+	std::ostream& m_out;
+	unsigned m_topLines;
+	unsigned m_maxCols;
+	bool     m_highlight;
+#ifdef HAVE_REGEX
+	const std::regex* m_grepLinePat;
+	lstring  m_replaceStr;
+#endif
+
+	lstring  m_partial;			// line not yet terminated by \n
+	lstring  m_clipped;			// line cut to m_maxCols
+	lstring  m_curr;
+	lstring  m_prev;
+	std::vector<size_t> m_prevLines;	// start offset of each line of m_prev, plus end
+	unsigned m_lineCnt;			// lines kept in current frame
+	bool     m_hasPrev;
+};
@@ -0,0 +1,668 @@
+// ------------------------------------------------------------------------------------------------
+// FramePipeline.cpp - Fused single pass frame processing
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+
+#include "FramePipeline.h"
+#include "FrameOps.h"
+#include "Colorize.h"
+#include "FieldRates.h"
+#include "HeatMap.h"
+#include "LineAggregate.h"
+#include "PhaseStats.h"
+#include "TokenMask.h"
+
+#include <algorithm>
+#include <string.h>
+
+static void MarkFirstOut()
+{
+	if (PhaseStats::sActive)
+		PhaseStats::sActive->MarkFirstOut();
+}
+
+// Frame written without highlight, stdout is written directly.
+static void WritePlain(std::ostream& out, const char* data, size_t len)
+{
+	if (&out == &std::cout)
+	{
+		WriteStdOut(data, len);
+	}
+	else
+	{
+		out.write(data, len);
+		out.flush();
+	}
+}
+
+// ======================================================================================
+// Filter stages. Add is given a line without its newline (eol) and the start of the
+// next line, returns true if the line is kept. Base/Length is the kept frame so far.
+// Lines are cut to m_maxCols (npos without a limit).
+
+static size_t MaxCols(const FramePipeline& cfg)
+{
+	return (cfg.m_maxCols == 0) ? std::string::npos : cfg.m_maxCols;
+}
+
+// Keep every line, kept frame is the input itself.
+class NoFilter
+{
+public:
+	static const bool sTerminates = false;		// last line may lack a newline
+	static const bool sKeepsAll = true;			// trimmed before the loop
+
+	NoFilter(const FramePipeline&, const char* data, lstring&) :
+		m_data(data), m_len(0)
+	{ }
+
+	bool Add(const char*, const char*, const char* next)
+	{
+		m_len = next - m_data;
+		return true;
+	}
+
+	const char* Base() const
+	{ return m_data; }
+
+	size_t Length() const
+	{ return m_len; }
+
+private:
+	const char* m_data;
+	size_t m_len;
+};
+
+// Keep every line cut to m_maxCols, the input is used as is up to the first line
+// which is cut, kept lines are copied from there.
+class ClipFilter
+{
+public:
+	static const bool sTerminates = false;
+	static const bool sKeepsAll = true;
+
+	ClipFilter(const FramePipeline& cfg, const char* data, lstring& filtered) :
+		m_data(data), m_len(0), m_maxCols(cfg.m_maxCols), m_out(filtered), m_copy(false)
+	{ }
+
+	bool Add(const char* line, const char* eol, const char* next)
+	{
+		size_t keepLen = ClipLength(line, eol - line, m_maxCols);
+		if (!m_copy)
+		{
+			if (line + keepLen == eol)
+			{
+				m_len = next - m_data;
+				return true;
+			}
+			m_copy = true;
+			m_out.assign(m_data, m_len);
+		}
+		m_out.append(line, keepLen);
+		if (next != eol)
+			m_out += '\n';
+		return true;
+	}
+
+	const char* Base() const
+	{ return m_copy ? m_out.c_str() : m_data; }
+
+	size_t Length() const
+	{ return m_copy ? m_out.length() : m_len; }
+
+private:
+	const char* m_data;
+	size_t m_len;
+	size_t m_maxCols;
+	lstring& m_out;
+	bool   m_copy;			// a line was cut, kept frame is m_out
+};
+
+// Keep lines matching the grep pattern, matched in place.
+class GrepFilter
+{
+public:
+	static const bool sTerminates = true;		// kept lines end with a newline
+	static const bool sKeepsAll = false;
+
+	GrepFilter(const FramePipeline& cfg, const char*, lstring& filtered) :
+		m_grepLinePat(*cfg.m_grepLinePat), m_maxCols(MaxCols(cfg)), m_out(filtered)
+	{ m_out.clear(); }
+
+	bool Add(const char* line, const char* eol, const char*)
+	{
+		if (eol == line || !std::regex_search(line, eol, m_grepLinePat))
+			return false;
+
+		const char* ptr = line;
+		while (ptr != eol && isspace((unsigned char)*ptr))
+			ptr++;
+		if (ptr == eol)
+			return false;
+
+		m_out.append(line, ClipLength(line, eol - line, m_maxCols));
+		m_out += '\n';
+		return true;
+	}
+
+	const char* Base() const
+	{ return m_out.c_str(); }
+
+	size_t Length() const
+	{ return m_out.length(); }
+
+private:
+	const std::regex& m_grepLinePat;
+	size_t m_maxCols;
+	lstring& m_out;
+};
+
+// Keep lines matching the grep pattern, with matches replaced.
+class ReplaceFilter
+{
+public:
+	static const bool sTerminates = true;
+	static const bool sKeepsAll = false;
+
+	ReplaceFilter(const FramePipeline& cfg, const char*, lstring& filtered) :
+		m_grepLinePat(*cfg.m_grepLinePat), m_replaceStr(cfg.m_replaceStr), m_maxCols(MaxCols(cfg)), m_out(filtered)
+	{ m_out.clear(); }
+
+	bool Add(const char* line, const char* eol, const char*)
+	{
+		if (eol == line)
+			return false;
+		m_line.assign(line, eol);
+		if (!m_line.regReplace(m_grepLinePat, m_replaceStr) || m_line.isSpace())
+			return false;
+
+		m_out.append(m_line, 0, ClipLength(m_line.c_str(), m_line.length(), m_maxCols));
+		m_out += '\n';
+		return true;
+	}
+
+	const char* Base() const
+	{ return m_out.c_str(); }
+
+	size_t Length() const
+	{ return m_out.length(); }
+
+private:
+	const std::regex& m_grepLinePat;
+	const lstring& m_replaceStr;
+	size_t m_maxCols;
+	lstring& m_out;
+	lstring m_line;
+};
+
+// ======================================================================================
+// Trim stages. Stop is asked before each line, lineCnt is the newlines kept so far.
+// Same rules as TrimTopBottom.
+
+class AllLines
+{
+public:
+	static const bool sWholeFrame = false;
+
+	AllLines(const FramePipeline&)
+	{ }
+
+	bool Stop(unsigned, const char*, const char*, bool) const
+	{ return false; }
+};
+
+// Top lines, a trailing partial line is kept if it is all that is left.
+class TopLines
+{
+public:
+	static const bool sWholeFrame = false;
+
+	TopLines(const FramePipeline& cfg) :
+		m_topLines(cfg.m_topLines)
+	{ }
+
+	bool Stop(unsigned lineCnt, const char* line, const char* end, bool terminates) const
+	{
+		return lineCnt >= m_topLines && (terminates || memchr(line, '\n', end - line) != NULL);
+	}
+
+private:
+	unsigned m_topLines;
+};
+
+// Bottom lines need the whole frame, trimmed after filtering and before writing.
+class BottomLines
+{
+public:
+	static const bool sWholeFrame = true;
+
+	BottomLines(const FramePipeline&)
+	{ }
+
+	bool Stop(unsigned, const char*, const char*, bool) const
+	{ return false; }
+};
+
+// ======================================================================================
+// Key stages, what the highlight compares. Add is given the same ranges as the Emit
+// stage and returns the base of the key of the kept frame so far.
+
+// The kept text itself.
+class TextKey
+{
+public:
+	TextKey(const FramePipeline&)
+	{ }
+
+	const char* Add(const char* curr, size_t, size_t)
+	{ return curr; }
+};
+
+// The kept text with volatile tokens masked (TokenMask), built as ranges are kept.
+class MaskKey
+{
+public:
+	MaskKey(const FramePipeline& cfg) :
+		m_mask(*cfg.m_mask), m_key(cfg.m_currKey)
+	{ m_key.clear(); }
+
+	const char* Add(const char* curr, size_t from, size_t to)
+	{
+		m_mask.AppendKey(curr + from, to - from, m_key);
+		return m_key.c_str();
+	}
+
+private:
+	const TokenMask& m_mask;
+	lstring& m_key;
+};
+
+// ======================================================================================
+// Emit stages. Add is given the kept frame (its base may move as it grows) and the
+// range just kept, Finish the whole kept frame. prev is the key of the previous frame.
+
+// First frame, written as is.
+class PlainEmit
+{
+public:
+	PlainEmit(const FramePipeline&, const char*, size_t, std::ostream& out) :
+		m_out(out)
+	{ }
+
+	void Add(const char*, size_t, size_t)
+	{ }
+
+	void Finish(const char* curr, size_t len)
+	{
+		MarkFirstOut();
+		PhaseTimer timer(PhaseStats::WRITE);
+		WritePlain(m_out, curr, len);
+	}
+
+private:
+	std::ostream& m_out;
+};
+
+// Highlight characters which differ from the same offset of the previous frame.
+// Runs are written as soon as they end, making the same Colorize::write calls
+// as showDiffFast.
+template <class Key>
+class DiffEmit
+{
+public:
+	DiffEmit(const FramePipeline& cfg, const char* prev, size_t prevLen, std::ostream& out) :
+		m_key(cfg), m_prev(prev), m_prevLen(prevLen), m_out(out), m_startIdx(0), m_match(true), m_started(false)
+	{ }
+
+	void Add(const char* curr, size_t from, size_t to)
+	{
+		const char* key = m_key.Add(curr, from, to);
+		size_t end = (std::min)(to, m_prevLen);
+		if (from >= end)
+			return;
+		if (!m_started)
+		{
+			// showDiffFast starts with a match run, empty if the first character differs.
+			m_started = true;
+			m_match = key[0] == m_prev[0];
+			if (!m_match)
+				WriteRun(MATCH_COLOR, curr, 0, 0);
+		}
+
+		size_t pos = from;
+		while ((pos = NextDiffRun(key, m_prev, pos, end, m_match)) != end)
+		{
+			WriteRun(m_match ? MATCH_COLOR : DIFF_COLOR, curr, m_startIdx, pos);
+			m_startIdx = pos;
+			m_match = !m_match;
+		}
+	}
+
+	void Finish(const char* curr, size_t len)
+	{
+		size_t endIdx = (std::min)(len, m_prevLen);
+		if (endIdx != 0)
+		{
+			// Last run, a match run is followed by an empty differ run.
+			WriteRun(m_match ? MATCH_COLOR : DIFF_COLOR, curr, m_startIdx, endIdx);
+			if (m_match)
+				WriteRun(DIFF_COLOR, curr, endIdx, endIdx);
+			m_startIdx = endIdx;
+		}
+
+		MarkFirstOut();
+		PhaseTimer timer(PhaseStats::WRITE);
+		Colorize::write(m_out, MATCH_COLOR);
+		if (len > m_startIdx)
+			Colorize::write(m_out, curr + m_startIdx, (unsigned)(len - m_startIdx));
+	}
+
+private:
+	void WriteRun(const char* color, const char* curr, size_t start, size_t end)
+	{
+		MarkFirstOut();
+		PhaseTimer timer(PhaseStats::WRITE);
+		Colorize::write(m_out, color);
+		Colorize::write(m_out, curr + start, (unsigned)(end - start));
+	}
+
+	Key    m_key;
+	const char* m_prev;
+	size_t m_prevLen;
+	std::ostream& m_out;
+	size_t m_startIdx;		// start of the run not yet written
+	bool   m_match;			// state of the current run
+	bool   m_started;
+};
+
+// Color every character by how recently it changed (HeatMap), stamps are updated as
+// the ranges are kept.
+template <class Key>
+class HeatEmit
+{
+public:
+	HeatEmit(const FramePipeline& cfg, const char* prev, size_t prevLen, std::ostream& out) :
+		m_key(cfg), m_heatMap(*cfg.m_heatMap), m_out(out)
+	{ m_heatMap.Begin(prev, prevLen); }
+
+	void Add(const char* curr, size_t from, size_t to)
+	{
+		const char* key = m_key.Add(curr, from, to);
+		if (from == to)
+			return;
+		MarkFirstOut();
+		PhaseTimer timer(PhaseStats::WRITE);
+		m_heatMap.Add(curr, key, from, to, m_out);
+	}
+
+	void Finish(const char*, size_t len)
+	{
+		MarkFirstOut();
+		PhaseTimer timer(PhaseStats::WRITE);
+		m_heatMap.Finish(len, m_out);
+	}
+
+private:
+	Key      m_key;
+	HeatMap& m_heatMap;
+	std::ostream& m_out;
+};
+
+// ======================================================================================
+// One loop over the lines of the frame running the stages.
+template <class Filter, class Trim, class Emit>
+static unsigned RunStages(const FramePipeline& cfg, const char*& data, size_t& len,
+	const char* prev, size_t prevLen, lstring& filtered, std::ostream& out)
+{
+	PhaseTimer timer(PhaseStats::DIFF, PhaseStats::WRITE);
+	if (Trim::sWholeFrame && Filter::sKeepsAll)
+		TrimTopBottom(data, len, cfg.m_topLines, cfg.m_bottomLines);	// only kept lines are filtered
+	Filter filter(cfg, data, filtered);
+	Trim trim(cfg);
+	Emit emit(cfg, prev, prevLen, out);
+
+	unsigned lineCnt = 0;
+	const char* end = data + len;
+	const char* line = data;
+	while (line != end && !trim.Stop(lineCnt, line, end, Filter::sTerminates))
+	{
+		const char* eol = (const char*)memchr(line, '\n', end - line);
+		const char* next = (eol == NULL) ? end : eol + 1;
+		if (eol == NULL)
+			eol = end;
+
+		size_t from = filter.Length();
+		if (filter.Add(line, eol, next))
+		{
+			if (Filter::sTerminates || eol != end)
+				lineCnt++;
+			if (!Trim::sWholeFrame)
+				emit.Add(filter.Base(), from, filter.Length());
+		}
+		line = next;
+	}
+
+	data = filter.Base();
+	len = filter.Length();
+	if (Trim::sWholeFrame)
+	{
+		lineCnt = TrimTopBottom(data, len, cfg.m_topLines, cfg.m_bottomLines);
+		emit.Add(data, 0, len);
+	}
+	emit.Finish(data, len);
+	return lineCnt;
+}
+
+// ======================================================================================
+// Separate passes, each using the parallel frame operations when there is a pool.
+// With a mask prev is the key of the previous frame.
+static unsigned RunMultiPass(const FramePipeline& cfg, const char*& data, size_t& len,
+	const char* prev, size_t prevLen, lstring& filtered, std::ostream& out)
+{
+	if (cfg.m_grepLinePat)
+	{
+		PhaseTimer timer(PhaseStats::GREP);
+		RegexTrim(data, len, filtered, *cfg.m_grepLinePat, cfg.m_replaceStr, cfg.m_pool);
+		data = filtered.c_str();
+		len = filtered.length();
+	}
+	if (cfg.m_aggregate != NULL)
+	{
+		PhaseTimer timer(PhaseStats::TRIM);
+		cfg.m_aggregate->Apply(data, len);
+	}
+
+	unsigned lineCnt;
+	{
+		PhaseTimer timer(PhaseStats::TRIM);
+		lineCnt = TrimTopBottom(data, len, cfg.m_topLines, cfg.m_bottomLines);
+		if (cfg.m_maxCols != 0)
+			ClipColumns(data, len, filtered, cfg.m_maxCols);
+	}
+	if (cfg.m_rates != NULL)
+	{
+		PhaseTimer timer(PhaseStats::TRIM);
+		cfg.m_rates->Apply(data, len, FieldRates::Clock::now());
+		if (cfg.m_maxCols != 0)
+			ClipColumns(data, len, filtered, cfg.m_maxCols);
+	}
+
+	MarkFirstOut();
+	if (prevLen == 0)
+	{
+		PhaseTimer timer(PhaseStats::WRITE);
+		WritePlain(out, data, len);
+	}
+	else if (cfg.m_mask != NULL)
+	{
+		PhaseTimer timer(PhaseStats::DIFF, PhaseStats::WRITE);
+		cfg.m_mask->Key(data, len, cfg.m_currKey);
+		if (cfg.m_heatMap != NULL)
+		{
+			cfg.m_heatMap->Begin(prev, prevLen);
+			cfg.m_heatMap->Add(data, cfg.m_currKey.c_str(), 0, len, out);
+			cfg.m_heatMap->Finish(len, out);
+		}
+		else
+		{
+			showKeyDiff(data, cfg.m_currKey.c_str(), len, prev, prevLen, out);
+		}
+	}
+	else if (cfg.m_heatMap != NULL)
+	{
+		PhaseTimer timer(PhaseStats::DIFF, PhaseStats::WRITE);
+		cfg.m_heatMap->Show(data, len, prev, prevLen, out);
+	}
+	else
+	{
+		PhaseTimer timer(PhaseStats::DIFF, PhaseStats::WRITE);
+		showDiffFast(data, len, prev, prevLen, out, cfg.m_pool);
+	}
+	return lineCnt;
+}
+
+// ======================================================================================
+template <class Filter, class Trim, class Key>
+static void SelectEmit(const FramePipeline& cfg, FramePipeline::RunFn& plainRun, FramePipeline::RunFn& diffRun)
+{
+	plainRun = &RunStages<Filter, Trim, PlainEmit>;
+	if (cfg.m_heatMap != NULL)
+		diffRun = &RunStages<Filter, Trim, HeatEmit<Key> >;
+	else
+		diffRun = &RunStages<Filter, Trim, DiffEmit<Key> >;
+}
+
+template <class Filter, class Trim>
+static void SelectKey(const FramePipeline& cfg, FramePipeline::RunFn& plainRun, FramePipeline::RunFn& diffRun)
+{
+	if (cfg.m_mask != NULL)
+		SelectEmit<Filter, Trim, MaskKey>(cfg, plainRun, diffRun);
+	else
+		SelectEmit<Filter, Trim, TextKey>(cfg, plainRun, diffRun);
+}
+
+template <class Filter>
+static void SelectTrim(const FramePipeline& cfg, FramePipeline::RunFn& plainRun, FramePipeline::RunFn& diffRun)
+{
+	if (cfg.m_bottomLines != 0)
+		SelectKey<Filter, BottomLines>(cfg, plainRun, diffRun);
+	else if (cfg.m_topLines != 0)
+		SelectKey<Filter, TopLines>(cfg, plainRun, diffRun);
+	else
+		SelectKey<Filter, AllLines>(cfg, plainRun, diffRun);
+}
+
+// ======================================================================================
+FramePipeline::FramePipeline() :
+	m_grepLinePat(NULL),
+	m_topLines(0),
+	m_bottomLines(0),
+	m_maxCols(0),
+	m_heatMap(NULL),
+	m_mask(NULL),
+	m_rates(NULL),
+	m_aggregate(NULL),
+	m_pool(NULL),
+	m_plainRun(&RunStages<NoFilter, AllLines, PlainEmit>),
+	m_diffRun(&RunStages<NoFilter, AllLines, DiffEmit<TextKey> >)
+{ }
+
+// ======================================================================================
+void FramePipeline::Configure(const std::regex* grepLinePat, const lstring& replaceStr,
+	unsigned topLines, unsigned bottomLines, ThreadPool* pool, bool multiPass)
+{
+	m_grepLinePat = grepLinePat;
+	m_replaceStr = replaceStr;
+	m_topLines = topLines;
+	m_bottomLines = bottomLines;
+	m_pool = pool;
+	m_prevKey.clear();
+
+	if (m_rates != NULL || m_aggregate != NULL || ((pool != NULL || multiPass) && m_mask == NULL))
+		m_plainRun = m_diffRun = &RunMultiPass;
+	else if (grepLinePat == NULL && m_maxCols != 0)
+		SelectTrim<ClipFilter>(*this, m_plainRun, m_diffRun);
+	else if (grepLinePat == NULL)
+		SelectTrim<NoFilter>(*this, m_plainRun, m_diffRun);
+	else if (replaceStr.empty())
+		SelectTrim<GrepFilter>(*this, m_plainRun, m_diffRun);
+	else
+		SelectTrim<ReplaceFilter>(*this, m_plainRun, m_diffRun);
+}
+
+// ======================================================================================
+unsigned FramePipeline::Run(const char*& data, size_t& len, const char* prev, size_t prevLen,
+	lstring& filtered, std::ostream& out)
+{
+	if (prevLen == 0)
+	{
+		m_prevKey.clear();
+		return m_plainRun(*this, data, len, prev, prevLen, filtered, out);
+	}
+	if (m_mask == NULL)
+		return m_diffRun(*this, data, len, prev, prevLen, filtered, out);
+
+	// Previous key kept from the last Run, built from prev if that was written as is.
+	if (m_prevKey.length() != prevLen)
+		m_mask->Key(prev, prevLen, m_prevKey);
+	unsigned lineCnt = m_diffRun(*this, data, len, m_prevKey.c_str(), prevLen, filtered, out);
+	m_prevKey.swap(m_currKey);
+	return lineCnt;
+}
+
+// ======================================================================================
+unsigned FramePipeline::Run(lstring& frame, const lstring& prev, std::ostream& out)
+{
+	const char* data = frame.c_str();
+	size_t len = frame.length();
+	unsigned lineCnt = Run(data, len, prev.c_str(), prev.length(), m_filtered, out);
+
+	// Kept lines are a range of frame or of m_filtered, or held by the rates or aggregate.
+	bool inFrame = data >= frame.c_str() && data < frame.c_str() + frame.length();
+	bool inFiltered = data >= m_filtered.c_str() && data < m_filtered.c_str() + m_filtered.length();
+	if (len == 0)
+	{
+		frame.clear();
+	}
+	else if (inFrame || inFiltered)
+	{
+		lstring& kept = inFrame ? frame : m_filtered;
+		size_t offset = data - kept.c_str();
+		kept.resize(offset + len);
+		kept.erase(0, offset);
+		if (&kept != &frame)
+			frame.swap(m_filtered);
+	}
+	else
+	{
+		frame.assign(data, len);
+	}
+	return lineCnt;
+}
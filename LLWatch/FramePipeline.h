@@ -0,0 +1,123 @@
+// ------------------------------------------------------------------------------------------------
+// FramePipeline.h - Fused single pass frame processing
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+#pragma once
+
+#include "llstring.h"
+
+#include <iostream>
+
+class FieldRates;
+class HeatMap;
+class LineAggregate;
+class ThreadPool;
+class TokenMask;
+
+// ======================================================================================
+// Filter (grep), replace, trim and highlight a captured frame in one pass over its
+// lines. Each stage is a template argument, Configure picks the instantiation
+// matching the options once so a frame runs a single loop without per line tests of
+// unused stages. The output is identical to RegexTrim + TrimTopBottom + showDiffFast.
+//
+// Without grep the kept frame is a range of the input (no copy), with grep (or lines
+// cut by SetMaxCols) kept lines are built in a caller supplied string which must stay
+// valid while it is the previous frame. With rates or aggregation the kept frame is
+// held by the FieldRates or LineAggregate until its second next frame.
+//
+// With a ThreadPool (or multiPass) the stages run as separate passes using the
+// parallel frame operations. Fused stages are timed as one DIFF phase.
+//
+// With a TokenMask changes are found by comparing keys, built as lines are kept, in
+// place of the text. The key of the previous frame is kept from its Run, prev must be
+// the frame kept by the last Run (or empty).
+class FramePipeline
+{
+public:
+	FramePipeline();
+
+	// grepLinePat NULL keeps all lines, replaceStr empty only filters.
+	void Configure(const std::regex* grepLinePat, const lstring& replaceStr, unsigned topLines, unsigned bottomLines,
+		ThreadPool* pool = NULL, bool multiPass = false);
+
+	// Cut kept lines to maxCols (--fit, 0 for no limit), call before Configure.
+	void SetMaxCols(unsigned maxCols)
+	{ m_maxCols = maxCols; }
+
+	// Color changes by age with heatMap (--cumulative, NULL highlights the last
+	// change only), call before Configure.
+	void SetHeatMap(HeatMap* heatMap)
+	{ m_heatMap = heatMap; }
+
+	// Compare frames with volatile tokens masked (--mask, NULL compares the text),
+	// call before Configure. Masked frames run fused unless rates are added.
+	void SetMask(const TokenMask* mask)
+	{ m_mask = mask; }
+
+	// Add the delta and rate column of numeric fields to the kept lines (--rates),
+	// call before Configure. The rates run as a pass after the trim.
+	void SetRates(FieldRates* rates)
+	{ m_rates = rates; }
+
+	// Sort, top-k and uniq the kept lines before the trim (--sort, --top, --uniq),
+	// call before Configure. Runs as a pass after the grep.
+	void SetAggregate(LineAggregate* aggregate)
+	{ m_aggregate = aggregate; }
+
+	// Process frame [data, data+len), write it highlighting changes against prev
+	// (prevLen 0 writes it as is). data and len are set to the kept frame, which
+	// points into the input or into filtered. Return number of lines kept.
+	unsigned Run(const char*& data, size_t& len, const char* prev, size_t prevLen, lstring& filtered, std::ostream& out = std::cout);
+
+	// Same on a frame held in a string, frame is replaced by the kept lines.
+	unsigned Run(lstring& frame, const lstring& prev, std::ostream& out = std::cout);
+
+	// Stage settings, used by the stage templates.
+	const std::regex* m_grepLinePat;
+	lstring  m_replaceStr;
+	unsigned m_topLines;
+	unsigned m_bottomLines;
+	unsigned m_maxCols;
+	HeatMap* m_heatMap;
+	const TokenMask* m_mask;
+	FieldRates* m_rates;
+	LineAggregate* m_aggregate;
+	ThreadPool* m_pool;
+	mutable lstring m_currKey;	// key of the frame being run, built by the stages
+
+	typedef unsigned (*RunFn)(const FramePipeline& cfg, const char*& data, size_t& len,
+		const char* prev, size_t prevLen, lstring& filtered, std::ostream& out);
+
+private:
+	RunFn   m_plainRun;		// first frame, written as is
+	RunFn   m_diffRun;		// highlight changes
+	lstring m_filtered;		// kept lines of the string Run
+	lstring m_prevKey;		// key of the frame kept by the last Run
+};
@@ -0,0 +1,524 @@
+// ------------------------------------------------------------------------------------------------
+// FrameServer.cpp - Share frames of one command with many viewers
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "FrameServer.h"
+#include "FrameOps.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+#ifdef _WIN32
+static const ShareHandle NO_HANDLE = INVALID_HANDLE_VALUE;
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+static const ShareHandle NO_HANDLE = -1;
+#endif
+
+static const unsigned PROTOCOL_VERSION = 1;
+
+// ======================================================================================
+// Platform specific transport.
+#ifdef _WIN32
+static std::string PipePath(const char* name)
+{
+	return (strncmp(name, "\\\\", 2) == 0) ? name : std::string("\\\\.\\pipe\\llwatch-") + name;
+}
+
+static ShareHandle CreateListenPipe(const std::string& path, bool first)
+{
+	return CreateNamedPipeA(path.c_str(),
+		PIPE_ACCESS_OUTBOUND | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+		PIPE_TYPE_BYTE | PIPE_NOWAIT,		// writes never block the tick
+		PIPE_UNLIMITED_INSTANCES, 64 * 1024, 0, 0, NULL);
+}
+
+static void CloseShare(ShareHandle handle)
+{
+	CloseHandle(handle);
+}
+
+// Send what fits, false if the client is gone.
+static bool SendSome(ShareHandle handle, const char* data, size_t len, size_t& sent)
+{
+	DWORD written = 0;
+	if (!WriteFile(handle, data, (DWORD)len, &written, NULL))
+		return false;
+	sent = written;
+	return true;
+}
+#else
+static bool SetSocketFlags(int fd)
+{
+	return fcntl(fd, F_SETFD, FD_CLOEXEC) == 0		// not inherited by the watched command
+		&& fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0;
+}
+
+static bool SocketAddress(const char* name, sockaddr_un& addr)
+{
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(name) >= sizeof(addr.sun_path))
+		return false;
+	strcpy(addr.sun_path, name);
+	return true;
+}
+
+static void CloseShare(ShareHandle handle)
+{
+	close(handle);
+}
+
+static bool SendSome(ShareHandle handle, const char* data, size_t len, size_t& sent)
+{
+	sent = 0;
+	ssize_t cnt;
+	while ((cnt = write(handle, data, len)) < 0 && errno == EINTR)
+		;
+	if (cnt < 0)
+		return errno == EAGAIN || errno == EWOULDBLOCK;
+	sent = (size_t)cnt;
+	return true;
+}
+#endif
+
+// ======================================================================================
+FrameServer::FrameServer() :
+	m_listen(NO_HANDLE),
+	m_tick(0),
+	m_exitCode(0),
+	m_prevLines(1, 0)
+{ }
+
+FrameServer::~FrameServer()
+{
+	for (size_t idx = 0; idx != m_clients.size(); idx++)
+		CloseShare(m_clients[idx]->handle);
+	if (m_listen != NO_HANDLE)
+	{
+		CloseShare(m_listen);
+#ifndef _WIN32
+		unlink(m_name.c_str());
+#endif
+	}
+}
+
+// ======================================================================================
+bool FrameServer::Listen(const char* name, const std::string& command, std::string& error)
+{
+	char hello[64];
+	snprintf(hello, sizeof(hello), "W %u ", PROTOCOL_VERSION);
+	m_hello = hello + command + "\n";
+
+#ifdef _WIN32
+	m_name = PipePath(name);
+	m_listen = CreateListenPipe(m_name, true);
+	if (m_listen == NO_HANDLE)
+	{
+		error = "Failed to create pipe " + m_name + ", is it already served?";
+		return false;
+	}
+#else
+	m_name = name;
+	sockaddr_un addr;
+	if (!SocketAddress(name, addr))
+	{
+		error = std::string("Socket path too long:") + name;
+		return false;
+	}
+
+	// Replace the socket of a server which is gone, not one which is running
+	// and never a path which is not a socket.
+	struct stat info;
+	if (lstat(name, &info) == 0 && !S_ISSOCK(info.st_mode))
+	{
+		error = std::string(name) + " exists and is not a socket";
+		return false;
+	}
+	int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+	bool live = probe >= 0 && connect(probe, (sockaddr*)&addr, sizeof(addr)) == 0;
+	if (probe >= 0)
+		close(probe);
+	if (live)
+	{
+		error = std::string(name) + " is already served";
+		return false;
+	}
+	unlink(name);
+
+	m_listen = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (m_listen < 0 || !SetSocketFlags(m_listen)
+		|| bind(m_listen, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(m_listen, 16) != 0)
+	{
+		error = std::string("Failed to listen on ") + name + ": " + strerror(errno);
+		if (m_listen >= 0)
+			close(m_listen);
+		m_listen = NO_HANDLE;
+		return false;
+	}
+	signal(SIGPIPE, SIG_IGN);		// clients which leave are noticed by write errors
+#endif
+	return true;
+}
+
+// ======================================================================================
+void FrameServer::Accept()
+{
+	for (;;)
+	{
+		ShareHandle handle = NO_HANDLE;
+#ifdef _WIN32
+		BOOL connected = ConnectNamedPipe(m_listen, NULL);
+		DWORD err = GetLastError();
+		if (!connected && err == ERROR_NO_DATA)
+		{
+			DisconnectNamedPipe(m_listen);		// came and went
+			continue;
+		}
+		if (!connected && err != ERROR_PIPE_CONNECTED)
+			break;
+		handle = m_listen;
+		m_listen = CreateListenPipe(m_name, false);
+#else
+		handle = accept(m_listen, NULL, NULL);
+		if (handle < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		SetSocketFlags(handle);
+#endif
+
+		std::unique_ptr<Client> client(new Client());
+		client->handle = handle;
+		client->sent = 0;
+		client->synced = true;		// first delta is against the empty frame
+		client->queue.push_back(std::make_shared<const std::string>(m_hello));
+		if (m_tick != 0)
+			client->queue.push_back(FullFrame());
+		m_clients.push_back(std::move(client));
+#ifdef _WIN32
+		if (m_listen == NO_HANDLE)
+			break;
+#endif
+	}
+}
+
+// ======================================================================================
+bool FrameServer::Flush(Client& client)
+{
+	while (!client.queue.empty())
+	{
+		const std::string& msg = *client.queue.front();
+		size_t sent = 0;
+		if (!SendSome(client.handle, msg.c_str() + client.sent, msg.length() - client.sent, sent))
+			return false;
+		if (sent == 0)
+			break;
+		client.sent += sent;
+		if (client.sent != msg.length())
+			break;
+		client.queue.pop_front();
+		client.sent = 0;
+	}
+	return true;
+}
+
+// ======================================================================================
+FrameServer::Message FrameServer::FullFrame()
+{
+	if (!m_fullFrame)
+	{
+		char head[64];
+		snprintf(head, sizeof(head), "F %u %lu %lu\n", m_tick, m_exitCode, (unsigned long)m_frame.length());
+		std::string* msg = new std::string(head);
+		msg->append(m_frame);
+		m_fullFrame.reset(msg);
+	}
+	return m_fullFrame;
+}
+
+// ======================================================================================
+void FrameServer::Service()
+{
+	if (m_listen != NO_HANDLE)
+		Accept();
+	for (size_t idx = 0; idx < m_clients.size(); )
+	{
+		if (Flush(*m_clients[idx]))
+		{
+			idx++;
+			continue;
+		}
+		CloseShare(m_clients[idx]->handle);
+		m_clients.erase(m_clients.begin() + idx);
+	}
+}
+
+// ======================================================================================
+void FrameServer::Drain(unsigned msec)
+{
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::milliseconds(msec);
+	for (;;)
+	{
+		Service();
+		bool pending = false;
+		for (size_t idx = 0; idx != m_clients.size(); idx++)
+			pending = pending || !m_clients[idx]->queue.empty();
+		if (!pending || std::chrono::steady_clock::now() >= end)
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+}
+
+// ======================================================================================
+void FrameServer::Publish(unsigned tick, unsigned long exitCode, const char* frame, size_t len)
+{
+	if (m_listen != NO_HANDLE)
+		Accept();
+
+	// Delta against the last published frame, built once for all clients.
+	LineOffsets(frame, len, m_lines);
+	std::string body;
+	char line[96];
+	unsigned hunks = 0;
+	ForEachHunk(frame, m_lines, m_frame.c_str(), m_prevLines, [&](size_t at, size_t delCnt, size_t addEnd)
+		{
+			size_t bytes = m_lines[addEnd] - m_lines[at];
+			snprintf(line, sizeof(line), "%lu %lu %lu\n", (unsigned long)at, (unsigned long)delCnt, (unsigned long)bytes);
+			body += line;
+			body.append(frame + m_lines[at], bytes);
+			hunks++;
+		});
+	snprintf(line, sizeof(line), "D %u %lu %u\n", tick, exitCode, hunks);
+	std::string* msg = new std::string(line);
+	msg->append(body);
+	Message delta(msg);
+
+	m_tick = tick;
+	m_exitCode = exitCode;
+	m_frame.assign(frame, len);
+	m_prevLines.swap(m_lines);
+	m_fullFrame.reset();
+
+	for (size_t idx = 0; idx != m_clients.size(); idx++)
+	{
+		Client& client = *m_clients[idx];
+		if (client.queue.size() >= MAX_QUEUED)
+		{
+			// Too far behind, drop what it has not started receiving, resync.
+			while (client.queue.size() > ((client.sent != 0) ? 1u : 0u))
+				client.queue.pop_back();
+			client.synced = false;
+		}
+		client.queue.push_back(client.synced ? delta : FullFrame());
+		client.synced = true;
+	}
+	Service();
+}
+
+// ======================================================================================
+FrameClient::FrameClient() :
+	m_tick(0),
+	m_exitCode(0),
+	m_handle(NO_HANDLE),
+	m_inPos(0)
+{ }
+
+FrameClient::~FrameClient()
+{
+	if (m_handle != NO_HANDLE)
+		CloseShare(m_handle);
+}
+
+// ======================================================================================
+bool FrameClient::Connect(const char* name, std::string& error)
+{
+#ifdef _WIN32
+	std::string path = PipePath(name);
+	for (int attempt = 0; attempt != 2; attempt++)
+	{
+		m_handle = CreateFileA(path.c_str(), GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, NULL);
+		if (m_handle != NO_HANDLE || GetLastError() != ERROR_PIPE_BUSY)
+			break;
+		WaitNamedPipeA(path.c_str(), 2000);
+	}
+	if (m_handle == NO_HANDLE)
+	{
+		error = "Failed to open " + path + ", is it served?";
+		return false;
+	}
+#else
+	sockaddr_un addr;
+	if (!SocketAddress(name, addr))
+	{
+		error = std::string("Socket path too long:") + name;
+		return false;
+	}
+	m_handle = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (m_handle < 0 || connect(m_handle, (sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		error = std::string("Failed to connect to ") + name + ": " + strerror(errno);
+		return false;
+	}
+	fcntl(m_handle, F_SETFD, FD_CLOEXEC);
+#endif
+	return true;
+}
+
+// ======================================================================================
+// Append what arrives to m_in, waking every 100msec to check stop.
+bool FrameClient::ReadMore(volatile bool& stop)
+{
+	if (m_inPos != 0 && m_inPos == m_in.length())
+	{
+		m_in.clear();
+		m_inPos = 0;
+	}
+	char buf[64 * 1024];
+	while (!stop)
+	{
+#ifdef _WIN32
+		DWORD avail = 0;
+		if (!PeekNamedPipe(m_handle, NULL, 0, NULL, &avail, NULL))
+			return false;
+		if (avail == 0)
+		{
+			Sleep(20);
+			continue;
+		}
+		DWORD cnt = 0;
+		if (!ReadFile(m_handle, buf, (std::min)(avail, (DWORD)sizeof(buf)), &cnt, NULL) || cnt == 0)
+			return false;
+#else
+		pollfd pfd = { m_handle, POLLIN, 0 };
+		int ready = poll(&pfd, 1, 100);
+		if (ready == 0 || (ready < 0 && errno == EINTR))
+			continue;
+		ssize_t cnt = read(m_handle, buf, sizeof(buf));
+		if (cnt < 0 && errno == EINTR)
+			continue;
+		if (cnt <= 0)
+			return false;
+#endif
+		m_in.append(buf, cnt);
+		return true;
+	}
+	return false;
+}
+
+// ======================================================================================
+bool FrameClient::ReadLine(std::string& line, volatile bool& stop)
+{
+	size_t eol;
+	while ((eol = m_in.find('\n', m_inPos)) == std::string::npos)
+	{
+		if (!ReadMore(stop))
+			return false;
+	}
+	line.assign(m_in, m_inPos, eol - m_inPos);
+	m_inPos = eol + 1;
+	return true;
+}
+
+// Append len bytes to out.
+bool FrameClient::ReadBytes(size_t len, std::string& out, volatile bool& stop)
+{
+	while (len != 0)
+	{
+		if (m_inPos == m_in.length() && !ReadMore(stop))
+			return false;
+		size_t cnt = (std::min)(len, m_in.length() - m_inPos);
+		out.append(m_in, m_inPos, cnt);
+		m_inPos += cnt;
+		len -= cnt;
+	}
+	return true;
+}
+
+// ======================================================================================
+bool FrameClient::Read(volatile bool& stop)
+{
+	for (;;)
+	{
+		if (!ReadLine(m_line, stop))
+			return false;
+		char type = m_line.empty() ? ' ' : m_line[0];
+		unsigned long count = 0;
+		if (type == 'W')
+		{
+			size_t sp = m_line.find(' ', 2);
+			m_command = (sp == std::string::npos) ? "" : m_line.substr(sp + 1);
+			continue;
+		}
+		if ((type != 'F' && type != 'D')
+			|| sscanf(m_line.c_str() + 1, "%u %lu %lu", &m_tick, &m_exitCode, &count) != 3)
+			return false;
+
+		if (type == 'F')
+		{
+			m_frame.clear();
+			return ReadBytes(count, m_frame, stop);
+		}
+
+		// Copy the unchanged lines, hunks replace the others.
+		LineOffsets(m_frame.c_str(), m_frame.length(), m_lines);
+		size_t lineCnt = m_lines.size() - 1;
+		size_t lineIdx = 0;
+		m_next.clear();
+		for (unsigned long hunk = 0; hunk != count; hunk++)
+		{
+			unsigned long at, delCnt, bytes;
+			if (!ReadLine(m_line, stop) || sscanf(m_line.c_str(), "%lu %lu %lu", &at, &delCnt, &bytes) != 3
+				|| at < lineIdx || at + delCnt > lineCnt)
+				return false;
+			m_next.append(m_frame, m_lines[lineIdx], m_lines[at] - m_lines[lineIdx]);
+			if (!ReadBytes(bytes, m_next, stop))
+				return false;
+			lineIdx = at + delCnt;
+		}
+		m_next.append(m_frame, m_lines[lineIdx], m_frame.length() - m_lines[lineIdx]);
+		m_frame.swap(m_next);
+		return true;
+	}
+}
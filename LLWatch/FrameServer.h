@@ -0,0 +1,152 @@
+// ------------------------------------------------------------------------------------------------
+// FrameServer.h - Share frames of one command with many viewers
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+
+#pragma once
+
+#include "llstring.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+typedef HANDLE ShareHandle;
+#else
+typedef int ShareHandle;
+#endif
+
+// ======================================================================================
+// One llwatch runs the command and publishes its frames (llwatch --serve <name>),
+// viewers (llwatch --attach <name>) render them with their own filters and highlight.
+// Transport is a Unix domain socket (name is its path) or a named pipe
+// (\\.\pipe\llwatch-<name>) on Windows.
+//
+// Messages are a text header line, optionally followed by raw frame bytes:
+//   W <version> <command>                   hello, once
+//   F <tick> <exit> <bytes>                 full frame
+//   D <tick> <exit> <hunks>                 delta, per hunk a line
+//   <at> <del> <bytes>                      replace lines [at, at+del) by the bytes
+// A client is sent a full frame when it connects, deltas after that. Sockets are
+// non-blocking, a client which falls more than MAX_QUEUED messages behind has its
+// unsent messages dropped and is sent a full frame instead, the tick never waits.
+class FrameServer
+{
+public:
+	FrameServer();
+	~FrameServer();
+
+	bool Listen(const char* name, const std::string& command, std::string& error);
+
+	// Queue frame (delta of the previous one) to every client and send what fits.
+	void Publish(unsigned tick, unsigned long exitCode, const char* frame, size_t len);
+
+	// Accept new clients and continue sending, call between ticks.
+	void Service();
+
+	// Keep sending for up to msec so clients get the last frame, before exit.
+	void Drain(unsigned msec);
+
+	size_t Clients() const
+	{ return m_clients.size(); }
+
+	static const size_t MAX_QUEUED = 2;
+
+private:
+	typedef std::shared_ptr<const std::string> Message;
+
+	struct Client
+	{
+		ShareHandle handle;
+		std::deque<Message> queue;
+		size_t sent;				// bytes of the front message already sent
+		bool   synced;				// has the frame the next delta applies to
+	};
+
+	void Accept();
+	bool Flush(Client& client);		// false if the client is gone
+	Message FullFrame();
+
+	FrameServer(const FrameServer&);
+	FrameServer& operator=(const FrameServer&);
+
+	std::string m_name;
+	std::string m_hello;
+	ShareHandle m_listen;
+	std::vector<std::unique_ptr<Client> > m_clients;
+
+	unsigned m_tick;
+	unsigned long m_exitCode;
+	lstring  m_frame;				// last published
+	std::vector<size_t> m_lines;
+	std::vector<size_t> m_prevLines;
+	Message  m_fullFrame;			// of m_frame, built when a client needs it
+};
+
+// ======================================================================================
+// Viewer side, rebuilds the published frames.
+class FrameClient
+{
+public:
+	FrameClient();
+	~FrameClient();
+
+	bool Connect(const char* name, std::string& error);
+
+	// Wait for the next frame, false if the server is gone or stop is set.
+	bool Read(volatile bool& stop);
+
+	const lstring& Frame() const
+	{ return m_frame; }
+
+	unsigned      m_tick;
+	unsigned long m_exitCode;
+	std::string   m_command;		// watched by the server
+
+private:
+	bool ReadMore(volatile bool& stop);
+	bool ReadLine(std::string& line, volatile bool& stop);
+	bool ReadBytes(size_t len, std::string& bytes, volatile bool& stop);
+
+	FrameClient(const FrameClient&);
+	FrameClient& operator=(const FrameClient&);
+
+	ShareHandle m_handle;
+	std::string m_in;				// received, not parsed
+	size_t      m_inPos;
+	lstring     m_frame;
+	lstring     m_next;				// frame being rebuilt
+	std::vector<size_t> m_lines;
+	std::string m_line;
+	std::string m_bytes;
+};
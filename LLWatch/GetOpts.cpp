@@ -49,6 +49,9 @@ bool GetOpts<tchar>::GetOpt()
 
 		if (m_argSeq[1] && *++m_argSeq == '-') 
         { 
+            if (m_argSeq[1] && m_longOpts)
+                return GetLongOpt(m_argSeq + 1);
+
             // Found "--", no more options allowed.
 			++m_optIdx;
 			m_argSeq = 0;
@@ -109,5 +112,58 @@ bool GetOpts<tchar>::GetOpt()
 	return true; // Got a valid option.
 }
 
+// ------------------------------------------------------------------------------------------------
+template <typename tchar>
+bool GetOpts<tchar>::GetLongOpt(const tchar* name)
+{
+    m_argSeq = 0;
+    ++m_optIdx;
+
+    const tchar* pEndName = FindChr(name, '=');
+    size_t nameLen = 0;
+    while (name[nameLen] && &name[nameLen] != pEndName)
+        nameLen++;
+
+    for (const LongOpt* pLong = m_longOpts; pLong->name != 0; pLong++)
+    {
+        const tchar* pName = pLong->name;
+        size_t idx = 0;
+        while (idx != nameLen && pName[idx] == name[idx])
+            idx++;
+        if (idx != nameLen || pName[idx] != 0)
+            continue;
+
+        m_optOpt = pLong->opt;
+        m_optArg = NULL;
+        if (!pLong->hasArg)
+        {
+            if (pEndName == 0)
+                return true;
+            m_error = true;     // Unexpected option value
+            return false;
+        }
+
+        if (pEndName)
+        {
+            m_optArg = pEndName + 1;
+        }
+        else if (m_optIdx < m_argc)
+        {
+            m_optArg = m_argv[m_optIdx++];
+        }
+        else
+        {
+            m_error = true;     // Missing option value
+            return false;
+        }
+        return true;
+    }
+
+    m_optOpt = '-';
+    m_error = true;     // Illegal option.
+    return false;
+}
+
 // Force template to build.
 template bool GetOpts<char>::GetOpt();
+template bool GetOpts<char>::GetLongOpt(const char*);
@@ -35,15 +35,26 @@ template <typename tchar>
 class GetOpts
 {
 public:
+    // Long option, reported by Opt() as its 'opt' character.
+    //   --name  or  --name value  or  --name=value
+    // Table is terminated by an entry with a NULL name.
+    struct LongOpt
+    {
+        const tchar*    name;
+        bool            hasArg;
+        tchar           opt;
+    };
+
     // Pass in argc and argv from main()
     // optStr is optional switches
     //      "bd:eg:h"
     // colon indicates those switch letter which tag an argument
     //   -b  -d foo -e -g bar -h
-    GetOpts(int argc,  const tchar* argv[], const tchar* optStr) :
+    GetOpts(int argc,  const tchar* argv[], const tchar* optStr, const LongOpt* longOpts = 0) :
         m_argc(argc),
         m_argv(argv),
         m_optStr(optStr),
+        m_longOpts(longOpts),
         m_optArg(0),     // Argument associated with option 
         m_optIdx(1),        // Index into parent argv vector
         m_optOpt(0),        // Character checked for validity
@@ -54,6 +65,7 @@ public:
     int             m_argc;
     const tchar**   m_argv;
     const tchar*    m_optStr;
+    const LongOpt*  m_longOpts;
 
     const tchar*    m_optArg;   // Argument associated with option  
     int             m_optIdx;   // Index into parent argv vector 
@@ -64,6 +76,9 @@ public:
     // Return true if option detected.
     bool GetOpt();
 
+    // Parse --name[=value], return true if name is in the long option table.
+    bool GetLongOpt(const tchar* name);
+
     // Return option character just processed by GetOpt().
     tchar Opt() const
     { return m_optOpt; }
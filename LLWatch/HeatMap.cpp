@@ -0,0 +1,150 @@
+// ------------------------------------------------------------------------------------------------
+// HeatMap.cpp - Cumulative change heatmap, cells colored by age of last change
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+#include "HeatMap.h"
+#include "FrameOps.h"
+#include "Colorize.h"
+
+#include <algorithm>
+
+// Hottest first, text older than the fade uses MATCH_COLOR.
+static const char* s_heatColors[HeatMap::LEVELS] = { "!0e", "!0c", "!04", "!08" };
+
+// ======================================================================================
+HeatMap::HeatMap(unsigned fadeTicks, size_t maxCells) :
+	m_fadeTicks((std::min)((std::max)(fadeTicks, 1u), MAX_FADE_TICKS)),
+	m_maxCells(maxCells),
+	m_tick(0),
+	m_prev(NULL),
+	m_prevLen(0),
+	m_color(LEVELS)
+{ }
+
+// ======================================================================================
+void HeatMap::Clear()
+{
+	m_stamps.clear();
+	m_tick = 0;
+}
+
+// ======================================================================================
+// Oldest stamps still within the fade move down to 1, older ones become never.
+void HeatMap::Rebase()
+{
+	uint16_t shift = (uint16_t)(m_tick - m_fadeTicks - 1);
+	for (size_t cell = 0; cell != m_stamps.size(); cell++)
+	{
+		uint16_t stamp = m_stamps[cell];
+		m_stamps[cell] = (stamp == 0 || (unsigned)(m_tick - stamp) >= m_fadeTicks) ? 0 : (uint16_t)(stamp - shift);
+	}
+	m_tick -= shift;
+}
+
+// ======================================================================================
+void HeatMap::Begin(const char* prev, size_t prevLen)
+{
+	if (m_tick == UINT16_MAX)
+		Rebase();
+	m_tick++;
+	m_prev = prev;
+	m_prevLen = prevLen;
+	m_color = LEVELS;
+}
+
+// ======================================================================================
+// Level of a cell, changed this frame is 0, LEVELS once the fade is over.
+inline unsigned HeatMap::Level(size_t cell, bool changed) const
+{
+	if (changed)
+		return 0;
+	if (cell >= m_stamps.size() || m_stamps[cell] == 0)
+		return LEVELS;
+	unsigned age = (uint16_t)(m_tick - m_stamps[cell]);
+	return (age >= m_fadeTicks) ? LEVELS : 1 + age * (LEVELS - 1) / m_fadeTicks;
+}
+
+// ======================================================================================
+void HeatMap::Add(const char* curr, const char* key, size_t from, size_t to, std::ostream& out)
+{
+	size_t stampEnd = (std::min)(to, m_maxCells);
+	if (m_stamps.size() < stampEnd)
+		m_stamps.resize(stampEnd, 0);
+
+	size_t start = from;
+	unsigned color = m_color;
+	for (size_t pos = from; pos != to; pos++)
+	{
+		bool changed = pos >= m_prevLen || key[pos] != m_prev[pos];
+		if (changed && pos < stampEnd)
+			m_stamps[pos] = m_tick;
+		unsigned level = Level(pos, changed);
+		if (level != color)
+		{
+			if (pos != start)
+				Colorize::write(out, curr + start, (unsigned)(pos - start));
+			Colorize::write(out, (level == LEVELS) ? MATCH_COLOR : s_heatColors[level]);
+			color = level;
+			start = pos;
+		}
+	}
+	if (to != start)
+		Colorize::write(out, curr + start, (unsigned)(to - start));
+	m_color = color;
+}
+
+// ======================================================================================
+void HeatMap::Finish(size_t len, std::ostream& out)
+{
+	if (m_stamps.size() > len)
+		m_stamps.resize(len);
+	Colorize::write(out, MATCH_COLOR);
+	m_color = LEVELS;
+}
+
+// ======================================================================================
+void HeatMap::Show(const char* curr, size_t currLen, const char* prev, size_t prevLen, std::ostream& out)
+{
+	Begin(prev, prevLen);
+	Add(curr, 0, currLen, out);
+	Finish(currLen, out);
+}
+
+// ======================================================================================
+void HeatMap::Counts(size_t counts[], unsigned levels) const
+{
+	for (unsigned level = 0; level != levels; level++)
+		counts[level] = 0;
+	for (size_t cell = 0; cell != m_stamps.size(); cell++)
+	{
+		unsigned level = Level(cell, m_stamps[cell] == m_tick && m_tick != 0);
+		if (level < levels)
+			counts[level]++;
+	}
+}
@@ -0,0 +1,92 @@
+// ------------------------------------------------------------------------------------------------
+// HeatMap.h - Cumulative change heatmap, cells colored by age of last change
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <iostream>
+#include <stdint.h>
+#include <vector>
+
+// ======================================================================================
+// Cumulative change heatmap (llwatch --cumulative). Each cell (byte offset of the
+// frame, like the highlight) keeps the tick it last changed at, text is colored by
+// how recently it changed, fading over fadeTicks frames. Stamps are updated from the
+// diff runs of each frame only, unchanged cells are not touched.
+//
+// Memory is bounded: 16 bit stamps, rebased when the tick wraps, for the first
+// maxCells cells. Cells past maxCells are colored like the plain highlight.
+class HeatMap
+{
+public:
+	static const size_t DEFAULT_MAX_CELLS = 4 << 20;
+	static const unsigned MAX_FADE_TICKS = 1000;
+
+	HeatMap(unsigned fadeTicks, size_t maxCells = DEFAULT_MAX_CELLS);
+
+	// Start a frame compared with prev.
+	void Begin(const char* prev, size_t prevLen);
+
+	// Stamp cells [from, to) of curr which differ from prev, write them colored by age.
+	// Called with consecutive ranges, curr may move between calls.
+	void Add(const char* curr, size_t from, size_t to, std::ostream& out)
+	{ Add(curr, curr, from, to, out); }
+
+	// Same comparing key (curr with tokens masked, prev is then a key) in place of curr.
+	void Add(const char* curr, const char* key, size_t from, size_t to, std::ostream& out);
+
+	// End of frame of len cells, stamps past it are dropped, color reset.
+	void Finish(size_t len, std::ostream& out);
+
+	// Compare and write a whole frame.
+	void Show(const char* curr, size_t currLen, const char* prev, size_t prevLen, std::ostream& out);
+
+	// Forget all stamps (ex: window resized).
+	void Clear();
+
+	size_t Cells() const
+	{ return m_stamps.size(); }
+
+	// Cells which changed within the fade, by age bucket (0 is this frame).
+	void Counts(size_t counts[], unsigned levels) const;
+
+	static const unsigned LEVELS = 4;
+
+private:
+	unsigned Level(size_t cell, bool changed) const;
+	void Rebase();
+
+	unsigned m_fadeTicks;
+	size_t   m_maxCells;
+	uint16_t m_tick;				// frames compared, stamps are ticks (0 never changed)
+	std::vector<uint16_t> m_stamps;	// tick each cell last changed
+	const char* m_prev;
+	size_t   m_prevLen;
+	unsigned m_color;				// level written last, LEVELS for unchanged
+};
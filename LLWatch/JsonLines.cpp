@@ -0,0 +1,180 @@
+// ------------------------------------------------------------------------------------------------
+// JsonLines.cpp - JSON lines frame output
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "JsonLines.h"
+#include "FrameOps.h"
+
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// Characters which must be escaped in a JSON string.
+static bool s_escape[256];
+static bool s_escapeInit = []()
+{
+	for (unsigned chr = 0; chr != 256; chr++)
+		s_escape[chr] = chr < 0x20 || chr == '"' || chr == '\\';
+	return true;
+}();
+
+// ======================================================================================
+JsonLines::JsonLines() : m_out(NULL), m_hunks(false), m_prevLines(1, 0)
+{ }
+
+JsonLines::~JsonLines()
+{
+	if (m_out != NULL && m_out != stdout)
+		fclose(m_out);
+}
+
+// ======================================================================================
+bool JsonLines::Open(const char* path)
+{
+	if (path == NULL || *path == '\0')
+	{
+#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);	// no \r added to the lines
+#endif
+		m_out = stdout;
+		return true;
+	}
+	m_out = fopen(path, "wb");
+	return m_out != NULL;
+}
+
+// ======================================================================================
+// Quoted string, characters which need no escape are appended a run at a time.
+void JsonLines::AppendString(const char* str, size_t len)
+{
+	static const char s_hex[] = "0123456789abcdef";
+	m_buf += '"';
+	size_t start = 0;
+	for (size_t idx = 0; idx != len; idx++)
+	{
+		unsigned char chr = (unsigned char)str[idx];
+		if (!s_escape[chr])
+			continue;
+		m_buf.append(str + start, idx - start);
+		start = idx + 1;
+		switch (chr)
+		{
+		case '"':	m_buf += "\\\""; break;
+		case '\\':	m_buf += "\\\\"; break;
+		case '\n':	m_buf += "\\n"; break;
+		case '\r':	m_buf += "\\r"; break;
+		case '\t':	m_buf += "\\t"; break;
+		default:
+			m_buf += "\\u00";
+			m_buf += s_hex[chr >> 4];
+			m_buf += s_hex[chr & 0xf];
+			break;
+		}
+	}
+	m_buf.append(str + start, len - start);
+	m_buf += '"';
+}
+
+// ======================================================================================
+// Lines are written without their line ending, bounded by m_lines (LineOffsets of the
+// frame length) so NUL bytes in the frame are escaped like any control character.
+void JsonLines::AppendHunks(const char* frame)
+{
+	char num[64];
+	bool first = true;
+	m_buf += ",\"hunks\":[";
+	ForEachHunk(frame, m_lines, m_prevFrame.c_str(), m_prevLines, [&](size_t at, size_t delCnt, size_t addEnd)
+		{
+			snprintf(num, sizeof(num), "%s{\"at\":%u,\"del\":%u,\"add\":[", first ? "" : ",", (unsigned)at, (unsigned)delCnt);
+			m_buf += num;
+			first = false;
+			for (size_t addIdx = at; addIdx < addEnd; addIdx++)
+			{
+				const char* line = frame + m_lines[addIdx];
+				size_t lineLen = m_lines[addIdx + 1] - m_lines[addIdx];
+				if (lineLen != 0 && line[lineLen - 1] == '\n')
+					lineLen--;
+				if (lineLen != 0 && line[lineLen - 1] == '\r')
+					lineLen--;
+				if (addIdx != at)
+					m_buf += ',';
+				AppendString(line, lineLen);
+			}
+			m_buf += "]}";
+		});
+	m_buf += ']';
+}
+
+// ======================================================================================
+void JsonLines::Write(unsigned tick, int64_t startTimeMs, double runMs, unsigned long exitCode, const char* frame, size_t len)
+{
+	if (m_out == NULL)
+		return;
+	LineOffsets(frame, len, m_lines);
+
+	time_t secs = (time_t)(startTimeMs / 1000);
+	struct tm utc;
+#ifdef _WIN32
+	gmtime_s(&utc, &secs);
+#else
+	gmtime_r(&secs, &utc);
+#endif
+	char stamp[32];
+	strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &utc);
+
+	char head[256];
+	snprintf(head, sizeof(head),
+		"{\"tick\":%u,\"time\":\"%s.%03uZ\",\"ms\":%.1f,\"exit\":%lu,\"hash\":\"%016llx\",\"lines\":%u",
+		tick, stamp, (unsigned)(startTimeMs % 1000), runMs, exitCode,
+		(unsigned long long)HashBytes(frame, len), (unsigned)(m_lines.size() - 1));
+	m_buf.assign(head);
+
+	if (m_hunks)
+	{
+		AppendHunks(frame);
+		m_prevFrame.assign(frame, len);
+		m_prevLines.swap(m_lines);
+	}
+	else
+	{
+		m_buf += ",\"frame\":";
+		AppendString(frame, len);
+	}
+	m_buf += "}\n";
+
+	fwrite(m_buf.c_str(), 1, m_buf.length(), m_out);
+	fflush(m_out);
+}
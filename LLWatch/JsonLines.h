@@ -0,0 +1,79 @@
+// ------------------------------------------------------------------------------------------------
+// JsonLines.h - JSON lines frame output
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+
+#pragma once
+
+#include "llstring.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// ======================================================================================
+// Machine readable output (llwatch --format jsonl), one JSON object per run:
+//   {"tick":1,"time":"2016-01-23T10:20:30.123Z","ms":12.5,"exit":0,
+//    "hash":"cbf29ce484222325","lines":3,"frame":"line1\nline2\nline3\n"}
+// With hunks the frame is replaced by the lines which differ from the previous run,
+// by position like the highlight: delete 'del' lines at index 'at', insert 'add'.
+//   ..."hunks":[{"at":1,"del":1,"add":["line2 changed"]}]}
+// The first run is one hunk of all lines. Objects are built in a reused buffer and
+// strings are escaped in runs, nothing is allocated per line once buffers are warm.
+class JsonLines
+{
+public:
+	JsonLines();
+	~JsonLines();
+
+	// Write to path (truncated), stdout if path is NULL or empty.
+	bool Open(const char* path);
+
+	void SetHunks(bool hunks)
+	{ m_hunks = hunks; }
+
+	// Object for the kept lines of one run, started startTimeMs after the epoch (UTC).
+	void Write(unsigned tick, int64_t startTimeMs, double runMs, unsigned long exitCode, const char* frame, size_t len);
+
+private:
+	void AppendString(const char* str, size_t len);
+	void AppendHunks(const char* frame);
+
+	JsonLines(const JsonLines&);
+	JsonLines& operator=(const JsonLines&);
+
+	FILE* m_out;
+	bool  m_hunks;
+	std::string m_buf;					// object being built
+	std::string m_prevFrame;			// hunks base
+	std::vector<size_t> m_lines;		// line start offsets, plus end
+	std::vector<size_t> m_prevLines;
+};
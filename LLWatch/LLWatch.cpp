@@ -26,25 +26,66 @@
 // IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
 // CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
+// Build:
+//   Windows  llwatch-ms\llwatch.sln
+//   Linux    cd LLWatch
+//            g++ -O2 -std=c++17 -o llwatch LLWatch.cpp Baseline.cpp ChildProcess.cpp PosixProcess.cpp
+//              Colorize.cpp Daemon.cpp Dashboard.cpp FieldRates.cpp FrameGovernor.cpp FrameOps.cpp
+//              FramePipeline.cpp FrameServer.cpp GetOpts.cpp HeatMap.cpp JsonLines.cpp LineAggregate.cpp
+//              llstring.cpp MappedFile.cpp PhaseStats.cpp RunTrigger.cpp RunUsage.cpp ShmRing.cpp
+//              ThreadPool.cpp TimerWheel.cpp TokenMask.cpp -lutil -pthread
+//
 // ------------------------------------------------------------------------------------------------
  
+#ifdef _MSC_VER
 #pragma warning( disable : 4995 )
+#endif
 
 
 
-// Windows specific classes
-#include "winprocess.h"
-#include "wincursor.h"
-#include "colorize.h"
-#include "getopts.h"
+// Platform specific classes
+#include "Baseline.h"
+#include "ChildProcess.h"
+#include "WinCursor.h"
+#include "Colorize.h"
+#include "GetOpts.h"
 #include "llstring.h"
+#include "PhaseStats.h"
+#include "FrameOps.h"
+#include "Daemon.h"
+#include "Dashboard.h"
+#include "FieldRates.h"
+#include "FrameGovernor.h"
+#include "FramePipeline.h"
+#include "HeatMap.h"
+#include "LineAggregate.h"
+#include "FrameServer.h"
+#include "JsonLines.h"
+#include "MappedFile.h"
+#include "RunTrigger.h"
+#include "ShmRing.h"
+#include "ThreadPool.h"
+#include "TokenMask.h"
 
+#ifdef _WIN32
 #include <Windows.h>
+#include <strsafe.h>
+#else
+#include <signal.h>
+#include <unistd.h>
+#endif
 
+#include <algorithm>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <thread>
 #include <stdio.h> 
-#include <strsafe.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 
 using namespace std;
 typedef unsigned int uint;
@@ -64,6 +105,10 @@ char sUsage[] =
 "\n"
 "USAGE: \n"
 "  llwatch [-dhv] [-t #lines][-b #lines] [-n <seconds>] -- <command> \n"
+"  llwatch [options] [-n <seconds>] -c <command> [-n <seconds>] -c <command> ... \n"
+"  llwatch --daemon <config> [--count <#runs>] \n"
+"  llwatch --serve <name> [-g <pattern>] [-n <seconds>] -- <command> \n"
+"  llwatch --attach <name> [-dhv] [-t #lines][-b #lines] [-g <pattern>] \n"
 "\n"
 "DESCRIPTION:"
 "  Watch runs command repeatedly, displaying its output. This allows you to \n"
@@ -75,7 +120,52 @@ char sUsage[] =
 "  -n <seconds> Specify update interval, default 2 seconds \n"
 "  -t <#lines> Limit output to top # lines, default is 20 \n"
 "  -b <#lines> Limit output to bottom # lines, default is all \n"
+"  --cumulative <ticks>  Color changes by how recently they happened, fading over \n"
+"     ticks (1..1000) runs (heatmap) in place of highlighting the last change only \n"
+"  --baseline <file>  Highlight where the kept lines deviate from a saved snapshot \n"
+"     (line by line) instead of changes since the previous run \n"
+"  --save-baseline <file>  Save the kept lines of the first run as a --baseline snapshot \n"
+"  --mask <pattern>  Volatile tokens (timestamps, counters) which are not highlighted \n"
+"     as changes, a regex or @time @date @number @hex @uuid, repeat for more rules \n"
+"  --rates <line|key>  Add a column of the change and per second rate of numeric fields, \n"
+"     paired with the previous run by line and field position or by the line text (key) \n"
+"  --sort <column>[n][r]  Sort lines by a blank separated column, n as numbers, r descending \n"
+"     (column 0 is the --uniq count), lines without the column stay on top \n"
+"  --top <k>  With --sort keep the first k lines of the sort order, ex: --sort 5nr --top 10 \n"
+"  --uniq  Collapse duplicate lines into one prefixed with its count \n"
+"  --fit  Keep the top (or with -b bottom) lines and columns which fit the console \n"
+"     window in place of -t / -b, follows window resizes \n"
+"  -c <command> Watch several commands in tiled panes, repeat -c per command. \n"
+"     Each runs every -n seconds given before it, a command after -- is the last pane \n"
 "  -v  Toggle verbose output \n"
+"  --stats  Show per-phase timing (min/avg/p50/p99) status line, dump summary on exit \n"
+"  --trace <file>  Write per-tick timing as JSON lines to file \n"
+"  --count <#runs>  Stop after # runs, default is forever \n"
+"  --stream  Highlight and show each line as soon as the command writes it \n"
+"  --mmap  Capture output in temporary files, processed memory mapped (huge outputs) \n"
+"  --pty  Run command in a pseudo terminal so it line buffers its output \n"
+"  --pty-size <cols>x<rows>  Pseudo terminal size, default is console size \n"
+"  --threads <#threads>  Grep and diff large output in parallel, 0 for all cores \n"
+"  --daemon <config>  Run the watch jobs of config file headless, see README \n"
+"  --format <text|jsonl|jsonl-hunks>  jsonl writes one JSON object per run with \n"
+"     the kept lines, jsonl-hunks only the lines which changed \n"
+"  --output <file>  Write --format jsonl to file instead of stdout \n"
+"  --serve <name>  Run command for --attach viewers (Unix socket path or pipe name), \n"
+"     viewers apply their own -t, -b, -g and highlight \n"
+"  --attach <name>  Show the frames of a --serve llwatch instead of running a command \n"
+"  --shm <name>  Publish the kept lines of each run in shared memory for ShmRingReader \n"
+"  --shm-size <MB>  Largest frame in --shm, default 4 MB \n"
+"  --slow <msec>  Highlight the trailer of runs which took longer, shown even without -v \n"
+"  --nice <1..19>  Run commands and llwatch at lower cpu priority \n"
+"  --low-io  Run commands and llwatch at idle I/O priority (Linux, llwatch only on Windows) \n"
+"  --affinity <hexMask>  Run commands and llwatch on these cpus \n"
+"  --max-mem <MB>  Cap command memory, trailer shows LIMIT memory when hit \n"
+"  --max-cpu <seconds>  Cap command cpu time, trailer shows LIMIT cpu when hit \n"
+"  --max-fps <fps>  Paint at most fps frames per second, runs in between are coalesced \n"
+"     into the latest frame highlighting all changes since the last paint \n"
+"  --trigger <name>  Run now on a write to FIFO name (Windows \\\\.\\pipe\\llwatch-name) or \n"
+"     the named event Local\\llwatch-name (Windows). Space or enter also runs now, \n"
+"     q quits, SIGUSR1 runs now (POSIX) \n"
 
 #ifdef HAVE_REGEX
 "  -g <pattern> Match grep pattern for line to show. \n"
@@ -110,117 +200,332 @@ std::string         m_replaceStr;       // -R=<replacePattern>
 #endif
 
 bool m_verbose = true;
-const char MATCH_COLOR[] = "!07";
-const char DIFF_COLOR[] = "!0e";
+bool m_showStats = false;
+const char* m_traceFile = NULL;
+bool m_usePty = false;
+bool m_stream = false;
+bool m_mmap = false;
+uint m_ptyCols = 0;
+uint m_ptyRows = 0;
+int  m_threads = 1;
+const char* m_daemonConfig = NULL;
+bool m_jsonl = false;
+bool m_jsonlHunks = false;
+const char* m_outputFile = NULL;
+const char* m_serveName = NULL;
+const char* m_attachName = NULL;
+const char* m_shmName = NULL;
+const char* m_triggerName = NULL;
+unsigned m_maxFps = 0;
+bool m_fit = false;
+unsigned m_fadeTicks = 0;
+const char* m_baselineFile = NULL;
+const char* m_saveBaselineFile = NULL;
+TokenMask m_tokenMask;
+const char* m_ratesPairing = NULL;
+LineAggregate m_aggregate;
+size_t m_shmSlotBytes = 4 << 20;
+double m_slowMs = 0;
+const char SLOW_COLOR[] = "!0c";
+RunLimits m_limits;
+volatile bool m_stop = false;
 
 // ======================================================================================
-void showDiffFast(const lstring& currBuffer, const lstring& prevBuffer)
+// Return position of the stand alone "--" which separates options from command.
+size_t FindCommandSeparator(const lstring& cmdLine)
 {
-	unsigned endIdx = (unsigned)min(currBuffer.length(), prevBuffer.length());
-	unsigned startIdx = 0;
-	unsigned idx = 0;
-	while (idx != endIdx)
-	{
-		while (idx != endIdx && currBuffer[idx] == prevBuffer[idx])
-			idx++;
-		Colorize::write(std::cout, MATCH_COLOR);
-		Colorize::write(std::cout, currBuffer + startIdx, idx - startIdx);
-		startIdx = idx;
-		while (idx != endIdx && currBuffer[idx] != prevBuffer[idx])
-			idx++;
-		Colorize::write(std::cout, DIFF_COLOR);
-		Colorize::write(std::cout, currBuffer + startIdx, idx - startIdx);
-		startIdx = idx;
-	}
-
-	Colorize::write(std::cout, MATCH_COLOR);
-	idx = (unsigned)currBuffer.length();
-	if (idx > startIdx)
-		Colorize::write(std::cout, currBuffer + startIdx, idx - startIdx);
+	size_t off = 0;
+	while ((off = cmdLine.find("--", off)) != std::string::npos)
+	{
+		bool begTok = (off == 0 || isspace(cmdLine[off - 1]));
+		bool endTok = (off + 2 == cmdLine.length() || isspace(cmdLine[off + 2]));
+		if (begTok && endTok)
+			return off;
+		off += 2;
+	}
+	return std::string::npos;
 }
 
 // ======================================================================================
-void TrimTopBottom(lstring& currBuffer, uint topLines, uint bottomLines)
+// Ctrl-C stops the loop so statistics can be reported.
+#ifdef _WIN32
+BOOL WINAPI CtrlHandler(DWORD ctrlType)
 {
-	lstring eol("\n");
-	uint lineCnt = currBuffer.count(eol);
-	if (lineCnt > bottomLines && bottomLines != 0)
+	if (ctrlType == CTRL_C_EVENT || ctrlType == CTRL_BREAK_EVENT)
 	{
-		uint skipLines = lineCnt - bottomLines;
-		size_t offset = currBuffer.findCnt(eol, 0, skipLines);
-		currBuffer.erase(0, offset);
+		m_stop = true;
+		RunTrigger::Stop();
+		return TRUE;
 	}
-	else if (lineCnt > topLines && topLines != 0)
+	return FALSE;
+}
+
+void SetCtrlHandler()
+{
+	SetConsoleCtrlHandler(CtrlHandler, TRUE);
+}
+#else
+void CtrlHandler(int)
+{
+	m_stop = true;
+	RunTrigger::Stop();
+}
+
+void SetCtrlHandler()
+{
+	signal(SIGINT, CtrlHandler);
+}
+#endif
+
+// ======================================================================================
+// Rows and columns of the console window left for the kept lines (--fit), rows less
+// the status lines written around each run, one column left so lines do not wrap.
+bool FitViewport(unsigned& rows, unsigned& cols)
+{
+	uint conCols, conRows;
+	if (!WinCursor::GetConsoleSize(conCols, conRows))
+		return false;
+	unsigned reserved = 1 + (m_verbose ? 4 : 0) + (m_showStats ? 1 : 0);
+	rows = (conRows > reserved) ? conRows - reserved : 1;
+	cols = (conCols > 1) ? conCols - 1 : 1;
+	return true;
+}
+
+// ======================================================================================
+// Per process temporary file for captured output (--mmap).
+std::string TempCaptureFile(unsigned idx)
+{
+	char name[64];
+#ifdef _WIN32
+	char tmpDir[MAX_PATH];
+	GetTempPathA(sizeof(tmpDir), tmpDir);
+	snprintf(name, sizeof(name), "llwatch-%lu-%u.out", (unsigned long)GetCurrentProcessId(), idx);
+	return std::string(tmpDir) + name;
+#else
+	const char* tmpDir = getenv("TMPDIR");
+	snprintf(name, sizeof(name), "/llwatch-%lu-%u.out", (unsigned long)getpid(), idx);
+	return std::string(tmpDir ? tmpDir : "/tmp") + name;
+#endif
+}
+
+#ifndef _WIN32
+// ======================================================================================
+// Append argument quoted for /bin/sh, bare if it has no shell meta characters.
+void AppendShellArg(lstring& cmdLine, const char* arg)
+{
+	if (*arg != '\0' && arg[strspn(arg, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_./:,+@")] == '\0')
+	{
+		cmdLine += arg;
+		return;
+	}
+	cmdLine += "'";
+	for (; *arg != '\0'; arg++)
 	{
-		size_t offset = currBuffer.findCnt(eol, 0, topLines);
-		currBuffer.resize(offset + eol.length());
+		if (*arg == '\'')
+			cmdLine += "'\\''";
+		else
+			cmdLine += *arg;
 	}
+	cmdLine += "'";
 }
+#endif
 
 // ======================================================================================
-void RegexTrim(lstring& currBuffer, const std::regex& grepLinePat, const lstring& replaceStr)
+// Command follows the "--" separator in the raw command line (Windows) so quoting
+// is passed through untouched. POSIX has no raw command line, a single argument is
+// the command as typed (run by /bin/sh if needed), several arguments are quoted so
+// PosixProcess::GetRunArgs gives each to the child unchanged.
+// Without a separator the whole line is the command, unless requireSeparator.
+lstring GetWatchCommand(int argc, const char* argv[], bool requireSeparator)
 {
-	const char eol[] = "\n";
-	Split lines(currBuffer, eol);
-	bool changed = false;
-	size_t size = 0;
-	
-	bool doReplace = !replaceStr.empty();
-	for (size_t idx = lines.size() - 1; idx < lines.size(); idx--)
-	{
-		lstring& str = lines[idx];
-		bool keep;
-		if (doReplace)
-			keep = str.regReplace(grepLinePat, replaceStr);
-		else
-			keep = str.regFind(grepLinePat);
+#ifdef _WIN32
+	lstring cmdLine = GetCommandLine();
+	size_t eraseCnt = strlen(argv[0]) + 1 + ((cmdLine.at(0) == '"') ? 2 : 0);
+	cmdLine.erase(0, eraseCnt);
+	size_t off = FindCommandSeparator(cmdLine);
+	if (off != std::string::npos)
+		cmdLine.erase(0, off + 2);
+	else if (requireSeparator)
+		cmdLine.clear();
+#else
+	int first = 1;
+	while (first < argc && strcmp(argv[first], "--") != 0)
+		first++;
+	if (first < argc)
+		first++;
+	else if (requireSeparator)
+		first = argc;
+	else
+		first = 1;
 
-		if (!keep || str.isSpace())
-			lines.erase(lines.begin() + idx);
-		else
-			size += str.length();
+	lstring cmdLine;
+	if (argc - first == 1)
+		cmdLine = argv[first];
+	else
+	{
+		for (int idx = first; idx < argc; idx++)
+		{
+			cmdLine += " ";
+			AppendShellArg(cmdLine, argv[idx]);
+		}
 	}
+#endif
+	cmdLine.trim();
+	return cmdLine;
+}
+
+// ======================================================================================
+// Several commands (-c), shown in tiled panes of one console.
+typedef std::pair<std::string, uint> WatchCommand;		// command, seconds
 
-	std::string result;
-	result.reserve(size);
+int RunDashboard(const std::vector<WatchCommand>& commands)
+{
+	if (m_stream || m_mmap || m_showStats || m_traceFile || m_threads != 1 || m_homeCursor)
+		std::cerr << "-h, --stream, --mmap, --stats, --trace and --threads are ignored with several commands\n";
 
-	for (unsigned idx = 0; idx != lines.size(); idx++)
-		result.append(lines[idx] + eol);
+	Dashboard dashboard;
+	for (size_t idx = 0; idx != commands.size(); idx++)
+		dashboard.AddCommand(commands[idx].first, commands[idx].second);
+#ifdef HAVE_REGEX
+	if (m_isGrepLinePat)
+		dashboard.SetGrep(&m_grepLinePat, m_replaceStr);
+#endif
+	dashboard.SetTrim(m_topLines, m_bottomLines);
+	dashboard.SetHighlight(m_highlightDelta);
+	dashboard.SetPty(m_usePty);
+	dashboard.SetLimits(m_limits);
 
-	currBuffer.swap(result);
+	SetCtrlHandler();
+	dashboard.Run(m_maxRunCnt, m_stop);
+	return 0;
 }
 
 // ======================================================================================
-int main(int argc, const char *argv[])
+// Jobs of the config file, no console output (--daemon).
+int RunDaemon()
 {
-	if (argc == 1)
+	Daemon daemon;
+	std::string error;
+	if (!daemon.Load(m_daemonConfig, error))
 	{
-		std::cerr << sUsage;
+		std::cerr << error << std::endl;
 		return -1;
 	}
+	daemon.SetLimits(m_limits);
 
-	lstring cmdLine = GetCommandLine();
-    size_t eraseCnt = strlen(argv[0]) + 1 + ((cmdLine.at(0) == '"') ? 2 : 0);
-    cmdLine.erase(0, eraseCnt);
-	int off = (int)cmdLine.find("--");
-	if (off != -1)
-		cmdLine.erase(0, off + 2);
+	SetCtrlHandler();
+#ifndef _WIN32
+	signal(SIGTERM, CtrlHandler);
+#endif
+	daemon.Run(m_maxRunCnt, m_stop);
+	return 0;
+}
 
-	cmdLine.trim();
+// ======================================================================================
+// Show frames published by llwatch --serve, filtered and highlighted here.
+int RunAttach()
+{
+	FrameClient client;
+	std::string error;
+	if (!client.Connect(m_attachName, error))
+	{
+		std::cerr << error << std::endl;
+		return -1;
+	}
+	SetCtrlHandler();
 
-	if (cmdLine.length() == 0)
+	FramePipeline pipeline;
+#ifdef HAVE_REGEX
+	pipeline.Configure(m_isGrepLinePat ? &m_grepLinePat : NULL, m_replaceStr, m_topLines, m_bottomLines);
+#else
+	pipeline.Configure(NULL, "", m_topLines, m_bottomLines);
+#endif
+	if (m_homeCursor)
+		WinCursor::ClearScreen(" ");
+
+	lstring currBuffer;
+	lstring prevBuffer;
+	lstring filtered;
+	for (uint runCnt = 0; runCnt < m_maxRunCnt && client.Read(m_stop); runCnt++)
 	{
-		std::cerr << "Specify a command to execute\n";
+		if (m_homeCursor)
+			WinCursor::SetCursorPosition(0, 0);
+		if (m_verbose)
+			std::cerr << "---[Attach=" << m_attachName << " Execute=" << client.m_command << "]---\n";
+
+		currBuffer.assign(client.Frame());
+		if (m_highlightDelta)
+		{
+			pipeline.Run(currBuffer, prevBuffer);
+			prevBuffer.swap(currBuffer);
+		}
+		else
+		{
+			const char* data = currBuffer.c_str();
+			size_t len = currBuffer.length();
+			pipeline.Run(data, len, NULL, 0, filtered);
+		}
+		std::cout.flush();
+		if (m_verbose)
+			std::cerr << "\n---[Exit code=" << client.m_exitCode << " Tick=" << client.m_tick << "]---\n";
+	}
+	return 0;
+}
+
+// ======================================================================================
+int main(int argc, const char *argv[])
+{
+	if (argc == 1)
+	{
+		std::cerr << sUsage;
 		return -1;
 	}
 
 #ifdef HAVE_REGEX
-	const char opts[] = "b:dg:r:hn:t:v?";
+	const char opts[] = "b:c:dg:r:hn:t:v?";
 #else
-	const char opts[] = "b:dhn:t:v?";
+	const char opts[] = "b:c:dhn:t:v?";
 #endif
 
-	GetOpts<char> getOpts(argc, argv, opts);
+	static const GetOpts<char>::LongOpt longOpts[] =
+	{
+		{ "stats", false, 'S' },
+		{ "trace", true, 'T' },
+		{ "count", true, 'C' },
+		{ "stream", false, 'L' },
+		{ "mmap", false, 'M' },
+		{ "pty", false, 'P' },
+		{ "pty-size", true, 'Z' },
+		{ "threads", true, 'J' },
+		{ "daemon", true, 'D' },
+		{ "format", true, 'F' },
+		{ "output", true, 'O' },
+		{ "serve", true, 'E' },
+		{ "attach", true, 'A' },
+		{ "shm", true, 'H' },
+		{ "shm-size", true, 'K' },
+		{ "slow", true, 'W' },
+		{ "nice", true, 'N' },
+		{ "low-io", false, 'I' },
+		{ "affinity", true, 'X' },
+		{ "max-mem", true, 'Y' },
+		{ "max-cpu", true, 'U' },
+		{ "trigger", true, 'R' },
+		{ "max-fps", true, 'Q' },
+		{ "fit", false, 'V' },
+		{ "cumulative", true, 'G' },
+		{ "baseline", true, 'B' },
+		{ "save-baseline", true, 'a' },
+		{ "mask", true, 'm' },
+		{ "rates", true, 'e' },
+		{ "sort", true, 's' },
+		{ "top", true, 'k' },
+		{ "uniq", false, 'u' },
+		{ NULL, false, 0 }
+	};
+
+	std::vector<WatchCommand> commands;
+	GetOpts<char> getOpts(argc, argv, opts, longOpts);
 	char* endPtr;
 	while (getOpts.GetOpt())
 	{
@@ -235,6 +540,10 @@ int main(int argc, const char *argv[])
 			}
 			break;
 
+		case 'c':	// additional command, runs every -n seconds given before it
+			commands.push_back(WatchCommand(getOpts.OptArg(), m_seconds));
+			break;
+
 		case 'd':	// toggle delta highlight. 
 			m_highlightDelta = !m_highlightDelta;
 			break;
@@ -277,59 +586,857 @@ int main(int argc, const char *argv[])
 			m_verbose = !m_verbose;
 			break;
 
+		case 'S':	// --stats, per phase timing
+			m_showStats = true;
+			break;
+
+		case 'T':	// --trace <file>, per tick timing
+			m_traceFile = getOpts.OptArg();
+			break;
+
+		case 'C':	// --count <#runs>
+			m_maxRunCnt = strtoul(getOpts.OptArg(), &endPtr, 10);
+			if (endPtr == getOpts.OptArg())
+			{
+				std::cerr << "Invalid # runs:" << getOpts.OptArg() << std::endl;
+				return -1;
+			}
+			break;
+
+		case 'L':	// --stream, show lines as they arrive
+			m_stream = true;
+			break;
+
+		case 'M':	// --mmap, capture to memory mapped files
+			m_mmap = true;
+			break;
+
+		case 'P':	// --pty, capture through pseudo terminal
+			m_usePty = true;
+			break;
+
+		case 'Z':	// --pty-size <cols>x<rows>
+			m_ptyCols = strtoul(getOpts.OptArg(), &endPtr, 10);
+			if (*endPtr == 'x' || *endPtr == 'X')
+				m_ptyRows = strtoul(endPtr + 1, &endPtr, 10);
+			if (m_ptyCols == 0 || m_ptyRows == 0 || *endPtr != '\0')
+			{
+				std::cerr << "Invalid pty size, expect <cols>x<rows>:" << getOpts.OptArg() << std::endl;
+				return -1;
+			}
+			m_usePty = true;
+			break;
+
+		case 'J':	// --threads <#threads>
+			m_threads = strtol(getOpts.OptArg(), &endPtr, 10);
+			if (endPtr == getOpts.OptArg() || m_threads < 0)
+			{
+				std::cerr << "Invalid # threads:" << getOpts.OptArg() << std::endl;
+				return -1;
+			}
+			break;
+
+		case 'D':	// --daemon <config>
+			m_daemonConfig = getOpts.OptArg();
+			break;
+
+		case 'F':	// --format <text|jsonl|jsonl-hunks>
+			m_jsonl = strcmp(getOpts.OptArg(), "text") != 0;
+			m_jsonlHunks = strcmp(getOpts.OptArg(), "jsonl-hunks") == 0;
+			if (m_jsonl && !m_jsonlHunks && strcmp(getOpts.OptArg(), "jsonl") != 0)
+			{
+				std::cerr << "Invalid format:" << getOpts.OptArg() << std::endl;
+				return -1;
+			}
+			break;
+
+		case 'O':	// --output <file>
+			m_outputFile = getOpts.OptArg();
+			break;
+
+		case 'E':	// --serve <name>
+			m_serveName = getOpts.OptArg();
+			break;
+
+		case 'A':	// --attach <name>
+			m_attachName = getOpts.OptArg();
+			break;
+
+		case 'H':	// --shm <name>
+			m_shmName = getOpts.OptArg();
+			break;
+
+		case 'K':	// --shm-size <MB>
+			m_shmSlotBytes = (size_t)strtoul(getOpts.OptArg(), &endPtr, 10) << 20;
+			if (m_shmSlotBytes == 0)
+			{
+				std::cerr << "Invalid --shm-size:" << getOpts.OptArg() << std::endl;
+				return -1;
+			}
+			break;
+
+		case 'W':	// --slow <msec>
+			m_slowMs = strtod(getOpts.OptArg(), &endPtr);
+			if (endPtr == getOpts.OptArg() || *endPtr != '\0' || !(m_slowMs > 0))
+			{
+				std::cerr << "Invalid --slow:" << getOpts.OptArg() << std::endl;
+				return -1;
+			}
+			break;
+
+		case 'N':	// --nice <1..19>
+			m_limits.nice = (int)strtol(getOpts.OptArg(), &endPtr, 10);
+			if (m_limits.nice < 0 || m_limits.nice > 19 || *endPtr != '\0')
+			{
+				std::cerr << "Invalid --nice:" << getOpts.OptArg() << std::endl;
+				return -1;
+			}
+			break;
+
+		case 'I':	// --low-io
+			m_limits.lowIo = true;
+			break;
+
+		case 'X':	// --affinity <hexMask>
+			errno = 0;
+			m_limits.affinity = strtoull(getOpts.OptArg(), &endPtr, 16);
+			if (endPtr == getOpts.OptArg() || *endPtr != '\0' || errno == ERANGE || m_limits.affinity == 0)
+			{
+				std::cerr << "Invalid --affinity:" << getOpts.OptArg() << std::endl;
+				return -1;
+			}
+			break;
+
+		case 'Y':	// --max-mem <MB>
+			{
+				errno = 0;
+				unsigned long long mb = strtoull(getOpts.OptArg(), &endPtr, 10);
+				if (endPtr == getOpts.OptArg() || *endPtr != '\0' || errno == ERANGE || mb == 0 || mb > (UINT64_MAX >> 20))
+				{
+					std::cerr << "Invalid --max-mem:" << getOpts.OptArg() << std::endl;
+					return -1;
+				}
+				m_limits.memoryBytes = (uint64_t)mb << 20;
+			}
+			break;
+
+		case 'U':	// --max-cpu <seconds>
+			{
+				double ms = strtod(getOpts.OptArg(), &endPtr) * 1000;
+				if (endPtr == getOpts.OptArg() || *endPtr != '\0' || !(ms >= 1 && ms < 1e18))
+				{
+					std::cerr << "Invalid --max-cpu:" << getOpts.OptArg() << std::endl;
+					return -1;
+				}
+				m_limits.cpuMs = (uint64_t)ms;
+			}
+			break;
+
+		case 'R':	// --trigger <name>
+			m_triggerName = getOpts.OptArg();
+			break;
+
+		case 'Q':	// --max-fps <fps>
+			{
+				unsigned long fps = strtoul(getOpts.OptArg(), &endPtr, 10);
+				if (endPtr == getOpts.OptArg() || *endPtr != '\0' || fps == 0 || fps > 1000)
+				{
+					std::cerr << "Invalid --max-fps, expect 1..1000:" << getOpts.OptArg() << std::endl;
+					return -1;
+				}
+				m_maxFps = (unsigned)fps;
+			}
+			break;
+
+		case 'V':	// --fit
+			m_fit = true;
+			break;
+
+		case 'G':	// --cumulative <ticks>
+			{
+				unsigned long ticks = strtoul(getOpts.OptArg(), &endPtr, 10);
+				if (endPtr == getOpts.OptArg() || *endPtr != '\0' || ticks == 0 || ticks > HeatMap::MAX_FADE_TICKS)
+				{
+					std::cerr << "Invalid --cumulative, expect 1.." << HeatMap::MAX_FADE_TICKS << " ticks:" << getOpts.OptArg() << std::endl;
+					return -1;
+				}
+				m_fadeTicks = (unsigned)ticks;
+			}
+			break;
+
+		case 'B':	// --baseline <file>
+			m_baselineFile = getOpts.OptArg();
+			break;
+
+		case 'a':	// --save-baseline <file>
+			m_saveBaselineFile = getOpts.OptArg();
+			break;
+
+		case 'e':	// --rates <line|key>
+			m_ratesPairing = getOpts.OptArg();
+			if (strcmp(m_ratesPairing, "line") != 0 && strcmp(m_ratesPairing, "key") != 0)
+			{
+				std::cerr << "--rates expects line or key\n";
+				return -1;
+			}
+			break;
+
+		case 's':	// --sort <column>[n][r]
+			{
+				std::string error;
+				if (!m_aggregate.SetSort(getOpts.OptArg(), error))
+				{
+					std::cerr << error << std::endl;
+					return -1;
+				}
+			}
+			break;
+
+		case 'k':	// --top <k>
+			{
+				unsigned long topK = strtoul(getOpts.OptArg(), &endPtr, 10);
+				if (endPtr == getOpts.OptArg() || *endPtr != '\0' || topK == 0 || topK > UINT_MAX)
+				{
+					std::cerr << "Invalid --top:" << getOpts.OptArg() << std::endl;
+					return -1;
+				}
+				m_aggregate.SetTop((unsigned)topK);
+			}
+			break;
+
+		case 'u':	// --uniq
+			m_aggregate.SetUniq(true);
+			break;
+
+		case 'm':	// --mask <pattern>
+			{
+				std::string error;
+				if (!m_tokenMask.Add(getOpts.OptArg(), error))
+				{
+					std::cerr << error << std::endl;
+					return -1;
+				}
+			}
+			break;
+
 		default:
 		case '?':	// show help banner
 			std::cout << sUsage;
 			return 0;
 		}
 	}
+	if (getOpts.Error())
+	{
+		// Unknown option or bad option value, later options were not parsed.
+		const char* arg = argv[getOpts.NextIdx() - 1];
+		if (arg[0] == '-' && arg[1] == '-')
+			std::cerr << "Invalid option:" << arg << std::endl;
+		else
+			std::cerr << "Invalid option:-" << getOpts.Opt() << std::endl;
+		std::cerr << sUsage;
+		return -1;
+	}
+
+	if (m_aggregate.Top() != 0 && !m_aggregate.Sorted())
+	{
+		std::cerr << "--top needs --sort <column>\n";
+		return -1;
+	}
 
+	// Before any thread starts, they inherit priority and affinity.
+	std::string limitError;
+	if (!ChildProcess::LimitSelf(m_limits, limitError))
+		std::cerr << limitError << std::endl;
 
-	WinProcess winProcess;
-	HANDLE hParentStdOut = GetStdHandle(STD_OUTPUT_HANDLE);
-	HANDLE hNull = INVALID_HANDLE_VALUE;
+	if (m_daemonConfig)
+		return RunDaemon();
+	if (m_attachName)
+		return RunAttach();
+
+	lstring cmdLine = GetWatchCommand(argc, argv, !commands.empty());
+	if (cmdLine.length() != 0 && !commands.empty())
+		commands.push_back(WatchCommand(cmdLine, m_seconds));
+	if (commands.size() > 1)
+		return RunDashboard(commands);
+	if (commands.size() == 1)
+	{
+		cmdLine = commands[0].first;
+		m_seconds = commands[0].second;
+	}
+	if (cmdLine.length() == 0)
+	{
+		std::cerr << "Specify a command to execute\n";
+		return -1;
+	}
+
+	std::unique_ptr<ChildProcess> process(ChildProcess::Create());
+	process->SetLimits(m_limits);
+	if (m_usePty)
+	{
+		if (m_ptyCols == 0 && !WinCursor::GetConsoleSize(m_ptyCols, m_ptyRows))
+		{
+			m_ptyCols = 80;
+			m_ptyRows = 24;
+		}
+		process->SetPty(true, m_ptyCols, m_ptyRows);
+	}
 	lstring prevBuffer;
 	lstring currBuffer;
 
+	PhaseStats phaseStats;
+	if (m_showStats)
+	{
+		PhaseStats::sActive = &phaseStats;
+		SetCtrlHandler();
+	}
+
+	std::ofstream traceStream;
+	if (m_traceFile)
+	{
+		traceStream.open(m_traceFile);
+		if (!traceStream)
+		{
+			std::cerr << "Failed to create trace file:" << m_traceFile << std::endl;
+			return -1;
+		}
+		phaseStats.SetTrace(&traceStream);
+		PhaseStats::sActive = &phaseStats;
+	}
+
+	// One JSON object per run and/or frames published to viewers or shared memory in
+	// place of the console display.
+	JsonLines jsonLines;
+	FrameServer frameServer;
+	ShmRingWriter shmRing;
+	bool headless = m_jsonl || m_serveName != NULL || m_shmName != NULL;
+	if (m_jsonl)
+	{
+		if (!jsonLines.Open(m_outputFile))
+		{
+			std::cerr << "Failed to create output file:" << m_outputFile << std::endl;
+			return -1;
+		}
+		jsonLines.SetHunks(m_jsonlHunks);
+	}
+	if (m_serveName)
+	{
+		std::string error;
+		if (!frameServer.Listen(m_serveName, cmdLine, error))
+		{
+			std::cerr << error << std::endl;
+			return -1;
+		}
+		SetCtrlHandler();		// stop the loop so the socket is removed
+#ifndef _WIN32
+		signal(SIGTERM, CtrlHandler);
+#endif
+	}
+	if (m_shmName)
+	{
+		std::string error;
+		if (!shmRing.Create(m_shmName, ShmRing::DEFAULT_SLOTS, m_shmSlotBytes, error))
+		{
+			std::cerr << error << std::endl;
+			return -1;
+		}
+		SetCtrlHandler();		// stop the loop so the name is removed
+#ifndef _WIN32
+		signal(SIGTERM, CtrlHandler);
+#endif
+	}
+	if (headless)
+	{
+		if (m_stream || m_mmap || m_homeCursor)
+			std::cerr << "-h, --stream and --mmap ignored with --format jsonl, --serve or --shm\n";
+		m_stream = m_mmap = m_homeCursor = false;
+	}
+
+	// Kept lines compared with a known good snapshot (--baseline) in place of the
+	// previous run, captured and trimmed like headless ones.
+	Baseline baseline;
+	if (m_baselineFile != NULL && (headless
+		|| (m_saveBaselineFile != NULL && strcmp(m_baselineFile, m_saveBaselineFile) == 0)))
+	{
+		std::cerr << "--baseline ignored with --format jsonl, --serve, --shm or the same --save-baseline\n";
+		m_baselineFile = NULL;
+	}
+	if (m_baselineFile != NULL)
+	{
+		std::string error;
+		if (!baseline.Open(m_baselineFile, error))
+		{
+			std::cerr << error << std::endl;
+			return -1;
+		}
+		if (m_stream || m_mmap || m_maxFps != 0)
+			std::cerr << "--stream, --mmap and --max-fps ignored with --baseline\n";
+		m_stream = m_mmap = false;
+		m_maxFps = 0;
+		if (m_verbose)
+			std::cerr << "---[Baseline " << m_baselineFile << " lines=" << baseline.Lines()
+				<< (baseline.IndexLoaded() ? " index loaded" : " index built") << "]---\n";
+	}
+	if (m_saveBaselineFile != NULL && m_serveName != NULL && !m_jsonl && !m_shmName)
+	{
+		std::cerr << "--save-baseline ignored with --serve\n";
+		m_saveBaselineFile = NULL;
+	}
+
+	// Paints capped to --max-fps, runs are captured and trimmed like headless ones
+	// and the governor paints the latest.
+	std::unique_ptr<FrameGovernor> governor;
+	if (m_maxFps != 0 && !headless)
+	{
+		if (m_stream || m_mmap)
+			std::cerr << "--stream and --mmap ignored with --max-fps\n";
+		m_stream = m_mmap = false;
+		governor.reset(new FrameGovernor(m_maxFps, m_highlightDelta));
+		governor->SetHomeCursor(m_homeCursor);
+	}
+	bool capture = headless || governor || baseline.IsOpen();
+
+	// Kept lines and columns follow the console window (--fit), lines and columns past
+	// it are not filtered, compared or written.
+	unsigned fitRows = 0;
+	unsigned fitCols = 0;
+	if (m_fit && (headless || !FitViewport(fitRows, fitCols)))
+	{
+		std::cerr << "--fit ignored, output is not a console\n";
+		m_fit = false;
+	}
+	if (m_fit)
+		(m_bottomLines != 0 ? m_bottomLines : m_topLines) = fitRows;
+
+	// Changes colored by age (--cumulative), the heatmap keeps its stamps across runs.
+	std::unique_ptr<HeatMap> heatMap;
+	if (m_fadeTicks != 0)
+	{
+		if (!m_highlightDelta || capture)
+		{
+			std::cerr << "--cumulative ignored with -d, --max-fps, --baseline, --format jsonl, --serve or --shm\n";
+		}
+		else
+		{
+			if (m_stream)
+				std::cerr << "--stream ignored with --cumulative\n";
+			m_stream = false;
+			heatMap.reset(new HeatMap(m_fadeTicks));
+		}
+	}
+
+	// Frames compared with volatile tokens masked (--mask), written with their text.
+	const TokenMask* mask = NULL;
+	if (!m_tokenMask.Empty())
+	{
+		if (!m_highlightDelta || headless || baseline.IsOpen())
+		{
+			std::cerr << "--mask ignored with -d, --baseline, --format jsonl, --serve or --shm\n";
+		}
+		else
+		{
+			if (m_stream)
+				std::cerr << "--stream ignored with --mask\n";
+			m_stream = false;
+			mask = &m_tokenMask;
+		}
+	}
+
+	// Delta and rate column of numeric fields (--rates), added after the trim.
+	std::unique_ptr<FieldRates> rates;
+	if (m_ratesPairing != NULL)
+	{
+		if (capture)
+		{
+			std::cerr << "--rates ignored with --max-fps, --baseline, --format jsonl, --serve or --shm\n";
+		}
+		else
+		{
+			if (m_stream)
+				std::cerr << "--stream ignored with --rates\n";
+			m_stream = false;
+			rates.reset(new FieldRates(strcmp(m_ratesPairing, "key") == 0 ? FieldRates::BY_KEY : FieldRates::BY_LINE));
+		}
+	}
+
+	// Lines sorted, top-k selected and collapsed (--sort, --top, --uniq) before the trim.
+	LineAggregate* aggregate = NULL;
+	if (m_aggregate.Active())
+	{
+		if (capture)
+		{
+			std::cerr << "--sort and --uniq ignored with --max-fps, --baseline, --format jsonl, --serve or --shm\n";
+		}
+		else
+		{
+			if (m_stream)
+				std::cerr << "--stream ignored, --sort and --uniq need the entire output\n";
+			m_stream = false;
+			aggregate = &m_aggregate;
+		}
+	}
+
+	// Streaming diffs and writes lines from the read loop, see StreamFrame.
+	StreamFrame streamFrame;
+	if (m_stream && m_bottomLines != 0)
+	{
+		std::cerr << "--stream ignored, -b needs the entire output\n";
+		m_stream = false;
+	}
+	if (m_stream)
+	{
+		streamFrame.SetTopLines(m_topLines);
+		streamFrame.SetMaxCols(fitCols);
+		streamFrame.SetHighlight(m_highlightDelta);
+#ifdef HAVE_REGEX
+		if (m_isGrepLinePat)
+			streamFrame.SetGrep(&m_grepLinePat, m_replaceStr);
+#endif
+		process->SetDataSink([&streamFrame](const char* data, size_t len)
+			{ streamFrame.Append(data, len); });
+	}
+	else if (!m_highlightDelta && !capture && !m_fit && !m_saveBaselineFile && !rates && !aggregate)
+	{
+		// Output is only echoed, let the backend skip copying it.
+		process->SetPassthrough(true);
+	}
+
+	// Memory mapped capture, frames alternate between two files so the previous
+	// frame stays mapped while the command writes the current one.
+	if (m_mmap && (m_stream || !m_highlightDelta))
+	{
+		std::cerr << "--mmap ignored with --stream or -d\n";
+		m_mmap = false;
+	}
+	std::string captureFiles[2];
+	MappedFile mappedFrames[2];
+	lstring grepFrames[2];
+	const char* prevFrame = NULL;
+	size_t prevFrameLen = 0;
+	if (m_mmap)
+	{
+		captureFiles[0] = TempCaptureFile(0);
+		captureFiles[1] = TempCaptureFile(1);
+		SetCtrlHandler();		// stop the loop so the files are removed
+	}
+
+	// Caller of the parallel frame operations is one of the threads.
+	std::unique_ptr<ThreadPool> threadPool;
+	if (m_threads != 1)
+		threadPool.reset(new ThreadPool((m_threads == 0) ? 0 : m_threads - 1));
+	if (governor)
+	{
+		governor->SetPool(threadPool.get());
+		governor->SetMask(mask);
+	}
+
+	// Grep, trim and highlight stages picked once, fused into one pass unless parallel.
+	// Picked again when the window is resized with --fit.
+	FramePipeline pipeline;
+	auto configurePipeline = [&]()
+	{
+		pipeline.SetMaxCols(fitCols);
+		pipeline.SetHeatMap(heatMap.get());
+		pipeline.SetMask(mask);
+		pipeline.SetRates(rates.get());
+		pipeline.SetAggregate(aggregate);
+#ifdef HAVE_REGEX
+		pipeline.Configure(m_isGrepLinePat ? &m_grepLinePat : NULL, m_replaceStr, m_topLines, m_bottomLines, threadPool.get());
+#else
+		pipeline.Configure(NULL, "", m_topLines, m_bottomLines, threadPool.get());
+#endif
+	};
+	configurePipeline();
+
+	// Interval wait, a key, SIGUSR1 / named event or control pipe write runs now.
+	RunTrigger trigger;
+	{
+		std::string error;
+		if (!trigger.EnableExternal(m_triggerName, error))
+		{
+			std::cerr << error << std::endl;
+			return -1;
+		}
+		if (trigger.EnableKeys())
+		{
+			SetCtrlHandler();		// terminal mode is restored on the way out
+#ifndef _WIN32
+			signal(SIGTERM, CtrlHandler);
+#endif
+		}
+		if (m_fit)
+			trigger.EnableResize();
+	}
+
+	// Kept lines of the first run saved as a snapshot (--save-baseline).
+	bool baselineSaved = false;
+	auto saveBaseline = [&](const char* frame, size_t len)
+	{
+		if (m_saveBaselineFile == NULL || baselineSaved)
+			return;
+		baselineSaved = true;
+		std::string error;
+		if (!Baseline::Save(m_saveBaselineFile, frame, len, error))
+			std::cerr << error << std::endl;
+		else if (m_verbose)
+			std::cerr << "---[Saved baseline " << m_saveBaselineFile << "]---\n";
+	};
+
 	if (m_homeCursor)
 		WinCursor::ClearScreen(" ");
 
-	DWORD dwWritten;
+	// Resources of recent runs for the trailer, --slow runs and limit breaches are highlighted.
+	UsageTrend usageTrend;
+	unsigned slowRuns = 0;
+	unsigned limitRuns = 0;
+
 	uint runCnt = 0;
-	for (runCnt = 0; runCnt < m_maxRunCnt; runCnt++)
+	for (runCnt = 0; runCnt < m_maxRunCnt && !m_stop; runCnt++)
 	{
-		if (m_homeCursor)
+		phaseStats.BeginTick();
+		unsigned rows, cols;
+		if (m_fit && FitViewport(rows, cols) && (rows != fitRows || cols != fitCols))
+		{
+			// Resized, the next frame is written as is.
+			fitRows = rows;
+			fitCols = cols;
+			(m_bottomLines != 0 ? m_bottomLines : m_topLines) = fitRows;
+			configurePipeline();
+			streamFrame.SetTopLines(m_topLines);
+			streamFrame.SetMaxCols(fitCols);
+			prevBuffer.clear();
+			prevFrameLen = 0;
+			if (heatMap)
+				heatMap->Clear();
+			if (m_homeCursor)
+				WinCursor::ClearScreen(" ");
+		}
+		if (m_homeCursor && !governor)
 			WinCursor::SetCursorPosition(0, 0);
 
 		if (m_verbose)
 			std::cerr << "---[Execute=" << cmdLine << "]---\n";
-		winProcess.CreateChildProcess(cmdLine);
-		if (m_highlightDelta)
+		if (m_mmap)
+		{
+			mappedFrames[runCnt & 1].Close();
+			process->SetCaptureFile(captureFiles[runCnt & 1]);
+		}
+		int64_t startTimeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+		PhaseStats::Clock::time_point runStart = PhaseStats::Clock::now();
 		{
-			winProcess.ReadFromPipe(hNull, &currBuffer);
+			PhaseTimer timer(PhaseStats::SPAWN);
+			process->CreateChildProcess(cmdLine);
+		}
+		if (m_stream)
+		{
+			// Read time excludes the grep, diff and writes done by streamFrame.
+			streamFrame.Begin();
+			PhaseStats::Value nestedNs = phaseStats.Accumulated(PhaseStats::GREP)
+				+ phaseStats.Accumulated(PhaseStats::DIFF) + phaseStats.Accumulated(PhaseStats::WRITE);
+			PhaseStats::Clock::time_point readStart = PhaseStats::Clock::now();
+			process->ReadFromPipe(false);
+			nestedNs = phaseStats.Accumulated(PhaseStats::GREP) + phaseStats.Accumulated(PhaseStats::DIFF)
+				+ phaseStats.Accumulated(PhaseStats::WRITE) - nestedNs;
+			phaseStats.Add(PhaseStats::READ,
+				PhaseStats::Clock::now() - readStart - std::chrono::nanoseconds(nestedNs));
+
+			phaseStats.Add(PhaseStats::LINES_KEPT, streamFrame.Finish());
+			phaseStats.Add(PhaseStats::BYTES_IN, process->m_bytesRead);
+			phaseStats.Add(PhaseStats::BYTES_OUT, streamFrame.Frame().length());
+			saveBaseline(streamFrame.Frame().c_str(), streamFrame.Frame().length());
+		}
+		else if (m_mmap)
+		{
+			unsigned slot = runCnt & 1;
+			{
+				PhaseTimer timer(PhaseStats::READ);
+				process->ReadFromPipe(false);
+				mappedFrames[slot].Open(captureFiles[slot].c_str());
+			}
+			const char* currFrame = mappedFrames[slot].Data();
+			size_t currFrameLen = mappedFrames[slot].Size();
+			phaseStats.Add(PhaseStats::BYTES_IN, currFrameLen);
+			phaseStats.Add(PhaseStats::LINES_KEPT,
+				pipeline.Run(currFrame, currFrameLen, prevFrame, prevFrameLen, grepFrames[slot]));
+			phaseStats.Add(PhaseStats::BYTES_OUT, currFrameLen);
+			saveBaseline(currFrame, currFrameLen);
+			prevFrame = currFrame;
+			prevFrameLen = currFrameLen;
+		}
+		else if (capture)
+		{
+			{
+				PhaseTimer timer(PhaseStats::READ);
+				process->ReadFromPipe(false, &currBuffer);
+			}
+			phaseStats.Add(PhaseStats::BYTES_IN, currBuffer.length());
 #ifdef HAVE_REGEX
 			if (m_isGrepLinePat)
-				RegexTrim(currBuffer, m_grepLinePat, m_replaceStr);
+			{
+				PhaseTimer timer(PhaseStats::GREP);
+				RegexTrim(currBuffer, m_grepLinePat, m_replaceStr, threadPool.get());
+			}
 #endif
-			TrimTopBottom(currBuffer, m_topLines, m_bottomLines);
-
-			if (prevBuffer.empty())
-				 WriteFile(hParentStdOut, currBuffer.c_str(), (DWORD)currBuffer.length(), &dwWritten, NULL);
-			else
+		}
+		else if (m_highlightDelta || m_fit || m_saveBaselineFile || rates || aggregate)
+		{
 			{
-				// showDiffLcs(currBuffer, prevBuffer);
-				showDiffFast(currBuffer, prevBuffer);
+				PhaseTimer timer(PhaseStats::READ);
+				process->ReadFromPipe(false, &currBuffer);
 			}
-			prevBuffer.swap(currBuffer);
+			phaseStats.Add(PhaseStats::BYTES_IN, currBuffer.length());
+			// showDiffLcs(currBuffer, prevBuffer);
+			phaseStats.Add(PhaseStats::LINES_KEPT, pipeline.Run(currBuffer, prevBuffer));
+			phaseStats.Add(PhaseStats::BYTES_OUT, currBuffer.length());
+			saveBaseline(currBuffer.c_str(), currBuffer.length());
+			if (m_highlightDelta)
+				prevBuffer.swap(currBuffer);		// else prev stays empty, frames written as is
 		}
 		else
 		{
-			winProcess.ReadFromPipe(hParentStdOut);
+			PhaseTimer timer(PhaseStats::READ);
+			process->ReadFromPipe(true);
+			if (process->m_firstByteMs >= 0)	// echoed as soon as read
+				phaseStats.Add(PhaseStats::FIRST_OUT, std::chrono::duration_cast<PhaseStats::Clock::duration>(
+					std::chrono::duration<double, std::milli>(process->m_firstByteMs)));
+			phaseStats.Add(PhaseStats::BYTES_IN, process->m_bytesRead);
+			phaseStats.Add(PhaseStats::BYTES_OUT, process->m_bytesRead);
 		}
-		winProcess.CloseProcess();
-		if (m_verbose)
-			std::cerr << "\n---[Exit code=" << winProcess.m_exitCode << " RunCnt=" << runCnt << "]---\n";
-		Sleep(m_seconds * 1000);
+		process->CloseProcess();
+		if (m_jsonl || m_shmName)
+		{
+			// Written once the exit code is known.
+			const char* frame = currBuffer.c_str();
+			size_t frameLen = currBuffer.length();
+			{
+				PhaseTimer timer(PhaseStats::TRIM);
+				phaseStats.Add(PhaseStats::LINES_KEPT, TrimTopBottom(frame, frameLen, m_topLines, m_bottomLines));
+				if (m_bottomLines != 0 && frameLen != 0 && *frame == '\n')
+				{
+					frame++;		// bottom lines start at the newline before them
+					frameLen--;
+				}
+			}
+			saveBaseline(frame, frameLen);
+			double runMs = std::chrono::duration<double, std::milli>(PhaseStats::Clock::now() - runStart).count();
+			PhaseTimer timer(PhaseStats::WRITE);
+			if (m_jsonl)
+				jsonLines.Write(runCnt + 1, startTimeMs, runMs, process->m_exitCode, frame, frameLen);
+			if (m_shmName)
+				shmRing.Publish(runCnt + 1, process->m_exitCode, frame, frameLen);
+			phaseStats.Add(PhaseStats::BYTES_OUT, frameLen);
+		}
+		if (governor || baseline.IsOpen())
+		{
+			{
+				PhaseTimer timer(PhaseStats::TRIM);
+				phaseStats.Add(PhaseStats::LINES_KEPT, TrimTopBottom(currBuffer, m_topLines, m_bottomLines));
+				if (m_bottomLines != 0 && !currBuffer.empty() && currBuffer[0] == '\n')
+					currBuffer.erase(0, 1);		// bottom lines start at the newline before them
+				if (m_fit)
+					ClipColumns(currBuffer, fitCols);
+			}
+			saveBaseline(currBuffer.c_str(), currBuffer.length());
+			phaseStats.Add(PhaseStats::BYTES_OUT, currBuffer.length());
+		}
+		if (governor)
+		{
+			PhaseTimer timer(PhaseStats::WRITE);
+			governor->Submit(currBuffer, PhaseStats::Clock::now());
+		}
+		if (baseline.IsOpen())
+		{
+			Baseline::Deviation deviation;
+			{
+				phaseStats.MarkFirstOut();
+				PhaseTimer timer(PhaseStats::DIFF, PhaseStats::WRITE);
+				deviation = baseline.Show(currBuffer.c_str(), currBuffer.length());
+			}
+			if (m_verbose)
+				std::cerr << "\n---[Baseline changed=" << deviation.changed << " added=" << deviation.added
+					<< " missing=" << deviation.missing << " of " << deviation.lines << " lines]---";
+		}
+		if (m_serveName)
+		{
+			// Viewers trim their own copy.
+			PhaseTimer timer(PhaseStats::WRITE);
+			frameServer.Publish(runCnt + 1, process->m_exitCode, currBuffer.c_str(), currBuffer.length());
+			if (m_verbose)
+				std::cerr << "---[Published to " << frameServer.Clients() << " viewers]---\n";
+		}
+		phaseStats.EndTick();
+		usageTrend.Add(process->m_usage);
+		bool slow = m_slowMs > 0 && process->m_usage.valid && process->m_usage.wallMs > m_slowMs;
+		bool breached = process->m_usage.breached != 0;
+		if (slow)
+			slowRuns++;
+		if (breached)
+			limitRuns++;
+		if (slow || breached)
+			Colorize::write(std::cerr, SLOW_COLOR);
+		if (m_verbose || slow || breached)
+		{
+			std::cerr << "\n---[Exit code=" << process->m_exitCode << " RunCnt=" << runCnt << " ";
+			UsageTrend::Show(std::cerr, process->m_usage);
+			std::cerr << (slow ? " SLOW" : "") << "]---\n";
+		}
+		if (slow || breached)
+			Colorize::write(std::cerr, MATCH_COLOR);
+		if (m_verbose && usageTrend.Count() > 1)
+		{
+			std::cerr << "---[";
+			usageTrend.Show(std::cerr);
+			if (m_slowMs > 0)
+				std::cerr << " slow=" << slowRuns;
+			if (m_limits.Caps())
+				std::cerr << " limited=" << limitRuns;
+			std::cerr << "]---\n";
+		}
+		if (m_showStats)
+			phaseStats.ShowStatus(std::cerr);
+
+		// Blocked in the kernel until the interval ends or a trigger, viewers are
+		// serviced every 100 msec.
+		PhaseStats::Clock::time_point runAt = PhaseStats::Clock::now() + std::chrono::seconds(m_seconds);
+		while (!m_stop && PhaseStats::Clock::now() < runAt && runCnt + 1 < m_maxRunCnt)
+		{
+			unsigned msec = (unsigned)std::chrono::duration_cast<std::chrono::milliseconds>(
+				runAt - PhaseStats::Clock::now()).count();
+			if (m_serveName)
+				msec = (std::min)(100u, msec);
+			if (governor && governor->Pending())
+				msec = (std::min)(governor->MsecToPaint(), msec);
+			RunTrigger::Reason reason = trigger.Wait(msec);
+			if (m_serveName)
+				frameServer.Service();
+			if (governor)
+				governor->Service();
+			if (reason == RunTrigger::STOP)
+				m_stop = true;
+			else if (reason != RunTrigger::TIMEOUT)
+			{
+				if (m_verbose)
+					std::cerr << "---[Run now, " << RunTrigger::Name(reason) << "]---\n";
+				break;
+			}
+		}
+	}
+
+	if (governor)
+	{
+		governor->Flush();
+		if (m_verbose || m_showStats)
+			governor->Dump(std::cerr);
+	}
+	if (m_showStats)
+		phaseStats.Dump(std::cerr);
+	if (m_serveName)
+		frameServer.Drain(1000);
+
+	for (unsigned idx = 0; idx != 2 && m_mmap; idx++)
+	{
+		mappedFrames[idx].Close();
+		remove(captureFiles[idx].c_str());
 	}
 
 	return 0;
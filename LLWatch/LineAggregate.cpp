@@ -0,0 +1,276 @@
+// ------------------------------------------------------------------------------------------------
+// LineAggregate.cpp - Sort, top-k and uniq of frame lines
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+#include "LineAggregate.h"
+#include "FrameOps.h"
+
+#include <algorithm>
+#include <charconv>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Number at the start of field, digit group commas skipped, a unit after it ignored.
+static bool ParseGrouped(const char* field, size_t len, double& value)
+{
+	char buf[64];
+	size_t used = 0;
+	for (size_t idx = 0; idx != len && used != sizeof(buf); idx++)
+	{
+		char c = field[idx];
+		if (c == ',' && idx != 0 && idx + 1 != len && isdigit((unsigned char)field[idx + 1]))
+			continue;
+		if (!isdigit((unsigned char)c) && c != '.' && c != '-' && c != '+' && c != 'e' && c != 'E')
+			break;
+		buf[used++] = c;
+	}
+	const char* first = (used != 0 && buf[0] == '+') ? buf + 1 : buf;
+	const char* digits = (first != buf + used && *first == '-') ? first + 1 : first;
+	if (digits == buf + used || !isdigit((unsigned char)*digits))
+		return false;
+	return std::from_chars(first, buf + used, value).ec == std::errc();
+}
+
+// ======================================================================================
+LineAggregate::LineAggregate() :
+	m_column(-1),
+	m_numeric(false),
+	m_reverse(false),
+	m_topK(0),
+	m_uniq(false),
+	m_cur(0)
+{ }
+
+// ======================================================================================
+bool LineAggregate::SetSort(const char* spec, std::string& error)
+{
+	char* endPtr;
+	long column = strtol(spec, &endPtr, 10);
+	bool ok = endPtr != spec && column >= 0 && column < 1000;
+	m_numeric = column == 0;
+	m_reverse = false;
+	for (; ok && *endPtr != '\0'; endPtr++)
+	{
+		if (*endPtr == 'n')
+			m_numeric = true;
+		else if (*endPtr == 'r')
+			m_reverse = true;
+		else
+			ok = false;
+	}
+	if (!ok)
+	{
+		error = std::string("bad sort column ") + spec + ", expected <column>[n][r] ex: 5nr";
+		return false;
+	}
+	m_column = (int)column;
+	return true;
+}
+
+// ======================================================================================
+// Sort key of an entry, field is left NULL if the line has no such column.
+void LineAggregate::SetColumn(Entry& entry) const
+{
+	if (m_column == 0)
+	{
+		entry.field = entry.line;
+		entry.number = entry.count;
+		return;
+	}
+
+	const char* ptr = entry.line;
+	const char* end = entry.line + entry.len;
+	for (int column = 1; ; column++)
+	{
+		while (ptr != end && isspace((unsigned char)*ptr))
+			ptr++;
+		if (ptr == end)
+			return;
+		const char* field = ptr;
+		while (ptr != end && !isspace((unsigned char)*ptr))
+			ptr++;
+		if (column == m_column)
+		{
+			if (!m_numeric || ParseGrouped(field, ptr - field, entry.number))
+			{
+				entry.field = field;
+				entry.fieldLen = ptr - field;
+			}
+			return;
+		}
+	}
+}
+
+// ======================================================================================
+// Lines without the column first, then by column, ties by input order.
+bool LineAggregate::Before(const Entry& a, const Entry& b) const
+{
+	if ((a.field == NULL) != (b.field == NULL))
+		return a.field == NULL;
+	if (a.field != NULL)
+	{
+		int cmp;
+		if (m_numeric)
+		{
+			cmp = (a.number < b.number) ? -1 : ((a.number > b.number) ? 1 : 0);
+		}
+		else
+		{
+			cmp = memcmp(a.field, b.field, (std::min)(a.fieldLen, b.fieldLen));
+			if (cmp == 0 && a.fieldLen != b.fieldLen)
+				cmp = (a.fieldLen < b.fieldLen) ? -1 : 1;
+		}
+		if (cmp != 0)
+			return m_reverse ? cmp > 0 : cmp < 0;
+	}
+	return a.order < b.order;
+}
+
+// ======================================================================================
+// Duplicates counted on the first line, their count set to 0.
+void LineAggregate::Collapse()
+{
+	size_t size = 16;
+	while (size < m_entries.size() * 2)
+		size *= 2;
+	m_byLine.assign(size, 0);
+	for (uint32_t idx = 0; idx != m_entries.size(); idx++)
+	{
+		Entry& entry = m_entries[idx];
+		entry.hash = HashBytes(entry.line, entry.len);
+		size_t slot = (size_t)entry.hash & (size - 1);
+		for (; m_byLine[slot] != 0; slot = (slot + 1) & (size - 1))
+		{
+			const Entry& first = m_entries[m_byLine[slot] - 1];
+			if (first.hash == entry.hash && first.len == entry.len && memcmp(first.line, entry.line, entry.len) == 0)
+				break;
+		}
+		if (m_byLine[slot] == 0)
+		{
+			m_byLine[slot] = idx + 1;
+		}
+		else
+		{
+			m_entries[m_byLine[slot] - 1].count++;
+			entry.count = 0;
+		}
+	}
+}
+
+// ======================================================================================
+size_t LineAggregate::Apply(const char*& data, size_t& len)
+{
+	m_entries.clear();
+	const char* end = data + len;
+	for (const char* line = data; line != end; )
+	{
+		const char* eol = (const char*)memchr(line, '\n', end - line);
+		if (eol == NULL)
+			eol = end;
+		Entry entry;
+		entry.line = line;
+		entry.len = eol - line;
+		entry.field = NULL;
+		entry.fieldLen = 0;
+		entry.number = 0;
+		entry.hash = 0;
+		entry.count = 1;
+		entry.order = (uint32_t)m_entries.size();
+		m_entries.push_back(entry);
+		line = (eol == end) ? end : eol + 1;
+	}
+	if (m_uniq)
+		Collapse();
+
+	m_result.clear();
+	for (uint32_t idx = 0; idx != m_entries.size(); idx++)
+	{
+		if (m_entries[idx].count == 0)
+			continue;
+		if (m_column >= 0)
+			SetColumn(m_entries[idx]);
+		m_result.push_back(idx);
+	}
+
+	auto before = [this](uint32_t a, uint32_t b) { return Before(m_entries[a], m_entries[b]); };
+	if (m_column >= 0 && m_topK != 0)
+	{
+		// Lines without the column stay in place, the best k others are kept in a heap
+		// with the worst of them on top.
+		size_t kept = 0;
+		m_heap.clear();
+		for (size_t pos = 0; pos != m_result.size(); pos++)
+		{
+			uint32_t idx = m_result[pos];
+			if (m_entries[idx].field == NULL)
+			{
+				m_result[kept++] = idx;
+			}
+			else if (m_heap.size() < m_topK)
+			{
+				m_heap.push_back(idx);
+				std::push_heap(m_heap.begin(), m_heap.end(), before);
+			}
+			else if (before(idx, m_heap.front()))
+			{
+				std::pop_heap(m_heap.begin(), m_heap.end(), before);
+				m_heap.back() = idx;
+				std::push_heap(m_heap.begin(), m_heap.end(), before);
+			}
+		}
+		std::sort_heap(m_heap.begin(), m_heap.end(), before);
+		m_result.resize(kept);
+		m_result.insert(m_result.end(), m_heap.begin(), m_heap.end());
+	}
+	else if (m_column >= 0)
+	{
+		std::sort(m_result.begin(), m_result.end(), before);
+	}
+
+	m_cur ^= 1;
+	lstring& out = m_frames[m_cur];
+	out.clear();
+	char count[16];
+	for (size_t pos = 0; pos != m_result.size(); pos++)
+	{
+		const Entry& entry = m_entries[m_result[pos]];
+		if (m_uniq)
+		{
+			snprintf(count, sizeof(count), "%7u ", entry.count);
+			out += count;
+		}
+		out.append(entry.line, entry.len);
+		out += '\n';
+	}
+	data = out.c_str();
+	len = out.length();
+	return m_result.size();
+}
@@ -0,0 +1,108 @@
+// ------------------------------------------------------------------------------------------------
+// LineAggregate.h - Sort, top-k and uniq of frame lines
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "llstring.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// ======================================================================================
+// In process sort, top-k and uniq of the lines of a frame (llwatch --sort, --top,
+// --uniq), in place of piping the command through sort / uniq each run. It runs on
+// an index of the lines, no line is copied until the result is written once.
+//
+// Duplicate lines are collapsed first (--uniq, counted like uniq -c, first one keeps
+// its place). The sort column is a blank separated field, compared as a number (n,
+// digit group commas and a unit are ignored: 12,345 K) or as text. --top selects the
+// first k lines of the sort order with a heap of k lines, O(n log k), without sorting
+// the frame. Lines without the column (or not a number with n), like headers, stay on
+// top in their order and are not counted in k. Equal lines keep their order.
+class LineAggregate
+{
+public:
+	LineAggregate();
+
+	// Sort spec <column>[n][r], column 1.. (0 is the --uniq count), n compares numbers,
+	// r sorts descending. False with error set if it is bad.
+	bool SetSort(const char* spec, std::string& error);
+
+	// Keep the first topK lines of the sort order, 0 keeps all.
+	void SetTop(unsigned topK)
+	{ m_topK = topK; }
+
+	unsigned Top() const
+	{ return m_topK; }
+
+	// Collapse duplicate lines into one prefixed with its count.
+	void SetUniq(bool uniq)
+	{ m_uniq = uniq; }
+
+	bool Sorted() const
+	{ return m_column >= 0; }
+
+	bool Active() const
+	{ return m_column >= 0 || m_uniq; }
+
+	// Aggregate frame [data, data+len), data and len are set to the result which stays
+	// valid until the second next Apply. Return the lines of the result.
+	size_t Apply(const char*& data, size_t& len);
+
+private:
+	struct Entry
+	{
+		const char* line;
+		size_t   len;			// without newline
+		const char* field;		// sort column, NULL if missing
+		size_t   fieldLen;
+		double   number;
+		uint64_t hash;			// --uniq
+		uint32_t count;			// --uniq duplicates
+		uint32_t order;			// input position, ties keep it
+	};
+
+	bool Before(const Entry& a, const Entry& b) const;
+	void SetColumn(Entry& entry) const;
+	void Collapse();
+
+	int      m_column;			// -1 not sorted
+	bool     m_numeric;
+	bool     m_reverse;
+	unsigned m_topK;
+	bool     m_uniq;
+	std::vector<Entry> m_entries;
+	std::vector<uint32_t> m_byLine;		// --uniq open addressing by hash, entry + 1
+	std::vector<uint32_t> m_result;		// entries in output order
+	std::vector<uint32_t> m_heap;		// --top candidates, worst on top
+	lstring  m_frames[2];				// results, alternate
+	unsigned m_cur;
+};
@@ -0,0 +1,129 @@
+// ------------------------------------------------------------------------------------------------
+// MappedFile.cpp - Read only memory mapped file
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char s_empty[] = "";
+
+// ======================================================================================
+MappedFile::MappedFile() :
+#ifdef _WIN32
+	m_file(INVALID_HANDLE_VALUE),
+	m_mapping(NULL),
+#else
+	m_fd(-1),
+#endif
+	m_data(s_empty),
+	m_size(0)
+{ }
+
+// ======================================================================================
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+// ======================================================================================
+bool MappedFile::Open(const char* path)
+{
+	Close();
+#ifdef _WIN32
+	m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_file, &fileSize))
+		return false;
+	if (fileSize.QuadPart == 0)
+		return true;
+
+	m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_mapping == NULL)
+		return false;
+	const char* data = (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == NULL)
+		return false;
+	m_data = data;
+	m_size = (size_t)fileSize.QuadPart;
+#else
+	m_fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (m_fd < 0)
+		return false;
+
+	struct stat fileStat;
+	if (fstat(m_fd, &fileStat) != 0)
+		return false;
+	if (fileStat.st_size == 0)
+		return true;
+
+	void* data = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_SHARED, m_fd, 0);
+	if (data == MAP_FAILED)
+		return false;
+	m_data = (const char*)data;
+	m_size = (size_t)fileStat.st_size;
+
+	// Frame is scanned front to back (trim, grep, diff).
+	madvise(data, m_size, MADV_SEQUENTIAL);
+#endif
+	return true;
+}
+
+// ======================================================================================
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (m_size != 0)
+		UnmapViewOfFile(m_data);
+	if (m_mapping != NULL)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = NULL;
+#else
+	if (m_size != 0)
+		munmap((void*)m_data, m_size);
+	if (m_fd >= 0)
+		close(m_fd);
+	m_fd = -1;
+#endif
+	m_data = s_empty;
+	m_size = 0;
+}
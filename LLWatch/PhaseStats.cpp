@@ -0,0 +1,228 @@
+// ------------------------------------------------------------------------------------------------
+// PhaseStats.cpp - Per-phase latency statistics of the watch loop
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "PhaseStats.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+PhaseStats* PhaseStats::sActive = NULL;
+
+static const char* s_phaseNames[PhaseStats::PHASE_CNT] =
+	{ "spawn", "read", "grep", "trim", "diff", "write", "firstOut", "tick" };
+static const char* s_countNames[PhaseStats::COUNT_CNT] =
+	{ "bytesIn", "linesKept", "bytesOut" };
+
+// ======================================================================================
+PhaseStats::PhaseStats() : m_ticks(0), m_trace(NULL)
+{
+	BeginTick();
+}
+
+// ======================================================================================
+const char* PhaseStats::Name(Phase phase)
+{
+	return s_phaseNames[phase];
+}
+
+// ======================================================================================
+const char* PhaseStats::Name(Count count)
+{
+	return s_countNames[count];
+}
+
+// ======================================================================================
+void PhaseStats::BeginTick()
+{
+	for (unsigned idx = 0; idx != PHASE_CNT; idx++)
+	{
+		m_phaseNs[idx] = 0;
+		m_phaseHit[idx] = false;
+	}
+	for (unsigned idx = 0; idx != COUNT_CNT; idx++)
+		m_counts[idx] = 0;
+
+	m_tickStart = Clock::now();
+}
+
+// ======================================================================================
+// Move this tick's accumulated values into the rolling windows.
+// Phases which did not run this tick (ex: grep without -g) are not sampled.
+void PhaseStats::EndTick()
+{
+	Add(TICK, Clock::now() - m_tickStart);
+
+	for (unsigned idx = 0; idx != PHASE_CNT; idx++)
+	{
+		if (m_phaseHit[idx])
+			m_phases[idx].Add(m_phaseNs[idx]);
+	}
+	for (unsigned idx = 0; idx != COUNT_CNT; idx++)
+		m_countWin[idx].Add(m_counts[idx]);
+
+	if (m_trace)
+		WriteTrace();
+	m_ticks++;
+}
+
+// ======================================================================================
+// Cpu time (user + kernel) and peak memory of this process.
+static void GetSelfUsage(double& cpuMs, unsigned long long& peakKB)
+{
+#ifdef _WIN32
+	FILETIME createTime, exitTime, kernelTime, userTime;
+	GetProcessTimes(GetCurrentProcess(), &createTime, &exitTime, &kernelTime, &userTime);
+	ULONGLONG kernel100ns = ((ULONGLONG)kernelTime.dwHighDateTime << 32) | kernelTime.dwLowDateTime;
+	ULONGLONG user100ns = ((ULONGLONG)userTime.dwHighDateTime << 32) | userTime.dwLowDateTime;
+	cpuMs = (kernel100ns + user100ns) / 1e4;
+
+	PROCESS_MEMORY_COUNTERS memCounters;
+	memCounters.cb = sizeof(memCounters);
+	GetProcessMemoryInfo(GetCurrentProcess(), &memCounters, sizeof(memCounters));
+	peakKB = memCounters.PeakWorkingSetSize / 1024;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	cpuMs = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e3
+		+ (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e3;
+	peakKB = (unsigned long long)usage.ru_maxrss;
+#endif
+}
+
+// ======================================================================================
+// {"tick":0,"spawnNs":..,...,"tickNs":..,"bytesIn":..,"linesKept":..,"bytesOut":..,"cpuMs":..,"peakRssKB":..}
+void PhaseStats::WriteTrace()
+{
+	char buf[64];
+	*m_trace << "{\"tick\":" << m_ticks;
+	for (unsigned idx = 0; idx != PHASE_CNT; idx++)
+		*m_trace << ",\"" << s_phaseNames[idx] << "Ns\":" << m_phaseNs[idx];
+	for (unsigned idx = 0; idx != COUNT_CNT; idx++)
+		*m_trace << ",\"" << s_countNames[idx] << "\":" << m_counts[idx];
+
+	double cpuMs;
+	unsigned long long peakKB;
+	GetSelfUsage(cpuMs, peakKB);
+	snprintf(buf, sizeof(buf), ",\"cpuMs\":%.3f,\"peakRssKB\":%llu}\n", cpuMs, peakKB);
+	*m_trace << buf << std::flush;
+}
+
+// ======================================================================================
+void PhaseStats::Window::Add(Value value)
+{
+	m_values[m_next] = value;
+	m_next = (m_next + 1) % sWindow;
+	if (m_cnt < sWindow)
+		m_cnt++;
+}
+
+// ======================================================================================
+PhaseStats::Window::Summary PhaseStats::Window::Summarize() const
+{
+	Summary summary = { 0, 0, 0, 0 };
+	if (m_cnt == 0)
+		return summary;
+
+	Value sorted[sWindow];
+	Value total = 0;
+	std::copy(m_values, m_values + m_cnt, sorted);
+	for (unsigned idx = 0; idx != m_cnt; idx++)
+		total += sorted[idx];
+
+	summary.min = *std::min_element(sorted, sorted + m_cnt);
+	summary.avg = total / m_cnt;
+
+	unsigned p50 = m_cnt / 2;
+	std::nth_element(sorted, sorted + p50, sorted + m_cnt);
+	summary.p50 = sorted[p50];
+
+	unsigned p99 = std::min(m_cnt - 1, (m_cnt * 99) / 100);
+	std::nth_element(sorted, sorted + p99, sorted + m_cnt);
+	summary.p99 = sorted[p99];
+	return summary;
+}
+
+// ======================================================================================
+void PhaseStats::ShowStatus(std::ostream& out) const
+{
+	char buf[128];
+	out << "---[Stats(ms min/avg/p50/p99)";
+	for (unsigned idx = 0; idx != PHASE_CNT; idx++)
+	{
+		if (m_phases[idx].m_cnt == 0)
+			continue;
+		Window::Summary ms = m_phases[idx].Summarize();
+		snprintf(buf, sizeof(buf), " %s=%.2f/%.2f/%.2f/%.2f", s_phaseNames[idx],
+			ms.min / 1e6, ms.avg / 1e6, ms.p50 / 1e6, ms.p99 / 1e6);
+		out << buf;
+	}
+
+	// Counters of the most recent tick.
+	for (unsigned idx = 0; idx != COUNT_CNT; idx++)
+		out << " " << s_countNames[idx] << "=" << m_counts[idx];
+	out << "]---\n";
+}
+
+// ======================================================================================
+void PhaseStats::Dump(std::ostream& out) const
+{
+	char buf[128];
+	out << "\n---[Stats Ticks=" << m_ticks << " Window=" << std::min(m_ticks, (unsigned)sWindow) << "]---\n";
+	snprintf(buf, sizeof(buf), "%-10s %12s %12s %12s %12s\n", "phase(ms)", "min", "avg", "p50", "p99");
+	out << buf;
+	for (unsigned idx = 0; idx != PHASE_CNT; idx++)
+	{
+		if (m_phases[idx].m_cnt == 0)
+			continue;
+		Window::Summary ms = m_phases[idx].Summarize();
+		snprintf(buf, sizeof(buf), "%-10s %12.3f %12.3f %12.3f %12.3f\n", s_phaseNames[idx],
+			ms.min / 1e6, ms.avg / 1e6, ms.p50 / 1e6, ms.p99 / 1e6);
+		out << buf;
+	}
+
+	snprintf(buf, sizeof(buf), "%-10s %12s %12s %12s %12s\n", "per tick", "min", "avg", "p50", "p99");
+	out << buf;
+	for (unsigned idx = 0; idx != COUNT_CNT; idx++)
+	{
+		Window::Summary cnt = m_countWin[idx].Summarize();
+		snprintf(buf, sizeof(buf), "%-10s %12llu %12llu %12llu %12llu\n", s_countNames[idx],
+			cnt.min, cnt.avg, cnt.p50, cnt.p99);
+		out << buf;
+	}
+}
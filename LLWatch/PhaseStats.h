@@ -0,0 +1,161 @@
+// ------------------------------------------------------------------------------------------------
+// PhaseStats.h - Per-phase latency statistics of the watch loop
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <chrono>
+#include <iostream>
+
+// ======================================================================================
+// Collect elapsed time of each phase of a watch tick (spawn, read, grep, ...) plus
+// a few per-tick counters. Each value is kept in a fixed rolling window so
+// min/avg/p50/p99 reflect the most recent ticks.
+//
+// Instrumentation is only active while PhaseStats::sActive is set, otherwise
+// PhaseTimer reduces to a single pointer test.
+class PhaseStats
+{
+public:
+	enum Phase { SPAWN, READ, GREP, TRIM, DIFF, WRITE, FIRST_OUT, TICK, PHASE_CNT };
+	enum Count { BYTES_IN, LINES_KEPT, BYTES_OUT, COUNT_CNT };
+
+	typedef std::chrono::steady_clock Clock;		// monotonic
+	typedef unsigned long long Value;
+
+	static const unsigned sWindow = 256;		// samples kept per value
+
+	PhaseStats();
+
+	void BeginTick();
+	void EndTick();
+
+	void Add(Phase phase, Clock::duration elapsed)
+	{
+		m_phaseNs[phase] += (Value)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+		m_phaseHit[phase] = true;
+	}
+
+	void Add(Count count, size_t value)
+	{ m_counts[count] += value; }
+
+	// Time from start of tick to first output written (FIRST_OUT), only the first call counts.
+	void MarkFirstOut()
+	{
+		if (!m_phaseHit[FIRST_OUT])
+			Add(FIRST_OUT, Clock::now() - m_tickStart);
+	}
+
+	// Nanoseconds accumulated by phase during current tick.
+	Value Accumulated(Phase phase) const
+	{ return m_phaseNs[phase]; }
+
+	unsigned Ticks() const
+	{ return m_ticks; }
+
+	// Single status line, values in milliseconds as min/avg/p50/p99.
+	void ShowStatus(std::ostream& out) const;
+
+	// Multi-line summary table.
+	void Dump(std::ostream& out) const;
+
+	// Write one JSON line per tick (phase ns, counters, own cpu and peak memory), NULL to disable.
+	void SetTrace(std::ostream* trace)
+	{ m_trace = trace; }
+
+	static const char* Name(Phase phase);
+	static const char* Name(Count count);
+
+	// Stats receiving PhaseTimer samples, NULL when disabled.
+	static PhaseStats* sActive;
+
+private:
+	struct Window
+	{
+		Window() : m_cnt(0), m_next(0) { }
+		void Add(Value value);
+
+		// Summary of current window contents.
+		struct Summary { Value min, avg, p50, p99; };
+		Summary Summarize() const;
+
+		Value    m_values[sWindow];
+		unsigned m_cnt;
+		unsigned m_next;
+	};
+
+	void WriteTrace();
+
+	Clock::time_point m_tickStart;
+	unsigned m_ticks;
+	std::ostream* m_trace;
+
+	Value m_phaseNs[PHASE_CNT];
+	bool  m_phaseHit[PHASE_CNT];
+	Value m_counts[COUNT_CNT];
+
+	Window m_phases[PHASE_CNT];
+	Window m_countWin[COUNT_CNT];
+};
+
+// ======================================================================================
+// Scoped timer, adds elapsed time to a phase of the active stats.
+// Optional 'exclude' phase time accumulated while in scope is subtracted,
+// ex: diff time without the nested console writes.
+class PhaseTimer
+{
+public:
+	PhaseTimer(PhaseStats::Phase phase, PhaseStats::Phase exclude = PhaseStats::PHASE_CNT) :
+		m_phase(phase), m_exclude(exclude), m_excludeNs(0)
+	{
+		if (PhaseStats::sActive)
+		{
+			if (m_exclude != PhaseStats::PHASE_CNT)
+				m_excludeNs = PhaseStats::sActive->Accumulated(m_exclude);
+			m_start = PhaseStats::Clock::now();
+		}
+	}
+
+	~PhaseTimer()
+	{
+		if (PhaseStats::sActive)
+		{
+			PhaseStats::Clock::duration elapsed = PhaseStats::Clock::now() - m_start;
+			if (m_exclude != PhaseStats::PHASE_CNT)
+				elapsed -= std::chrono::nanoseconds(PhaseStats::sActive->Accumulated(m_exclude) - m_excludeNs);
+			PhaseStats::sActive->Add(m_phase, elapsed);
+		}
+	}
+
+private:
+	PhaseStats::Phase m_phase;
+	PhaseStats::Phase m_exclude;
+	PhaseStats::Value m_excludeNs;
+	PhaseStats::Clock::time_point m_start;
+};
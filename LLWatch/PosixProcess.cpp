@@ -0,0 +1,515 @@
+// ---------------------------------------------------------------------------
+// PosixProcess.cpp - POSIX Process api helper
+// 
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ---------------------------------------------------------------------------
+
+#include "PosixProcess.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+#include <iostream>
+
+#ifdef __APPLE__
+#include <util.h>
+#else
+#include <pty.h>
+#endif
+
+extern char** environ;
+
+const unsigned int BUFSIZE = 65536;
+const size_t SPLICE_LEN = 1 << 20;
+const int PIPE_SIZE = 1 << 20;
+
+// ======================================================================================
+PosixProcess::PosixProcess() :
+	m_hChildStd_OUT_Rd(-1),
+	m_pid(-1),
+	m_reaped(true),
+	m_useFork(false),
+	m_useSplice(true),
+	m_execErrno(0)
+{ }
+
+// ======================================================================================
+PosixProcess::~PosixProcess()
+{
+	CloseProcess();
+}
+
+// ======================================================================================
+void PosixProcess::GetRunArgs(std::vector<std::string>& args, const std::string& command)
+{
+	args.clear();
+	if (command.find_first_of("|&;<>()$`\\\"'*?[]#~=%{}\n") != std::string::npos)
+	{
+		args.push_back("/bin/sh");
+		args.push_back("-c");
+		args.push_back(command);
+		return;
+	}
+
+	size_t pos = 0;
+	while ((pos = command.find_first_not_of(" \t", pos)) != std::string::npos)
+	{
+		size_t end = command.find_first_of(" \t", pos);
+		args.push_back(command.substr(pos, end - pos));
+		pos = end;
+	}
+}
+
+// ======================================================================================
+const char* PosixProcess::SetPriority(const RunLimits& limits)
+{
+	if (limits.nice != 0 && setpriority(PRIO_PROCESS, 0, limits.nice) != 0)
+		return "setpriority";
+#ifdef SYS_ioprio_set
+	// IOPRIO_WHO_PROCESS 1, class IOPRIO_CLASS_IDLE 3 in the top bits.
+	if (limits.lowIo && syscall(SYS_ioprio_set, 1, 0, 3 << 13) != 0)
+		return "ioprio_set";
+#endif
+#ifdef __linux__
+	if (limits.affinity != 0)
+	{
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		for (unsigned cpu = 0; cpu != 64; cpu++)
+			if (limits.affinity & (1ull << cpu))
+				CPU_SET(cpu, &cpus);
+		if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+			return "sched_setaffinity";
+	}
+#endif
+	return NULL;
+}
+
+// ======================================================================================
+// posix_spawn, child stdout+stderr to outFd, stdin from /dev/null (or the pty).
+bool PosixProcess::SpawnChild(char* const argv[], int outFd, bool searchPath)
+{
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, outFd, STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, outFd, STDERR_FILENO);
+	if (m_usePty)
+		posix_spawn_file_actions_adddup2(&actions, outFd, STDIN_FILENO);
+	else
+		posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+
+	// Child starts with default signal handling and nothing blocked.
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	sigset_t sigs;
+	sigemptyset(&sigs);
+	posix_spawnattr_setsigmask(&attr, &sigs);
+	sigaddset(&sigs, SIGPIPE);
+	sigaddset(&sigs, SIGINT);
+	posix_spawnattr_setsigdefault(&attr, &sigs);
+	short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+#ifdef POSIX_SPAWN_USEVFORK
+	flags |= POSIX_SPAWN_USEVFORK;
+#endif
+#ifdef POSIX_SPAWN_SETSID
+	if (m_usePty)
+		flags |= POSIX_SPAWN_SETSID;	// own session, like forkpty
+#endif
+	posix_spawnattr_setflags(&attr, flags);
+
+	int err = searchPath ?
+		posix_spawnp(&m_pid, argv[0], &actions, &attr, argv, environ) :
+		posix_spawn(&m_pid, argv[0], &actions, &attr, argv, environ);
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+
+	if (err != 0)
+	{
+		if (!m_headless)
+			std::cerr << "posix_spawn " << argv[0] << " failed: " << strerror(err) << std::endl;
+		m_pid = -1;
+		return false;
+	}
+	return true;
+}
+
+// ======================================================================================
+// Classic fork+exec, same redirection as SpawnChild. Also used to apply RunLimits,
+// which posix_spawn has no attributes for. A failed exec sends its errno back through
+// a close-on-exec pipe (m_execErrno), ENOMEM when the image does not fit the cap.
+bool PosixProcess::ForkChild(char* const argv[], int outFd, bool searchPath)
+{
+	m_execErrno = 0;
+	int errFds[2];
+	if (pipe(errFds) != 0)
+		errFds[0] = errFds[1] = -1;
+	else
+	{
+		fcntl(errFds[0], F_SETFD, FD_CLOEXEC);
+		fcntl(errFds[1], F_SETFD, FD_CLOEXEC);
+	}
+
+	m_pid = fork();
+	if (m_pid == 0)
+	{
+		SetPriority(m_limits);
+		struct rlimit limit;
+		if (m_limits.cpuMs != 0)
+		{
+			// SIGXCPU at the soft limit, SIGKILL a second later if it is caught.
+			limit.rlim_cur = (rlim_t)((m_limits.cpuMs + 999) / 1000);
+			limit.rlim_max = limit.rlim_cur + 1;
+			setrlimit(RLIMIT_CPU, &limit);
+		}
+		if (m_limits.memoryBytes != 0)
+		{
+			limit.rlim_cur = limit.rlim_max = (rlim_t)m_limits.memoryBytes;
+			setrlimit(RLIMIT_AS, &limit);
+		}
+		if (m_usePty && setsid() >= 0)
+			ioctl(outFd, TIOCSCTTY, 0);	// terminal becomes controlling tty, like forkpty
+		dup2(outFd, STDOUT_FILENO);
+		dup2(outFd, STDERR_FILENO);
+		int inFd = m_usePty ? dup(outFd) : open("/dev/null", O_RDONLY);
+		if (inFd >= 0)
+		{
+			dup2(inFd, STDIN_FILENO);
+			close(inFd);
+		}
+		signal(SIGPIPE, SIG_DFL);
+		signal(SIGINT, SIG_DFL);
+		if (searchPath)
+			execvp(argv[0], argv);
+		else
+			execv(argv[0], argv);
+		int execErrno = errno;
+		if (errFds[1] >= 0 && write(errFds[1], &execErrno, sizeof(execErrno)) < 0)
+			_exit(126);
+		_exit(127);
+	}
+
+	if (errFds[1] >= 0)
+	{
+		close(errFds[1]);
+		if (m_pid > 0)
+		{
+			int execErrno = 0;
+			ssize_t len;
+			while ((len = read(errFds[0], &execErrno, sizeof(execErrno))) < 0 && errno == EINTR)
+				continue;
+			if (len == (ssize_t)sizeof(execErrno))
+				m_execErrno = execErrno;
+		}
+		close(errFds[0]);
+	}
+	if (m_pid < 0)
+	{
+		if (!m_headless)
+			std::cerr << "fork " << argv[0] << " failed: " << strerror(errno) << std::endl;
+		m_pid = -1;
+		return false;
+	}
+	return true;
+}
+
+// ======================================================================================
+// Pseudo terminal pair, master (our end) and slave (child stdin, stdout, stderr).
+// Output post processing is off so lines end in \n as with a pipe.
+bool PosixProcess::OpenPty(int& masterFd, int& slaveFd)
+{
+	struct winsize winSize;
+	memset(&winSize, 0, sizeof(winSize));
+	winSize.ws_col = (unsigned short)m_ptyCols;
+	winSize.ws_row = (unsigned short)m_ptyRows;
+
+	if (openpty(&masterFd, &slaveFd, NULL, NULL, &winSize) != 0)
+	{
+		std::cerr << "openpty failed: " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	struct termios tio;
+	if (tcgetattr(slaveFd, &tio) == 0)
+	{
+		tio.c_oflag &= ~OPOST;
+		tio.c_lflag &= ~ECHO;
+		tcsetattr(slaveFd, TCSANOW, &tio);
+	}
+
+	fcntl(masterFd, F_SETFD, FD_CLOEXEC);
+	fcntl(slaveFd, F_SETFD, FD_CLOEXEC);
+	return true;
+}
+
+// ======================================================================================
+bool PosixProcess::CreateChildProcess(const std::string& commandLine, unsigned long waitMsec)
+{
+	CloseProcess();
+	StartClock();
+	m_exitCode = 0;
+
+	std::vector<std::string> args;
+	GetRunArgs(args, commandLine);
+	if (args.empty())
+		return false;
+
+	std::vector<char*> argv;
+	for (size_t idx = 0; idx != args.size(); idx++)
+		argv.push_back((char*)args[idx].c_str());
+	argv.push_back(NULL);
+
+	// Both ends close-on-exec, the child only keeps the dup2 copies.
+	int fds[2];
+	if (!m_captureFile.empty())
+	{
+		fds[0] = -1;
+		fds[1] = open(m_captureFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+		if (fds[1] < 0)
+		{
+			std::cerr << "Failed to create " << m_captureFile << ": " << strerror(errno) << std::endl;
+			return false;
+		}
+	}
+	else if (m_usePty)
+	{
+		if (!OpenPty(fds[0], fds[1]))
+			return false;
+	}
+	else if (pipe2(fds, O_CLOEXEC) != 0)
+	{
+		std::cerr << "pipe2 failed: " << strerror(errno) << std::endl;
+		return false;
+	}
+
+#ifdef F_SETPIPE_SZ
+	// Larger pipe, fewer wake ups and bigger splice moves on chatty commands.
+	if (!m_usePty && fds[0] >= 0)
+		fcntl(fds[0], F_SETPIPE_SZ, PIPE_SIZE);
+#endif
+
+	bool searchPath = (args[0].find('/') == std::string::npos);
+	bool started = (m_useFork || m_limits.Any()) ?
+		ForkChild(&argv[0], fds[1], searchPath) :
+		SpawnChild(&argv[0], fds[1], searchPath);
+	close(fds[1]);
+
+	if (!started)
+	{
+		if (fds[0] >= 0)
+			close(fds[0]);
+		m_exitCode = 127;
+		if (!m_headless)
+			std::cerr << " Make sure you proceed command with --\n"
+				" And that executable is either in path or you specify \n"
+				" full path to executable \n";
+		return false;
+	}
+
+	m_hChildStd_OUT_Rd = fds[0];
+	m_reaped = false;
+	(void)waitMsec;		// Windows waits for startup, pipe reads below block instead.
+	return true;
+}
+
+// ======================================================================================
+// Collect exit status and resource usage, return true if child has exited.
+bool PosixProcess::Reap(int options)
+{
+	if (m_reaped)
+		return true;
+
+	int status = 0;
+	pid_t pid;
+	struct rusage usage;
+	while ((pid = wait4(m_pid, &status, options, &usage)) < 0 && errno == EINTR)
+		continue;
+	if (pid != m_pid)
+		return false;
+
+	m_usage.valid = true;
+	m_usage.wallMs = std::chrono::duration<double, std::milli>(Clock::now() - m_startTime).count();
+	m_usage.userMs = usage.ru_utime.tv_sec * 1e3 + usage.ru_utime.tv_usec / 1e3;
+	m_usage.kernelMs = usage.ru_stime.tv_sec * 1e3 + usage.ru_stime.tv_usec / 1e3;
+#ifdef __APPLE__
+	m_usage.peakBytes = (uint64_t)usage.ru_maxrss;			// bytes
+#else
+	m_usage.peakBytes = (uint64_t)usage.ru_maxrss * 1024;	// KB
+#endif
+	m_usage.readBytes = (uint64_t)usage.ru_inblock * 512;
+	m_usage.writeBytes = (uint64_t)usage.ru_oublock * 512;
+
+	// Killed at the cpu limit. The address space cap only makes allocations fail, a run
+	// counts as stopped by it when exec failed with ENOMEM, or it died of a signal an
+	// allocation failure ends in (segv, abort of bad_alloc, OOM kill) or exited with an
+	// error with its peak resident size near the cap. Other failures are ordinary.
+	int signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+	uint64_t cpuLimitMs = (m_limits.cpuMs + 999) / 1000 * 1000;
+	bool failed = signal == SIGKILL || signal == SIGSEGV || signal == SIGABRT
+		|| (WIFEXITED(status) && WEXITSTATUS(status) != 0);
+	if (m_limits.cpuMs != 0 && (signal == SIGXCPU || signal == SIGKILL)
+			&& m_usage.userMs + m_usage.kernelMs + 10 >= (double)cpuLimitMs)
+		m_usage.breached |= RunUsage::BREACH_CPU;
+	else if (m_limits.memoryBytes != 0 && (m_execErrno == ENOMEM
+			|| (failed && m_usage.peakBytes >= m_limits.memoryBytes / 10 * 9)))
+		m_usage.breached |= RunUsage::BREACH_MEMORY;
+
+	if (WIFEXITED(status))
+		m_exitCode = WEXITSTATUS(status);
+	else if (WIFSIGNALED(status))
+		m_exitCode = 128 + WTERMSIG(status);
+	m_reaped = true;
+	return true;
+}
+
+// ======================================================================================
+// Read output from the child process's pipe for STDOUT until end of file or child exit.
+// A grand child (ex: 'cmd &') may keep the pipe open after the child exits, so poll
+// with a timeout and stop once the child is gone and the pipe is drained.
+// A pty master reports EIO once the last slave descriptor is closed, same as end of file.
+//
+// On Linux echoed output does not pass through user space: splice moves it from the
+// pipe to stdout, or tee duplicates it to a stdout pipe when it is also captured.
+// Either falls back to read+write when stdout does not support it (ex: terminal).
+void PosixProcess::ReadFromPipe(bool echo, std::string* pBuffer)
+{
+	char chBuf[BUFSIZE];
+	if (pBuffer)
+		pBuffer->clear();
+	m_bytesRead = 0;
+	if (m_hChildStd_OUT_Rd < 0)
+	{
+		Reap(0);		// output went to capture file
+		return;
+	}
+
+#ifdef __linux__
+	enum { COPY, SPLICE, TEE } kernelCopy = COPY;
+	if (m_useSplice && echo && !m_usePty && !m_dataSink)
+		kernelCopy = (pBuffer == NULL) ? SPLICE : TEE;
+#endif
+
+	bool exited = false;
+	for (;;)
+	{
+		struct pollfd pfd;
+		pfd.fd = m_hChildStd_OUT_Rd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		int ready = poll(&pfd, 1, exited ? 0 : 100);
+		if (ready < 0 && errno == EINTR)
+			continue;
+
+		if (ready > 0)
+		{
+#ifdef __linux__
+			if (kernelCopy == SPLICE)
+			{
+				ssize_t moved = splice(m_hChildStd_OUT_Rd, NULL, STDOUT_FILENO, NULL, SPLICE_LEN, SPLICE_F_MOVE);
+				if (moved > 0)
+				{
+					NoteRead(NULL, moved);
+					continue;
+				}
+				if (moved == 0)
+					break;			// end of file
+				if (errno == EINTR)
+					continue;
+				kernelCopy = COPY;	// stdout can not splice, copy instead
+			}
+			else if (kernelCopy == TEE)
+			{
+				// Duplicate to stdout pipe, then consume the same bytes for the buffer.
+				ssize_t copied = tee(m_hChildStd_OUT_Rd, STDOUT_FILENO, sizeof(chBuf), 0);
+				if (copied > 0)
+				{
+					ssize_t rdLen = read(m_hChildStd_OUT_Rd, chBuf, copied);
+					if (rdLen > 0)
+					{
+						NoteRead(chBuf, rdLen);
+						pBuffer->append(chBuf, rdLen);
+					}
+					continue;
+				}
+				if (copied < 0 && errno == EINTR)
+					continue;
+				kernelCopy = COPY;	// stdout is not a pipe, or end of file, copy instead
+			}
+#endif
+			ssize_t rdLen = read(m_hChildStd_OUT_Rd, chBuf, sizeof(chBuf));
+			if (rdLen < 0 && errno == EINTR)
+				continue;
+			if (rdLen <= 0)
+				break;			// end of file
+
+			NoteRead(chBuf, rdLen);
+			if (echo)
+			{
+				for (ssize_t wrOff = 0; wrOff < rdLen; )
+				{
+					ssize_t wrLen = write(STDOUT_FILENO, chBuf + wrOff, rdLen - wrOff);
+					if (wrLen < 0 && errno != EINTR)
+						break;
+					wrOff += (wrLen > 0) ? wrLen : 0;
+				}
+			}
+			if (pBuffer)
+				pBuffer->append(chBuf, rdLen);
+		}
+		else if (exited)
+		{
+			break;				// child gone and nothing left to read
+		}
+		else
+		{
+			exited = Reap(WNOHANG);
+		}
+	}
+
+	Reap(0);
+}
+
+// ======================================================================================
+void PosixProcess::CloseProcess()
+{
+	if (m_hChildStd_OUT_Rd >= 0)
+	{
+		close(m_hChildStd_OUT_Rd);
+		m_hChildStd_OUT_Rd = -1;
+	}
+	Reap(0);
+}
@@ -0,0 +1,75 @@
+// ---------------------------------------------------------------------------
+// PosixProcess.h - POSIX Process api helper
+// 
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ---------------------------------------------------------------------------
+
+#pragma once
+
+#include "ChildProcess.h"
+
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+// ======================================================================================
+// Child process started with posix_spawn (vfork semantics, cheap even when the
+// watcher holds large frames) or optionally fork+exec. Output is captured through a
+// close-on-exec pipe drained with poll, or a pseudo terminal (SetPty).
+//
+// Commands without shell meta characters are run directly (PATH search),
+// others are run with /bin/sh -c like the unix 'watch' command.
+class PosixProcess : public ChildProcess
+{
+public:
+	PosixProcess();
+	~PosixProcess();
+
+	int   m_hChildStd_OUT_Rd;
+	pid_t m_pid;
+	bool  m_reaped;
+	bool  m_useFork;		// fork+exec instead of posix_spawn
+	bool  m_useSplice;		// Linux splice/tee to stdout when output is echoed
+	int   m_execErrno;		// errno of a failed exec by ForkChild, 0 if it ran
+
+	bool CreateChildProcess(const std::string& commandLine, unsigned long waitMsec = 10);
+	void ReadFromPipe(bool echo, std::string* pBuffer = NULL);
+	void CloseProcess();
+
+	// Split command into argv, run through /bin/sh if it needs a shell.
+	static void GetRunArgs(std::vector<std::string>& args, const std::string& command);
+
+	// Nice, I/O priority and affinity of limits for the calling thread and the threads
+	// and children it starts later. Async signal safe, returns the failed call or NULL.
+	static const char* SetPriority(const RunLimits& limits);
+
+private:
+	bool Reap(int options);
+	bool OpenPty(int& masterFd, int& slaveFd);
+	bool SpawnChild(char* const argv[], int outFd, bool searchPath);
+	bool ForkChild(char* const argv[], int outFd, bool searchPath);
+};
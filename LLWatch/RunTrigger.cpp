@@ -0,0 +1,479 @@
+// ------------------------------------------------------------------------------------------------
+// RunTrigger.cpp - Wait between runs, woken early by key, signal or control pipe
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+
+#include "RunTrigger.h"
+
+#include <chrono>
+#include <iostream>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+// Milliseconds until deadline, 0 once passed.
+static unsigned MsecLeft(Clock::time_point deadline)
+{
+	Clock::duration left = deadline - Clock::now();
+	if (left <= Clock::duration::zero())
+		return 0;
+	return (unsigned)std::chrono::duration_cast<std::chrono::milliseconds>(left + std::chrono::microseconds(999)).count();
+}
+
+// ======================================================================================
+const char* RunTrigger::Name(Reason reason)
+{
+	static const char* s_names[] = { "timeout", "key", "signal", "pipe", "resize", "stop" };
+	return s_names[reason];
+}
+
+#ifdef _WIN32
+// ======================================================================================
+static HANDLE s_stopEvent = CreateEventA(NULL, TRUE, FALSE, NULL);		// manual reset, stays set
+
+void RunTrigger::Stop()
+{
+	SetEvent(s_stopEvent);
+}
+
+// ======================================================================================
+RunTrigger::RunTrigger() :
+	m_event(NULL),
+	m_keys(NULL),
+	m_keysMode(0),
+	m_resize(false),
+	m_pipe(INVALID_HANDLE_VALUE),
+	m_pipeEvent(NULL),
+	m_pipeReading(false)
+{
+	ZeroMemory(&m_pipeIo, sizeof(m_pipeIo));
+}
+
+RunTrigger::~RunTrigger()
+{
+	if (m_resize)
+		SetConsoleMode(m_keys, m_keysMode);
+	if (m_pipe != INVALID_HANDLE_VALUE)
+	{
+		CancelIo(m_pipe);
+		CloseHandle(m_pipe);
+	}
+	if (m_pipeEvent != NULL)
+		CloseHandle(m_pipeEvent);
+	if (m_event != NULL)
+		CloseHandle(m_event);
+}
+
+// ======================================================================================
+bool RunTrigger::EnableKeys()
+{
+	HANDLE input = GetStdHandle(STD_INPUT_HANDLE);
+	if (input == INVALID_HANDLE_VALUE || input == NULL || !GetConsoleMode(input, &m_keysMode))
+		return false;		// redirected
+	m_keys = input;
+	return true;
+}
+
+// ======================================================================================
+bool RunTrigger::EnableExternal(const char* name, std::string& error)
+{
+	if (name == NULL)
+		return true;
+
+	std::string eventName = std::string("Local\\llwatch-") + name;
+	m_event = CreateEventA(NULL, FALSE, FALSE, eventName.c_str());
+	std::string pipeName = std::string("\\\\.\\pipe\\llwatch-") + name;
+	m_pipe = CreateNamedPipeA(pipeName.c_str(), PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+		PIPE_TYPE_BYTE, 1, 0, sizeof(m_pipeBuf), 0, NULL);
+	m_pipeEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+	if (m_event == NULL || m_pipe == INVALID_HANDLE_VALUE || m_pipeEvent == NULL)
+	{
+		error = "Failed to create trigger " + eventName + " / " + pipeName;
+		return false;
+	}
+	ListenPipe();
+	return true;
+}
+
+// ======================================================================================
+// Start waiting for a writer, or for the next write of the connected one.
+void RunTrigger::ListenPipe()
+{
+	for (;;)
+	{
+		ZeroMemory(&m_pipeIo, sizeof(m_pipeIo));
+		m_pipeIo.hEvent = m_pipeEvent;
+		ResetEvent(m_pipeEvent);
+		if (!m_pipeReading)
+		{
+			if (ConnectNamedPipe(m_pipe, &m_pipeIo) || GetLastError() == ERROR_IO_PENDING)
+				return;
+			if (GetLastError() != ERROR_PIPE_CONNECTED)
+				return;		// pipe broken, no more pipe triggers
+			m_pipeReading = true;
+		}
+		else
+		{
+			if (ReadFile(m_pipe, m_pipeBuf, sizeof(m_pipeBuf), NULL, &m_pipeIo) || GetLastError() == ERROR_IO_PENDING)
+				return;
+			DisconnectNamedPipe(m_pipe);		// writer gone
+			m_pipeReading = false;
+		}
+	}
+}
+
+// ======================================================================================
+// Window input makes buffer size changes console input events.
+bool RunTrigger::EnableResize()
+{
+	if (m_keys == NULL || !SetConsoleMode(m_keys, m_keysMode | ENABLE_WINDOW_INPUT))
+		return false;
+	m_resize = true;
+	return true;
+}
+
+// ======================================================================================
+// Drain console input, true if a run (space, enter) or quit (q) key was pressed.
+bool RunTrigger::ReadKeys(bool& quit, bool& resized)
+{
+	bool run = false;
+	DWORD events = 0;
+	while (GetNumberOfConsoleInputEvents(m_keys, &events) && events != 0)
+	{
+		INPUT_RECORD record;
+		DWORD read = 0;
+		if (!ReadConsoleInputA(m_keys, &record, 1, &read) || read == 0)
+			break;
+		if (record.EventType == WINDOW_BUFFER_SIZE_EVENT)
+			resized = true;
+		if (record.EventType != KEY_EVENT || !record.Event.KeyEvent.bKeyDown)
+			continue;
+		char ch = record.Event.KeyEvent.uChar.AsciiChar;
+		if (ch == 'q' || ch == 'Q')
+			quit = true;
+		else if (ch == ' ' || ch == '\r')
+			run = true;
+	}
+	return run || quit;
+}
+
+// ======================================================================================
+RunTrigger::Reason RunTrigger::Wait(unsigned msec)
+{
+	Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(msec);
+	for (;;)
+	{
+		HANDLE handles[4];
+		Reason reasons[4];
+		DWORD cnt = 0;
+		handles[cnt] = s_stopEvent;
+		reasons[cnt++] = STOP;
+		if (m_event != NULL)
+		{
+			handles[cnt] = m_event;
+			reasons[cnt++] = SIGNAL;
+		}
+		if (m_pipe != INVALID_HANDLE_VALUE)
+		{
+			handles[cnt] = m_pipeEvent;
+			reasons[cnt++] = PIPE;
+		}
+		if (m_keys != NULL)
+		{
+			handles[cnt] = m_keys;
+			reasons[cnt++] = KEY;
+		}
+
+		DWORD which = WaitForMultipleObjects(cnt, handles, FALSE, MsecLeft(deadline));
+		if (which >= WAIT_OBJECT_0 + cnt)
+			return TIMEOUT;
+		Reason reason = reasons[which - WAIT_OBJECT_0];
+		if (reason == KEY)
+		{
+			bool quit = false;
+			bool resized = false;
+			if (ReadKeys(quit, resized))
+				return quit ? STOP : KEY;
+			if (resized)
+				return RESIZE;
+		}
+		else if (reason == PIPE)
+		{
+			// Connect done (keep waiting for data), data read (run) or writer gone.
+			DWORD bytes = 0;
+			bool done = GetOverlappedResult(m_pipe, &m_pipeIo, &bytes, FALSE) != FALSE;
+			bool wrote = done && m_pipeReading;
+			if (done)
+				m_pipeReading = true;
+			else if (m_pipeReading)
+			{
+				DisconnectNamedPipe(m_pipe);
+				m_pipeReading = false;
+			}
+			ListenPipe();
+			if (wrote)
+				return PIPE;
+		}
+		else
+		{
+			return reason;
+		}
+	}
+}
+
+#else
+// ======================================================================================
+// Self pipe, signal handlers and Stop write a byte which wakes poll: 'u' SIGUSR1,
+// 'w' SIGWINCH, 'x' stop.
+static int s_wake[2] = { -1, -1 };
+
+static void WakeByte(char ch)
+{
+	int saved = errno;
+	if (s_wake[1] >= 0)
+	{
+		ssize_t written = write(s_wake[1], &ch, 1);		// pipe full, a wake up is pending anyway
+		(void)written;
+	}
+	errno = saved;
+}
+
+static void OnUsr1(int)
+{
+	WakeByte('u');
+}
+
+static void OnWinch(int)
+{
+	WakeByte('w');
+}
+
+void RunTrigger::Stop()
+{
+	WakeByte('x');
+}
+
+// ======================================================================================
+RunTrigger::RunTrigger() :
+	m_keys(false),
+	m_fifo(-1),
+	m_fifoKeep(-1),
+	m_fifoCreated(false)
+{
+	if (s_wake[0] < 0 && pipe(s_wake) == 0)
+	{
+		for (int idx = 0; idx != 2; idx++)
+		{
+			fcntl(s_wake[idx], F_SETFD, FD_CLOEXEC);
+			fcntl(s_wake[idx], F_SETFL, O_NONBLOCK);
+		}
+	}
+}
+
+RunTrigger::~RunTrigger()
+{
+	if (m_keys)
+	{
+		// Also when moved to the background since, SIGTTOU would stop us.
+		void (*savedTtou)(int) = signal(SIGTTOU, SIG_IGN);
+		tcsetattr(STDIN_FILENO, TCSANOW, &m_savedTio);
+		signal(SIGTTOU, savedTtou);
+	}
+	if (m_fifo >= 0)
+		close(m_fifo);
+	if (m_fifoKeep >= 0)
+		close(m_fifoKeep);
+	if (m_fifoCreated)
+		unlink(m_fifoPath.c_str());
+}
+
+// ======================================================================================
+// Non-canonical, no echo: single keys are readable at once. Ctrl-C still signals.
+// Not for a background job, changing the terminal mode would stop it with SIGTTOU.
+bool RunTrigger::EnableKeys()
+{
+	if (!isatty(STDIN_FILENO))
+		return false;
+	if (tcgetpgrp(STDIN_FILENO) != getpgrp())
+	{
+		std::cerr << "Running in the background, key triggers are off" << std::endl;
+		return false;
+	}
+	if (tcgetattr(STDIN_FILENO, &m_savedTio) != 0)
+		return false;
+	struct termios tio = m_savedTio;
+	tio.c_lflag &= ~(ICANON | ECHO);
+	tio.c_cc[VMIN] = 1;
+	tio.c_cc[VTIME] = 0;
+	if (tcsetattr(STDIN_FILENO, TCSANOW, &tio) != 0)
+		return false;
+	m_keys = true;
+	return true;
+}
+
+// ======================================================================================
+bool RunTrigger::EnableExternal(const char* name, std::string& error)
+{
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = OnUsr1;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGUSR1, &action, NULL);
+	if (name == NULL)
+		return true;
+
+	m_fifoPath = name;
+	struct stat fifoStat;
+	if (stat(name, &fifoStat) != 0)
+	{
+		if (mkfifo(name, 0600) != 0)
+		{
+			error = "mkfifo " + m_fifoPath + " failed: " + strerror(errno);
+			return false;
+		}
+		m_fifoCreated = true;
+	}
+	else if (!S_ISFIFO(fifoStat.st_mode))
+	{
+		error = m_fifoPath + " exists and is not a FIFO";
+		return false;
+	}
+	m_fifo = open(name, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	m_fifoKeep = open(name, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+	if (m_fifo < 0 || m_fifoKeep < 0)
+	{
+		error = "open " + m_fifoPath + " failed: " + strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+// ======================================================================================
+bool RunTrigger::EnableResize()
+{
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = OnWinch;
+	sigemptyset(&action.sa_mask);
+	return sigaction(SIGWINCH, &action, NULL) == 0;
+}
+
+// ======================================================================================
+// Read pending keys, true if a run (space, enter) or quit (q) key was pressed.
+bool RunTrigger::ReadKeys(bool& quit)
+{
+	char keys[64];
+	ssize_t len = read(STDIN_FILENO, keys, sizeof(keys));
+	bool run = false;
+	for (ssize_t idx = 0; idx < len; idx++)
+	{
+		if (keys[idx] == 'q' || keys[idx] == 'Q')
+			quit = true;
+		else if (keys[idx] == ' ' || keys[idx] == '\n')
+			run = true;
+	}
+	return run || quit;
+}
+
+// ======================================================================================
+RunTrigger::Reason RunTrigger::Wait(unsigned msec)
+{
+	enum { WAKE, KEYS, FIFO };
+	Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(msec);
+	for (;;)
+	{
+		struct pollfd fds[3];
+		int which[3];
+		nfds_t cnt = 0;
+		fds[cnt].fd = s_wake[0];
+		which[cnt++] = WAKE;
+		if (m_keys)
+		{
+			fds[cnt].fd = STDIN_FILENO;
+			which[cnt++] = KEYS;
+		}
+		if (m_fifo >= 0)
+		{
+			fds[cnt].fd = m_fifo;
+			which[cnt++] = FIFO;
+		}
+		for (nfds_t idx = 0; idx != cnt; idx++)
+			fds[idx].events = POLLIN;
+
+		int ready = poll(fds, cnt, (int)MsecLeft(deadline));
+		if (ready < 0 && errno == EINTR)
+			continue;			// signal, its byte is in the wake pipe
+		if (ready <= 0)
+			return TIMEOUT;
+
+		for (nfds_t idx = 0; idx != cnt; idx++)
+		{
+			if ((fds[idx].revents & (POLLIN | POLLHUP | POLLERR)) == 0)
+				continue;
+			char buf[256];
+			ssize_t len;
+			switch (which[idx])
+			{
+			case WAKE:
+			{
+				bool stop = false;
+				bool signaled = false;
+				while ((len = read(s_wake[0], buf, sizeof(buf))) > 0)
+				{
+					stop = stop || memchr(buf, 'x', (size_t)len) != NULL;
+					signaled = signaled || memchr(buf, 'u', (size_t)len) != NULL;
+				}
+				return stop ? STOP : (signaled ? SIGNAL : RESIZE);
+			}
+			case KEYS:
+			{
+				bool quit = false;
+				if (ReadKeys(quit))
+					return quit ? STOP : KEY;
+				break;
+			}
+			case FIFO:
+				while (read(m_fifo, buf, sizeof(buf)) > 0)
+					continue;
+				return PIPE;
+			}
+		}
+	}
+}
+#endif
@@ -0,0 +1,106 @@
+// ------------------------------------------------------------------------------------------------
+// RunTrigger.h - Wait between runs, woken early by key, signal or control pipe
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+
+#pragma once
+
+#include <string>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <termios.h>
+#endif
+
+// ======================================================================================
+// Wait between runs which sleeps in the kernel (no polling) until the interval ends or
+// something asks for a run now:
+//   key     space or enter, q quits (console input, not redirected)
+//   signal  SIGUSR1 (POSIX), named event Local\llwatch-<name> (Windows, SetEvent)
+//   pipe    any write to the control FIFO <name> (POSIX, created if missing) or
+//           to the named pipe \\.\pipe\llwatch-<name> (Windows)
+//   resize  console window size changed (SIGWINCH, console buffer size event)
+// Stop (Ctrl-C handler) wakes the wait as well. One instance per process.
+//
+//   kill -USR1 <pid>    echo > /tmp/llwatch.ctl    echo > \\.\pipe\llwatch-deploy
+class RunTrigger
+{
+public:
+	enum Reason { TIMEOUT, KEY, SIGNAL, PIPE, RESIZE, STOP };
+
+	RunTrigger();
+	~RunTrigger();
+
+	// Keys of the console, terminal is put in non-canonical mode until destroyed.
+	bool EnableKeys();
+
+	// SIGUSR1, also the named event and pipe of name when not NULL.
+	bool EnableExternal(const char* name, std::string& error);
+
+	// Window size changes (--fit), on Windows reported with the keys of the console.
+	bool EnableResize();
+
+	// Wait up to msec, return why it ended.
+	Reason Wait(unsigned msec);
+
+	// Wake Wait with STOP, safe from a signal handler or another thread.
+	static void Stop();
+
+	static const char* Name(Reason reason);
+
+private:
+	RunTrigger(const RunTrigger&);
+	RunTrigger& operator=(const RunTrigger&);
+
+#ifdef _WIN32
+	bool   ReadKeys(bool& quit, bool& resized);
+	void   ListenPipe();
+
+	HANDLE m_event;				// named event
+	HANDLE m_keys;				// console input, NULL if none
+	DWORD  m_keysMode;
+	bool   m_resize;			// window input enabled, mode restored on exit
+	HANDLE m_pipe;				// named pipe server end
+	HANDLE m_pipeEvent;
+	OVERLAPPED m_pipeIo;
+	bool   m_pipeReading;		// connected, read pending (else connect pending)
+	char   m_pipeBuf[256];
+#else
+	bool   ReadKeys(bool& quit);
+
+	bool   m_keys;
+	struct termios m_savedTio;
+	int    m_fifo;				// control FIFO, read end
+	int    m_fifoKeep;			// our write end, EOF never ends the FIFO
+	std::string m_fifoPath;
+	bool   m_fifoCreated;		// removed on exit
+#endif
+};
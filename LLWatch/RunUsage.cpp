@@ -0,0 +1,125 @@
+// ------------------------------------------------------------------------------------------------
+// RunUsage.cpp - Resources used by each run of the watched command
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+
+#include "RunUsage.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+// ======================================================================================
+// Short byte count, ex: 512B 12.0KB 3.5MB
+static void PrintBytes(char* buf, size_t bufLen, double bytes)
+{
+	if (bytes < 1024)
+		snprintf(buf, bufLen, "%.0fB", bytes);
+	else if (bytes < 1024 * 1024)
+		snprintf(buf, bufLen, "%.1fKB", bytes / 1024);
+	else if (bytes < 1024.0 * 1024 * 1024)
+		snprintf(buf, bufLen, "%.1fMB", bytes / (1024 * 1024));
+	else
+		snprintf(buf, bufLen, "%.2fGB", bytes / (1024.0 * 1024 * 1024));
+}
+
+// ======================================================================================
+std::string RunUsage::Breaches() const
+{
+	std::string names;
+	if (breached & BREACH_MEMORY)
+		names = "memory";
+	if (breached & BREACH_CPU)
+		names += names.empty() ? "cpu" : ",cpu";
+	return names;
+}
+
+// ======================================================================================
+void UsageTrend::Add(const RunUsage& usage)
+{
+	if (!usage.valid)
+		return;
+	m_runs[m_next] = usage;
+	m_next = (m_next + 1) % sWindow;
+	if (m_cnt < sWindow)
+		m_cnt++;
+}
+
+// ======================================================================================
+void UsageTrend::Show(std::ostream& out, const RunUsage& usage)
+{
+	if (!usage.valid)
+		return;
+	char peak[32], read[32], write[32];
+	PrintBytes(peak, sizeof(peak), (double)usage.peakBytes);
+	PrintBytes(read, sizeof(read), (double)usage.readBytes);
+	PrintBytes(write, sizeof(write), (double)usage.writeBytes);
+
+	char buf[256];
+	snprintf(buf, sizeof(buf), "wall=%.1fms user=%.1fms sys=%.1fms peak=%s io=%s/%s",
+		usage.wallMs, usage.userMs, usage.kernelMs, peak, read, write);
+	out << buf;
+	if (usage.breached != 0)
+		out << " LIMIT " << usage.Breaches();
+}
+
+// ======================================================================================
+void UsageTrend::Show(std::ostream& out) const
+{
+	if (m_cnt == 0)
+		return;
+
+	// min, sum, max of wall, cpu (user+sys), peak, io (read+write)
+	enum { WALL, CPU, PEAK, IO, FIELD_CNT };
+	double lo[FIELD_CNT], sum[FIELD_CNT], hi[FIELD_CNT];
+	for (unsigned idx = 0; idx != m_cnt; idx++)
+	{
+		const RunUsage& run = m_runs[idx];
+		double values[FIELD_CNT] =
+			{ run.wallMs, run.userMs + run.kernelMs, (double)run.peakBytes, (double)(run.readBytes + run.writeBytes) };
+		for (unsigned field = 0; field != FIELD_CNT; field++)
+		{
+			lo[field] = (idx == 0) ? values[field] : (std::min)(lo[field], values[field]);
+			hi[field] = (idx == 0) ? values[field] : (std::max)(hi[field], values[field]);
+			sum[field] = (idx == 0) ? values[field] : sum[field] + values[field];
+		}
+	}
+
+	char bytes[3][32], buf[320];
+	snprintf(buf, sizeof(buf), "last %u min/avg/max wall=%.1f/%.1f/%.1fms cpu=%.1f/%.1f/%.1fms",
+		m_cnt, lo[WALL], sum[WALL] / m_cnt, hi[WALL], lo[CPU], sum[CPU] / m_cnt, hi[CPU]);
+	out << buf;
+	for (unsigned field = PEAK; field <= IO; field++)
+	{
+		PrintBytes(bytes[0], sizeof(bytes[0]), lo[field]);
+		PrintBytes(bytes[1], sizeof(bytes[1]), sum[field] / m_cnt);
+		PrintBytes(bytes[2], sizeof(bytes[2]), hi[field]);
+		out << ((field == PEAK) ? " peak=" : " io=") << bytes[0] << "/" << bytes[1] << "/" << bytes[2];
+	}
+}
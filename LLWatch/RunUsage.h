@@ -0,0 +1,112 @@
+// ------------------------------------------------------------------------------------------------
+// RunUsage.h - Resources used by each run of the watched command
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+
+#pragma once
+
+#include <stdint.h>
+#include <iostream>
+#include <string>
+
+// ======================================================================================
+// Priority and caps of each run (llwatch --nice, --low-io, --affinity, --max-mem,
+// --max-cpu), 0 / false for none. Windows starts the child suspended in a Job Object
+// with these limits, POSIX sets them in the forked child before exec.
+struct RunLimits
+{
+	RunLimits() :
+		nice(0), lowIo(false), affinity(0), memoryBytes(0), cpuMs(0)
+	{ }
+
+	// Caps which can end or fail a run.
+	bool Caps() const
+	{ return memoryBytes != 0 || cpuMs != 0; }
+
+	bool Any() const
+	{ return nice != 0 || lowIo || affinity != 0 || Caps(); }
+
+	int      nice;			// 1..19, Windows below normal (< 10) or idle priority class
+	bool     lowIo;			// idle I/O priority (Linux), background mode (Windows, llwatch only)
+	uint64_t affinity;		// cpu mask
+	uint64_t memoryBytes;	// Windows job memory, POSIX address space
+	uint64_t cpuMs;			// Windows job user time, POSIX cpu seconds (rounded up)
+};
+
+// ======================================================================================
+// Resources used by one run of the watched command, filled when the child is reaped.
+// Windows: GetProcessTimes, GetProcessMemoryInfo, GetProcessIoCounters of the child.
+// POSIX: wait4 rusage, which also includes the children it waited for (ex: sh -c).
+struct RunUsage
+{
+	RunUsage() :
+		valid(false), wallMs(0), userMs(0), kernelMs(0), peakBytes(0), readBytes(0), writeBytes(0), breached(0)
+	{ }
+
+	enum Breach { BREACH_MEMORY = 1, BREACH_CPU = 2 };
+
+	// Limits the run hit, ex: "memory,cpu", empty if none.
+	std::string Breaches() const;
+
+	bool     valid;
+	double   wallMs;		// start to exit
+	double   userMs;
+	double   kernelMs;
+	uint64_t peakBytes;		// peak working set / max resident set size
+	uint64_t readBytes;		// all I/O on Windows, block I/O x 512 on POSIX
+	uint64_t writeBytes;
+	unsigned breached;		// Breach bits, POSIX reports memory when a capped run died near the cap
+};
+
+// ======================================================================================
+// Min/avg/max of the most recent runs.
+class UsageTrend
+{
+public:
+	static const unsigned sWindow = 64;		// runs kept
+
+	UsageTrend() : m_cnt(0), m_next(0) { }
+
+	void Add(const RunUsage& usage);
+
+	unsigned Count() const
+	{ return m_cnt; }
+
+	// One line "wall=min/avg/max ..." over the window.
+	void Show(std::ostream& out) const;
+
+	// Trailer fields of a single run "wall=12.5ms user=..."
+	static void Show(std::ostream& out, const RunUsage& usage);
+
+private:
+	RunUsage m_runs[sWindow];
+	unsigned m_cnt;
+	unsigned m_next;
+};
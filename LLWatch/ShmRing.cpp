@@ -0,0 +1,313 @@
+// ------------------------------------------------------------------------------------------------
+// ShmRing.cpp - Newest frames in shared memory
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+
+#include "ShmRing.h"
+
+#include <atomic>
+#include <chrono>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const uint32_t SHM_MAGIC = 0x4c4c5752;		// LLWR
+static const uint32_t SHM_VERSION = 1;
+
+// Lock free 64 bit atomics are required to share them between processes.
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "atomic<uint64_t> must be plain");
+
+// Region layout, header then 'slots' slots of 'stride' bytes.
+struct Header
+{
+	std::atomic<uint32_t> magic;	// set last by the writer, region is ready
+	uint32_t version;
+	uint32_t slots;
+	uint32_t reserved;
+	uint64_t slotBytes;
+	uint64_t stride;
+	std::atomic<uint64_t> latest;	// newest complete frame number, 0 none yet
+};
+
+// Metadata is atomic (relaxed), the seqlock orders it, data follows the slot.
+struct Slot
+{
+	std::atomic<uint64_t> seq;		// 2 x frame - 1 while writing, 2 x frame when complete
+	std::atomic<uint64_t> tick;
+	std::atomic<uint64_t> timeMs;
+	std::atomic<uint64_t> exitCode;
+	std::atomic<uint64_t> len;
+	std::atomic<uint64_t> truncated;
+};
+
+static const size_t s_headerBytes = 64;
+static_assert(sizeof(Header) <= s_headerBytes, "header fits its cache line");
+
+// ======================================================================================
+ShmRing::ShmRing() :
+	m_base(NULL),
+	m_size(0),
+	m_slots(0),
+	m_slotBytes(0),
+	m_stride(0),
+	m_owner(false),
+#ifdef _WIN32
+	m_mapping(NULL)
+#else
+	m_fd(-1)
+#endif
+{ }
+
+ShmRing::~ShmRing()
+{
+	Close();
+}
+
+// ======================================================================================
+Slot* ShmRing::GetSlot(uint64_t seq) const
+{
+	return (Slot*)(m_base + s_headerBytes + (size_t)((seq - 1) % m_slots) * m_stride);
+}
+
+// ======================================================================================
+// Create (size != 0) or open the named region, read only for readers.
+bool ShmRing::Map(const char* name, bool create, size_t size, std::string& error)
+{
+#ifdef _WIN32
+	m_name = std::string("Local\\llwatch-") + name;
+	if (create)
+	{
+		m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+			(DWORD)((uint64_t)size >> 32), (DWORD)size, m_name.c_str());
+		if (m_mapping != NULL && GetLastError() == ERROR_ALREADY_EXISTS)
+		{
+			error = m_name + " is already published";
+			return false;
+		}
+	}
+	else
+	{
+		m_mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, m_name.c_str());
+	}
+	if (m_mapping == NULL)
+	{
+		error = "Failed to " + std::string(create ? "create " : "open ") + m_name;
+		return false;
+	}
+	m_base = (char*)MapViewOfFile(m_mapping, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, 0);
+	if (m_base == NULL)
+	{
+		error = "Failed to map " + m_name;
+		return false;
+	}
+	if (!create)
+	{
+		MEMORY_BASIC_INFORMATION info;
+		VirtualQuery(m_base, &info, sizeof(info));
+		size = info.RegionSize;
+	}
+#else
+	m_name = std::string("/llwatch-") + name;
+	if (create)
+	{
+		// A previous writer's region is replaced, its readers keep the old mapping.
+		shm_unlink(m_name.c_str());
+		m_fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+		if (m_fd >= 0 && ftruncate(m_fd, (off_t)size) != 0)
+		{
+			error = "Failed to size " + m_name + ": " + strerror(errno);
+			return false;
+		}
+	}
+	else
+	{
+		m_fd = shm_open(m_name.c_str(), O_RDONLY, 0);
+		struct stat shmStat;
+		if (m_fd >= 0 && fstat(m_fd, &shmStat) == 0)
+			size = (size_t)shmStat.st_size;
+	}
+	if (m_fd < 0 || size < s_headerBytes)
+	{
+		error = "Failed to " + std::string(create ? "create " : "open ") + m_name + ": " + strerror(errno);
+		return false;
+	}
+	fcntl(m_fd, F_SETFD, FD_CLOEXEC);
+	void* base = mmap(NULL, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, m_fd, 0);
+	if (base == MAP_FAILED)
+	{
+		error = "Failed to map " + m_name + ": " + strerror(errno);
+		return false;
+	}
+	m_base = (char*)base;
+#endif
+	m_size = size;
+	m_owner = create;
+	return true;
+}
+
+// ======================================================================================
+void ShmRing::Close()
+{
+#ifdef _WIN32
+	if (m_base != NULL)
+		UnmapViewOfFile(m_base);
+	if (m_mapping != NULL)
+		CloseHandle(m_mapping);
+	m_mapping = NULL;
+#else
+	if (m_base != NULL)
+		munmap(m_base, m_size);
+	if (m_fd >= 0)
+		close(m_fd);
+	if (m_owner)
+		shm_unlink(m_name.c_str());
+	m_fd = -1;
+#endif
+	m_base = NULL;
+	m_size = 0;
+	m_owner = false;
+}
+
+// ======================================================================================
+bool ShmRingWriter::Create(const char* name, unsigned slots, size_t slotBytes, std::string& error)
+{
+	m_slots = (slots < 2) ? 2 : slots;
+	m_slotBytes = slotBytes;
+	m_stride = (sizeof(Slot) + slotBytes + 63) & ~(size_t)63;
+	if (!Map(name, true, s_headerBytes + m_slots * m_stride, error))
+		return false;
+
+	// New mappings are zero filled, no slot is complete.
+	Header* head = Head();
+	head->version = SHM_VERSION;
+	head->slots = (uint32_t)m_slots;
+	head->slotBytes = m_slotBytes;
+	head->stride = m_stride;
+	head->latest.store(0, std::memory_order_relaxed);
+	head->magic.store(SHM_MAGIC, std::memory_order_release);
+	return true;
+}
+
+// ======================================================================================
+void ShmRingWriter::Publish(uint64_t tick, unsigned long exitCode, const char* frame, size_t len)
+{
+	bool truncated = len > m_slotBytes;
+	if (truncated)
+	{
+		const char* eol = frame + m_slotBytes;
+		while (eol != frame && eol[-1] != '\n')
+			eol--;
+		len = (eol != frame) ? eol - frame : m_slotBytes;
+	}
+	uint64_t timeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	uint64_t seq = ++m_seq;
+	Slot* slot = GetSlot(seq);
+	slot->seq.store(seq * 2 - 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);	// odd before the data changes
+	slot->tick.store(tick, std::memory_order_relaxed);
+	slot->timeMs.store(timeMs, std::memory_order_relaxed);
+	slot->exitCode.store(exitCode, std::memory_order_relaxed);
+	slot->len.store(len, std::memory_order_relaxed);
+	slot->truncated.store(truncated ? 1 : 0, std::memory_order_relaxed);
+	memcpy((char*)(slot + 1), frame, len);
+	slot->seq.store(seq * 2, std::memory_order_release);
+	Head()->latest.store(seq, std::memory_order_release);
+}
+
+// ======================================================================================
+bool ShmRingReader::Open(const char* name, std::string& error)
+{
+	if (!Map(name, false, 0, error))
+		return false;
+	const Header* head = Head();
+	if (head->magic.load(std::memory_order_acquire) != SHM_MAGIC || head->version != SHM_VERSION)
+	{
+		error = m_name + " is not a llwatch frame ring (or not ready)";
+		return false;
+	}
+	m_slots = head->slots;
+	m_slotBytes = (size_t)head->slotBytes;
+	m_stride = (size_t)head->stride;
+	if (m_slots == 0 || s_headerBytes + m_slots * m_stride > m_size || m_stride < sizeof(Slot) + m_slotBytes)
+	{
+		error = m_name + " has a bad layout";
+		return false;
+	}
+	return true;
+}
+
+// ======================================================================================
+// Seqlock read: the slot must hold the newest frame number before and after the copy.
+bool ShmRingReader::ReadLatest(ShmFrame& frame, uint64_t afterSeq)
+{
+	const Header* head = Head();
+	for (;;)
+	{
+		uint64_t seq = head->latest.load(std::memory_order_acquire);
+		if (seq == 0 || seq <= afterSeq)
+			return false;
+
+		const Slot* slot = GetSlot(seq);
+		if (slot->seq.load(std::memory_order_acquire) != seq * 2)
+		{
+			m_retries++;		// rewritten since, latest moved on
+			continue;
+		}
+		uint64_t tick = slot->tick.load(std::memory_order_relaxed);
+		uint64_t timeMs = slot->timeMs.load(std::memory_order_relaxed);
+		uint64_t exitCode = slot->exitCode.load(std::memory_order_relaxed);
+		uint64_t len = slot->len.load(std::memory_order_relaxed);
+		uint64_t truncated = slot->truncated.load(std::memory_order_relaxed);
+		if (len > m_slotBytes)
+			len = m_slotBytes;		// torn metadata, rejected below
+		frame.data.assign((const char*)(slot + 1), (size_t)len);
+		std::atomic_thread_fence(std::memory_order_acquire);	// copy before the recheck
+		if (slot->seq.load(std::memory_order_relaxed) != seq * 2)
+		{
+			m_retries++;
+			continue;
+		}
+
+		frame.seq = seq;
+		frame.tick = tick;
+		frame.timeMs = timeMs;
+		frame.exitCode = (unsigned long)exitCode;
+		frame.truncated = truncated != 0;
+		return true;
+	}
+}
@@ -0,0 +1,142 @@
+// ------------------------------------------------------------------------------------------------
+// ShmRing.h - Newest frames in shared memory
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+
+#pragma once
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// ======================================================================================
+// Newest frames of llwatch in shared memory (llwatch --shm <name>) for local readers
+// which want them without a socket or parsing. The region is a header and a ring of
+// fixed size slots, each guarded by a sequence number (seqlock): odd while the writer
+// fills the slot, 2 x frame number once complete. The writer never waits for readers.
+// A reader copies the newest slot and keeps the copy only if the slot's sequence number
+// did not change meanwhile, so it only retries if the writer went all the way around
+// the ring while it was copying. Any number of readers, one writer.
+//
+// The name is a POSIX shared memory object (/llwatch-<name>) or a Windows file mapping
+// (Local\llwatch-<name>). Reader use:
+//   ShmRingReader reader;
+//   ShmFrame frame;
+//   if (reader.Open("top", error))
+//       while (...) if (reader.ReadLatest(frame, frame.seq)) Show(frame.data);
+
+// Frame copied out of the ring.
+struct ShmFrame
+{
+	ShmFrame() : seq(0), tick(0), timeMs(0), exitCode(0), truncated(false) { }
+
+	uint64_t seq;			// frame number, 1 for the first published
+	uint64_t tick;			// llwatch run
+	uint64_t timeMs;		// published, ms since the epoch (UTC)
+	unsigned long exitCode;
+	bool     truncated;		// larger than a slot, cut after the last line which fit
+	std::string data;
+};
+
+// Mapping shared by writer and reader.
+class ShmRing
+{
+public:
+	static const unsigned DEFAULT_SLOTS = 4;
+
+	size_t Slots() const
+	{ return m_slots; }
+
+	size_t SlotBytes() const
+	{ return m_slotBytes; }
+
+protected:
+	ShmRing();
+	~ShmRing();
+
+	bool Map(const char* name, bool create, size_t size, std::string& error);
+	void Close();
+	struct Header* Head() const
+	{ return (struct Header*)m_base; }
+	struct Slot* GetSlot(uint64_t seq) const;
+
+	char*  m_base;
+	size_t m_size;
+	size_t m_slots;
+	size_t m_slotBytes;
+	size_t m_stride;			// slot header + data, cache line aligned
+	bool   m_owner;				// writer, removes the name
+	std::string m_name;
+#ifdef _WIN32
+	HANDLE m_mapping;
+#else
+	int    m_fd;
+#endif
+
+private:
+	ShmRing(const ShmRing&);
+	ShmRing& operator=(const ShmRing&);
+};
+
+// ======================================================================================
+class ShmRingWriter : public ShmRing
+{
+public:
+	ShmRingWriter() : m_seq(0) { }
+
+	// Create (or replace) name with slots of slotBytes each.
+	bool Create(const char* name, unsigned slots, size_t slotBytes, std::string& error);
+
+	// Copy frame into the next slot and make it the newest.
+	void Publish(uint64_t tick, unsigned long exitCode, const char* frame, size_t len);
+
+	uint64_t Seq() const
+	{ return m_seq; }
+
+private:
+	uint64_t m_seq;
+};
+
+// ======================================================================================
+class ShmRingReader : public ShmRing
+{
+public:
+	ShmRingReader() : m_retries(0) { }
+
+	bool Open(const char* name, std::string& error);
+
+	// Copy the newest complete frame if it is newer than afterSeq, false if there is none.
+	bool ReadLatest(ShmFrame& frame, uint64_t afterSeq = 0);
+
+	uint64_t m_retries;			// copies discarded because the slot was rewritten
+};
@@ -0,0 +1,192 @@
+// ------------------------------------------------------------------------------------------------
+// ThreadPool.cpp - Work stealing thread pool
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+
+#include "ThreadPool.h"
+
+// Pool and deque index of the worker running on this thread.
+static thread_local ThreadPool* s_workerPool = NULL;
+static thread_local int s_workerIdx = -1;
+
+// ======================================================================================
+ThreadPool::ThreadPool(unsigned workers) :
+	m_queued(0),
+	m_nextQueue(0),
+	m_stop(false)
+{
+	if (workers == 0)
+	{
+		unsigned hwThreads = std::thread::hardware_concurrency();
+		workers = (hwThreads > 1) ? hwThreads - 1 : 1;
+	}
+
+	for (unsigned idx = 0; idx != workers; idx++)
+		m_queues.push_back(std::unique_ptr<Queue>(new Queue()));
+	for (unsigned idx = 0; idx != workers; idx++)
+		m_threads.push_back(std::thread(&ThreadPool::WorkerLoop, this, idx));
+}
+
+// ======================================================================================
+// Queued tasks are run before the workers exit.
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (size_t idx = 0; idx != m_threads.size(); idx++)
+		m_threads[idx].join();
+}
+
+// ======================================================================================
+void ThreadPool::Submit(const Task& task)
+{
+	unsigned qIdx = (s_workerPool == this) ?
+		(unsigned)s_workerIdx : m_nextQueue++ % (unsigned)m_queues.size();
+	{
+		std::lock_guard<std::mutex> lock(m_queues[qIdx]->mutex);
+		m_queues[qIdx]->tasks.push_back(task);
+	}
+	{
+		// Count under the wake lock so a worker about to sleep sees it.
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+		m_queued++;
+	}
+	m_wake.notify_one();
+}
+
+// ======================================================================================
+// Newest task of own deque (self < 0 for a non worker), else steal oldest of another.
+bool ThreadPool::PopTask(int self, Task& task)
+{
+	size_t qCnt = m_queues.size();
+	if (self >= 0)
+	{
+		Queue& queue = *m_queues[self];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			task.swap(queue.tasks.back());
+			queue.tasks.pop_back();
+			m_queued--;
+			return true;
+		}
+	}
+
+	size_t first = (self >= 0) ? self + 1 : 0;
+	for (size_t cnt = 0; cnt != qCnt; cnt++)
+	{
+		Queue& queue = *m_queues[(first + cnt) % qCnt];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			task.swap(queue.tasks.front());
+			queue.tasks.pop_front();
+			m_queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+// ======================================================================================
+void ThreadPool::WorkerLoop(unsigned idx)
+{
+	s_workerPool = this;
+	s_workerIdx = (int)idx;
+
+	Task task;
+	for (;;)
+	{
+		if (PopTask((int)idx, task))
+		{
+			task();
+			task = Task();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_wakeMutex);
+		m_wake.wait(lock, [this]() { return m_stop || m_queued != 0; });
+		if (m_stop && m_queued == 0)
+			return;
+	}
+}
+
+// ======================================================================================
+void ThreadPool::ParallelFor(size_t count, const std::function<void (size_t)>& fn)
+{
+	if (count == 0)
+		return;
+	if (count == 1)
+	{
+		fn(0);
+		return;
+	}
+
+	struct Latch
+	{
+		std::atomic<size_t> remaining;
+		std::mutex mutex;
+		std::condition_variable done;
+	};
+	std::shared_ptr<Latch> latch(new Latch());
+	latch->remaining = count;
+
+	// Caller keeps index 0, others are queued for the workers.
+	for (size_t idx = 1; idx != count; idx++)
+	{
+		Submit([latch, &fn, idx]()
+			{
+				fn(idx);
+				if (--latch->remaining == 0)
+				{
+					std::lock_guard<std::mutex> lock(latch->mutex);
+					latch->done.notify_all();
+				}
+			});
+	}
+
+	fn(0);
+	latch->remaining--;
+
+	// Help with queued tasks (possibly of other callers), then wait for running ones.
+	int self = (s_workerPool == this) ? s_workerIdx : -1;
+	Task task;
+	while (latch->remaining != 0 && PopTask(self, task))
+	{
+		task();
+		task = Task();
+	}
+
+	std::unique_lock<std::mutex> lock(latch->mutex);
+	latch->done.wait(lock, [&latch]() { return latch->remaining == 0; });
+}
@@ -0,0 +1,87 @@
+// ------------------------------------------------------------------------------------------------
+// ThreadPool.h - Work stealing thread pool
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ======================================================================================
+// Fixed set of worker threads, each with its own task deque. A worker runs its newest
+// task first and, when its deque is empty, steals the oldest task of another worker,
+// so uneven chunks (ex: lines which need many regex replacements) balance out.
+// Idle workers sleep on a condition variable.
+class ThreadPool
+{
+public:
+	typedef std::function<void ()> Task;
+
+	// workers, 0 for one less than the hardware threads (caller of ParallelFor helps).
+	explicit ThreadPool(unsigned workers = 0);
+	~ThreadPool();
+
+	// Worker threads, not counting the caller.
+	unsigned Workers() const
+	{ return (unsigned)m_threads.size(); }
+
+	// Queue task, from a worker it goes to its own deque otherwise round robin.
+	void Submit(const Task& task);
+
+	// Run fn(idx) for idx 0..count-1, caller runs or steals tasks until all are done.
+	void ParallelFor(size_t count, const std::function<void (size_t)>& fn);
+
+private:
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	bool PopTask(int self, Task& task);
+	void WorkerLoop(unsigned idx);
+
+	std::vector<std::unique_ptr<Queue> > m_queues;
+	std::vector<std::thread> m_threads;
+	std::mutex m_wakeMutex;
+	std::condition_variable m_wake;
+	std::atomic<size_t> m_queued;		// tasks in all deques
+	std::atomic<unsigned> m_nextQueue;
+	bool m_stop;
+};
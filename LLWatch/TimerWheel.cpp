@@ -0,0 +1,141 @@
+// ------------------------------------------------------------------------------------------------
+// TimerWheel.cpp - Hierarchical timer wheel
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+
+#include "TimerWheel.h"
+
+// ======================================================================================
+TimerWheel::TimerWheel(unsigned capacity) :
+	m_now(0),
+	m_count(0),
+	m_next(capacity, NONE),
+	m_expire(capacity, UNUSED)
+{
+	for (unsigned level = 0; level != LEVELS; level++)
+	{
+		m_levelCnt[level] = 0;
+		for (unsigned slot = 0; slot != SLOTS; slot++)
+			m_slots[level][slot] = NONE;
+	}
+}
+
+// ======================================================================================
+bool TimerWheel::Schedule(unsigned id, Tick delay)
+{
+	if (id >= m_expire.size() || m_expire[id] != UNUSED)
+		return false;
+	delay = (delay < 1) ? 1 : (delay > MaxDelay ? MaxDelay : delay);
+	m_expire[id] = m_now + delay;
+	Insert(id);
+	m_count++;
+	return true;
+}
+
+// ======================================================================================
+// Level is picked by distance to expiry, slot by the expiry bits of that level.
+// The slot comes up (is cascaded or fires) no later than the expiry tick.
+void TimerWheel::Insert(unsigned id)
+{
+	Tick delta = m_expire[id] - m_now;
+	unsigned level = 0;
+	while (level + 1 != LEVELS && delta >= ((Tick)1 << (SLOT_BITS * (level + 1))))
+		level++;
+	unsigned slot = (unsigned)(m_expire[id] >> (SLOT_BITS * level)) & (SLOTS - 1);
+	m_next[id] = m_slots[level][slot];
+	m_slots[level][slot] = id;
+	m_levelCnt[level]++;
+}
+
+// ======================================================================================
+// Move the ids of the slot coming up at this level to finer levels.
+void TimerWheel::Cascade(unsigned level)
+{
+	unsigned slot = (unsigned)(m_now >> (SLOT_BITS * level)) & (SLOTS - 1);
+	unsigned id = m_slots[level][slot];
+	m_slots[level][slot] = NONE;
+	while (id != NONE)
+	{
+		unsigned next = m_next[id];
+		m_levelCnt[level]--;
+		Insert(id);
+		id = next;
+	}
+}
+
+// ======================================================================================
+void TimerWheel::Advance(Tick to, std::vector<unsigned>& expired)
+{
+	while (m_now < to)
+	{
+		if (m_count == 0)
+		{
+			m_now = to;
+			break;
+		}
+		m_now++;
+
+		// Coarser levels first, their ids may land in the slot firing now.
+		unsigned level = 1;
+		while (level != LEVELS && (m_now & (((Tick)1 << (SLOT_BITS * level)) - 1)) == 0)
+			level++;
+		while (--level != 0)
+			Cascade(level);
+
+		unsigned slot = (unsigned)m_now & (SLOTS - 1);
+		unsigned id = m_slots[0][slot];
+		m_slots[0][slot] = NONE;
+		while (id != NONE)
+		{
+			unsigned next = m_next[id];
+			m_next[id] = NONE;
+			m_expire[id] = UNUSED;
+			m_levelCnt[0]--;
+			m_count--;
+			expired.push_back(id);
+			id = next;
+		}
+	}
+}
+
+// ======================================================================================
+// Level 0 holds everything due before the next cascade, which may bring in more.
+TimerWheel::Tick TimerWheel::TicksToNext() const
+{
+	if (m_count == 0)
+		return 0;
+	Tick limit = (m_count != m_levelCnt[0]) ? SLOTS - (m_now & (SLOTS - 1)) : SLOTS - 1;
+	for (Tick ticks = 1; ticks < limit; ticks++)
+	{
+		if (m_slots[0][(unsigned)(m_now + ticks) & (SLOTS - 1)] != NONE)
+			return ticks;
+	}
+	return limit;
+}
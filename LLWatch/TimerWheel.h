@@ -0,0 +1,93 @@
+// ------------------------------------------------------------------------------------------------
+// TimerWheel.h - Hierarchical timer wheel
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// ======================================================================================
+// Hierarchical timer wheel (4 levels of 64 slots) of integer ids, ex: daemon jobs.
+// Time is counted in ticks of the caller's choosing. Schedule and expiry are O(1),
+// a timer far in the future is cascaded to a finer level when its slot comes up, at
+// most once per level. Level 0 spans 64 ticks, level 3 about 16.7 million ticks.
+// Each id is in the wheel at most once, entries are linked through per id arrays so
+// the wheel never allocates after construction. Not thread safe.
+class TimerWheel
+{
+public:
+	typedef uint64_t Tick;
+
+	// Ids 0..capacity-1 can be scheduled.
+	explicit TimerWheel(unsigned capacity);
+
+	// Current time, advanced by Advance.
+	Tick Now() const
+	{ return m_now; }
+
+	// Expire id delay ticks from now (at least 1, at most MaxDelay).
+	// Returns false if id is already scheduled or out of range.
+	bool Schedule(unsigned id, Tick delay);
+
+	bool IsScheduled(unsigned id) const
+	{ return id < m_expire.size() && m_expire[id] != UNUSED; }
+
+	// Step to tick 'to', appending expired ids to 'expired'.
+	void Advance(Tick to, std::vector<unsigned>& expired);
+
+	// Ticks from now until the next expiry or cascade, 0 if nothing is scheduled.
+	// A sleeping caller can wait this long without missing an expiry.
+	Tick TicksToNext() const;
+
+	// Scheduled ids.
+	unsigned Count() const
+	{ return m_count; }
+
+	static const unsigned LEVELS = 4;
+	static const unsigned SLOT_BITS = 6;
+	static const unsigned SLOTS = 1u << SLOT_BITS;
+	static const Tick MaxDelay = ((Tick)1 << (SLOT_BITS * LEVELS)) - 1;
+
+private:
+	static const unsigned NONE = ~0u;
+	static const Tick UNUSED = ~(Tick)0;
+
+	void Insert(unsigned id);
+	void Cascade(unsigned level);
+
+	Tick m_now;
+	unsigned m_count;
+	unsigned m_slots[LEVELS][SLOTS];	// first id in slot, NONE if empty
+	unsigned m_levelCnt[LEVELS];		// ids per level
+	std::vector<unsigned> m_next;		// next id in the same slot
+	std::vector<Tick> m_expire;			// expiry tick, UNUSED if not scheduled
+};
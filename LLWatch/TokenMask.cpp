@@ -0,0 +1,121 @@
+// ------------------------------------------------------------------------------------------------
+// TokenMask.cpp - Mask volatile tokens out of frame comparisons
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+#include "TokenMask.h"
+
+#include <string.h>
+
+// Preset rules, @name.
+static const struct
+{
+	const char* name;
+	const char* pattern;
+} s_presets[] =
+{
+	{ "@time", "\\b\\d{1,2}:\\d{2}(:\\d{2}([.,]\\d+)?)?\\b" },
+	{ "@date", "\\b\\d{4}-\\d{2}-\\d{2}\\b|\\b\\d{1,2}/\\d{1,2}/\\d{2,4}\\b" },
+	{ "@number", "\\d+(\\.\\d+)?" },
+	{ "@hex", "\\b(0x)?[0-9a-fA-F]{8,}\\b" },
+	{ "@uuid", "\\b[0-9a-fA-F]{8}-[0-9a-fA-F]{4}-[0-9a-fA-F]{4}-[0-9a-fA-F]{4}-[0-9a-fA-F]{12}\\b" },
+};
+
+// ======================================================================================
+TokenMask::TokenMask()
+{ }
+
+// ======================================================================================
+bool TokenMask::Add(const std::string& pattern, std::string& error)
+{
+	std::string rule = pattern;
+	if (!pattern.empty() && pattern[0] == '@')
+	{
+		rule.clear();
+		for (size_t idx = 0; idx != sizeof(s_presets) / sizeof(s_presets[0]); idx++)
+		{
+			if (pattern == s_presets[idx].name)
+				rule = s_presets[idx].pattern;
+		}
+		if (rule.empty())
+		{
+			error = "unknown mask preset " + pattern + ", use @time @date @number @hex or @uuid";
+			return false;
+		}
+	}
+	else if (pattern.empty())
+	{
+		error = "empty mask pattern";
+		return false;
+	}
+
+	// Each rule checked on its own so the error names it, then all rules compiled once
+	// as one pattern.
+	std::string all;
+	try
+	{
+		std::regex check(rule);
+		for (size_t idx = 0; idx != m_rules.size(); idx++)
+			all += "(?:" + m_rules[idx] + ")|";
+		all += "(?:" + rule + ")";
+		m_pattern = std::regex(all, std::regex::ECMAScript | std::regex::optimize);
+	}
+	catch (const std::regex_error& ex)
+	{
+		error = "bad mask pattern " + pattern + ", " + ex.what();
+		return false;
+	}
+	m_names.push_back(pattern);
+	m_rules.push_back(rule);
+	return true;
+}
+
+// ======================================================================================
+void TokenMask::AppendKey(const char* data, size_t len, lstring& key) const
+{
+	size_t base = key.length();
+	key.append(data, len);
+	if (m_rules.empty())
+		return;
+
+	const char* end = data + len;
+	const char* line = data;
+	while (line != end)
+	{
+		const char* eol = (const char*)memchr(line, '\n', end - line);
+		if (eol == NULL)
+			eol = end;
+		std::cregex_iterator match(line, eol, m_pattern);
+		for (; match != std::cregex_iterator(); ++match)
+		{
+			if (match->length(0) != 0)
+				memset(&key[base + (line - data) + match->position(0)], MASK_CHAR, match->length(0));
+		}
+		line = (eol == end) ? end : eol + 1;
+	}
+}
@@ -0,0 +1,80 @@
+// ------------------------------------------------------------------------------------------------
+// TokenMask.h - Mask volatile tokens out of frame comparisons
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "llstring.h"
+
+#include <regex>
+#include <string>
+#include <vector>
+
+// ======================================================================================
+// Volatile token masking (llwatch --mask, daemon 'mask ='). Tokens matching a rule,
+// like timestamps and counters, are overwritten in the comparison key of a frame so
+// they do not count as changes, the frame itself is still written with its real text.
+//
+// The key has the length of the text (each masked character becomes MASK_CHAR) so it
+// is compared at the same offsets as the text. A token which changes width still
+// shifts the rest of its line. Rules are joined into one pattern compiled as they
+// are added, the key is built line by line so ^ and $ match at line ends.
+class TokenMask
+{
+public:
+	static const char MASK_CHAR = '#';
+
+	TokenMask();
+
+	// Add a regex or a preset, @time @date @number @hex or @uuid.
+	// False with error set if the pattern is bad.
+	bool Add(const std::string& pattern, std::string& error);
+
+	bool Empty() const
+	{ return m_rules.empty(); }
+
+	// Rules as given, presets by name.
+	const std::vector<std::string>& Rules() const
+	{ return m_names; }
+
+	// Append the key of text [data, data+len).
+	void AppendKey(const char* data, size_t len, lstring& key) const;
+
+	// Key of a whole frame.
+	void Key(const char* data, size_t len, lstring& key) const
+	{
+		key.clear();
+		AppendKey(data, len, key);
+	}
+
+private:
+	std::vector<std::string> m_names;
+	std::vector<std::string> m_rules;	// presets expanded
+	std::regex m_pattern;				// rules as one alternation
+};
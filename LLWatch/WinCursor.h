@@ -30,7 +30,12 @@
 
 #pragma once
 
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
 #include <iostream>
 #include <string>
 
@@ -43,15 +48,41 @@ class WinCursor
 
 	static void SetCursorPosition(uint x, uint y)
 	{
+#ifdef _WIN32
 		HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
 		COORD pos = { (SHORT)x, (SHORT)y };
 
 		SetConsoleCursorPosition(output, pos);
+#else
+		std::cout << "\033[" << (y + 1) << ";" << (x + 1) << "H" << std::flush;
+#endif
+	}
+
+	// Visible console window size, false if output is not a console.
+	static bool GetConsoleSize(uint& cols, uint& rows)
+	{
+#ifdef _WIN32
+		CONSOLE_SCREEN_BUFFER_INFO info;
+		if (!GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info))
+			return false;
+		cols = info.srWindow.Right - info.srWindow.Left + 1;
+		rows = info.srWindow.Bottom - info.srWindow.Top + 1;
+#else
+		struct winsize winSize;
+		if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &winSize) != 0 || winSize.ws_col == 0)
+			return false;
+		cols = winSize.ws_col;
+		rows = winSize.ws_row;
+#endif
+		return true;
 	}
 
 	static void ClearScreen(const std::string& ch)
 	{
-#if 1
+#ifndef _WIN32
+		(void)ch;
+		std::cout << "\033[2J\033[H" << std::flush;
+#elif 1
 		system("cls");
 #else
 		HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
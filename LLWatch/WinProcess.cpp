@@ -31,12 +31,38 @@
 #include "WinProcess.h"
 
 #include <Windows.h>
+#include <psapi.h>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <string>
 #include <stdio.h> 
 #include <strsafe.h>
+#include <thread>
 
-const unsigned int BUFSIZE = 4096;
+const unsigned int BUFSIZE = 65536;
+const DWORD PIPE_SIZE = 1 << 20;		// fewer child stalls on chatty commands
+
+#ifndef PROC_THREAD_ATTRIBUTE_PSEUDOCONSOLE
+#define PROC_THREAD_ATTRIBUTE_PSEUDOCONSOLE 0x00020016
+#endif
+
+// ConPTY is only present on Windows 10 1809 and newer, resolve it at run time.
+typedef HRESULT (WINAPI *CreatePseudoConsoleFn)(COORD size, HANDLE hInput, HANDLE hOutput, DWORD flags, HANDLE* phPC);
+typedef void (WINAPI *ClosePseudoConsoleFn)(HANDLE hPC);
+static CreatePseudoConsoleFn s_createPseudoConsole = NULL;
+static ClosePseudoConsoleFn s_closePseudoConsole = NULL;
+
+static bool LoadPseudoConsoleApi()
+{
+	if (s_createPseudoConsole == NULL)
+	{
+		HMODULE kernel = GetModuleHandleA("kernel32.dll");
+		s_createPseudoConsole = (CreatePseudoConsoleFn)GetProcAddress(kernel, "CreatePseudoConsole");
+		s_closePseudoConsole = (ClosePseudoConsoleFn)GetProcAddress(kernel, "ClosePseudoConsole");
+	}
+	return s_createPseudoConsole != NULL && s_closePseudoConsole != NULL;
+}
 
 // ======================================================================================
 bool WinProcess::Init(void)
@@ -50,7 +76,7 @@ bool WinProcess::Init(void)
 
 	// Create a pipe for the child process's STDOUT. 
 	HANDLE rd, wrt;
-	if (!CreatePipe(&rd, &wrt, &saAttr, 0))
+	if (!CreatePipe(&rd, &wrt, &saAttr, PIPE_SIZE))
 		ErrorExit("StdoutRd CreatePipe");
 	m_hChildStd_OUT_Rd = rd;
 	m_hChildStd_OUT_Wr = wrt;
@@ -76,13 +102,62 @@ bool WinProcess::Init(void)
 }
 
 // ======================================================================================
-// Has statics - not thread safe.
-const char* WinProcess::GetRunExtension(std::string& exeName)
+// Pseudo console in place of the STDOUT/STDIN pipes, child sees a terminal.
+bool WinProcess::InitPty(void)
+{
+	if (!LoadPseudoConsoleApi())
+	{
+		std::cerr << "--pty requires Windows 10 1809 or newer (ConPTY)\n";
+		return false;
+	}
+
+	// Pipes are not inherited, the pseudo console duplicates its ends.
+	HANDLE inRd, inWr, outRd, outWr;
+	if (!CreatePipe(&inRd, &inWr, NULL, 0))
+		ErrorExit("Pty CreatePipe");
+	if (!CreatePipe(&outRd, &outWr, NULL, 0))
+		ErrorExit("Pty CreatePipe");
+	m_hChildStd_IN_Wr = inWr;
+	m_hChildStd_OUT_Rd = outRd;
+	Hnd ptyIn(inRd);
+	Hnd ptyOut(outWr);
+
+	COORD size = { (SHORT)m_ptyCols, (SHORT)m_ptyRows };
+	HRESULT result = s_createPseudoConsole(size, ptyIn, ptyOut, 0, &m_hPty);
+	if (FAILED(result))
+	{
+		m_hPty = NULL;
+		std::cerr << "CreatePseudoConsole failed with error " << result << std::endl;
+		return false;
+	}
+
+	DWORD pipeMode = PIPE_READMODE_BYTE | PIPE_NOWAIT;
+	if (!SetNamedPipeHandleState(m_hChildStd_OUT_Rd, &pipeMode, NULL, NULL))
+		ErrorExit("Pty SetNamedPipeHandleState");
+
+	m_vtState = 0;
+	return true;
+}
+
+// Extension found for each executable name, shared by all processes (dashboard panes
+// start commands from several threads).
+static std::mutex s_extnMutex;
+static std::map<std::string, const char*> s_extnCache;
+
+// Handles created inheritable for one child must not leak into a child started by
+// another thread, pipe creation through CreateProcess is serialized.
+static std::mutex s_spawnMutex;
+
+// ======================================================================================
+// Thread safe, results (including not found) are cached.
+const char* WinProcess::GetRunExtension(const std::string& exeName)
 {
-	// Cache results - return previous match
-	if (m_lastExeName == exeName)
-		return m_extn;
-	m_lastExeName = exeName;
+	{
+		std::lock_guard<std::mutex> lock(s_extnMutex);
+		std::map<std::string, const char*>::const_iterator iter = s_extnCache.find(exeName);
+		if (iter != s_extnCache.end())
+			return iter->second;
+	}
 
 	/*
 	static char ext[_MAX_EXT];
@@ -95,15 +170,20 @@ const char* WinProcess::GetRunExtension(std::string& exeName)
 	// Expensive - search PATH for executable.
 	char fullPath[MAX_PATH];
 	static const char* s_extns[] = { NULL, ".exe", ".com", ".cmd", ".bat", ".ps" };
+	const char* extn = NULL;
 	for (unsigned idx = 0; idx != ARRAYSIZE(s_extns); idx++)
 	{
-		m_extn = s_extns[idx];
-		DWORD foundPathLen = SearchPath(NULL, exeName.c_str(), m_extn, ARRAYSIZE(fullPath), fullPath, NULL);
+		DWORD foundPathLen = SearchPath(NULL, exeName.c_str(), s_extns[idx], ARRAYSIZE(fullPath), fullPath, NULL);
 		if (foundPathLen != 0)
-			return m_extn;
+		{
+			extn = s_extns[idx];
+			break;
+		}
 	}
 
-	return NULL;
+	std::lock_guard<std::mutex> lock(s_extnMutex);
+	s_extnCache[exeName] = extn;
+	return extn;
 }
 
 // ======================================================================================
@@ -136,9 +216,14 @@ std::string WinProcess::GetRunCommand(std::string& fullCommand, const std::strin
 
 // ======================================================================================
 // Create a child process that uses the previously created pipes for STDIN and STDOUT.
-void WinProcess::CreateChildProcess(const std::string& rawCommandLine, unsigned long waitMsec)
+bool WinProcess::CreateChildProcess(const std::string& rawCommandLine, unsigned long waitMsec)
 {
-	Init();
+	std::unique_lock<std::mutex> spawnLock(s_spawnMutex);
+	StartClock();
+	if (!m_usePty)
+		Init();
+	else if (!InitPty())
+		return false;
 
 	std::string commandLine;
 	GetRunCommand(commandLine, rawCommandLine);
@@ -158,22 +243,104 @@ void WinProcess::CreateChildProcess(const std::string& rawCommandLine, unsigned
 	m_siStartInfo.hStdInput = m_hChildStd_IN_Rd;
 	m_siStartInfo.dwFlags |= STARTF_USESTDHANDLES;
 
+	// Passthrough, child writes straight to our stdout, nothing to copy.
+	// Capture file, child writes to the file.
+	m_outInherited = false;
+	HANDLE stdOut = GetStdHandle(STD_OUTPUT_HANDLE);
+	if (!m_captureFile.empty() && !m_usePty)
+	{
+		SECURITY_ATTRIBUTES saAttr;
+		saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
+		saAttr.bInheritHandle = TRUE;
+		saAttr.lpSecurityDescriptor = NULL;
+		HANDLE fileOut = CreateFileA(m_captureFile.c_str(), GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, &saAttr,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, NULL);
+		if (fileOut == INVALID_HANDLE_VALUE)
+		{
+			std::cerr << "Failed to create " << m_captureFile << std::endl;
+			return false;
+		}
+		m_hStdOutDup = fileOut;
+		m_siStartInfo.hStdError = m_hStdOutDup;
+		m_siStartInfo.hStdOutput = m_hStdOutDup;
+		m_outInherited = true;
+	}
+	else if (m_passthrough && !m_usePty && stdOut != INVALID_HANDLE_VALUE && stdOut != NULL)
+	{
+		HANDLE dupOut;
+		if (DuplicateHandle(GetCurrentProcess(), stdOut, GetCurrentProcess(), &dupOut, 0, TRUE, DUPLICATE_SAME_ACCESS))
+		{
+			m_hStdOutDup = dupOut;
+			m_siStartInfo.hStdError = m_hStdOutDup;
+			m_siStartInfo.hStdOutput = m_hStdOutDup;
+			m_outInherited = true;
+		}
+	}
+
+	// Pseudo console child attaches through the attribute list, nothing is inherited.
+	STARTUPINFOEXA siStartInfoEx;
+	STARTUPINFOA* pStartInfo = &m_siStartInfo;
+	BOOL inheritHandles = TRUE;
+	DWORD createFlags = 0;
+	if (m_hPty != NULL)
+	{
+		ZeroMemory(&siStartInfoEx, sizeof(siStartInfoEx));
+		siStartInfoEx.StartupInfo.cb = sizeof(siStartInfoEx);
+
+		SIZE_T attrSize = 0;
+		InitializeProcThreadAttributeList(NULL, 1, 0, &attrSize);
+		m_attrList.resize(attrSize);
+		siStartInfoEx.lpAttributeList = (LPPROC_THREAD_ATTRIBUTE_LIST)&m_attrList[0];
+		InitializeProcThreadAttributeList(siStartInfoEx.lpAttributeList, 1, 0, &attrSize);
+		UpdateProcThreadAttribute(siStartInfoEx.lpAttributeList, 0,
+			PROC_THREAD_ATTRIBUTE_PSEUDOCONSOLE, m_hPty, sizeof(m_hPty), NULL, NULL);
+
+		pStartInfo = &siStartInfoEx.StartupInfo;
+		inheritHandles = FALSE;
+		createFlags = EXTENDED_STARTUPINFO_PRESENT;
+	}
+	else if (m_headless)
+	{
+		createFlags = CREATE_NO_WINDOW;
+	}
+	if (m_limits.Any())
+		createFlags |= CREATE_SUSPENDED;	// runs once in its job, see StartInJob
+
 	// Create the child process. 
 	char* cmdPtr = (char*)commandLine.c_str();
 	bSuccess = CreateProcessA(NULL,
 		cmdPtr,			// command line 
 		NULL,          // process security attributes 
 		NULL,          // primary thread security attributes 
-		TRUE,          // handles are inherited 
-		0,             // creation flags 
+		inheritHandles, // handles are inherited 
+		createFlags,   // creation flags 
 		NULL,          // use parent's environment 
 		NULL,          // use parent's current directory 
-		&m_siStartInfo,  // STARTUPINFO pointer 
+		pStartInfo,    // STARTUPINFO pointer 
 		&m_piProcInfo);  // receives PROCESS_INFORMATION 
 
+	if (m_hPty != NULL)
+		DeleteProcThreadAttributeList(siStartInfoEx.lpAttributeList);
+	if (bSuccess && m_limits.Any())
+		StartInJob();
+
+	// Child has its own copy.
+	m_hStdOutDup.Close();
+
+	// Our copies of the child ends stay open, keep them out of later children.
+	if (!m_usePty)
+	{
+		SetHandleInformation(m_hChildStd_OUT_Wr, HANDLE_FLAG_INHERIT, 0);
+		SetHandleInformation(m_hChildStd_IN_Rd, HANDLE_FLAG_INHERIT, 0);
+	}
+	spawnLock.unlock();
+
 					   // If an error occurs, exit the application. 
 	if (!bSuccess)
 	{
+		if (m_headless)
+			return false;
 		ErrorExit("CreateProcess");
 		std::cerr << " Make sure you proceed command with --\n"
 			" And that executable is either in path or you specify \n"
@@ -194,13 +361,119 @@ void WinProcess::CreateChildProcess(const std::string& rawCommandLine, unsigned
 		CloseHandle(m_piProcInfo.hThread);
 #endif
 	}
+
+	return bSuccess != FALSE;
 }
 
 // ======================================================================================
 void WinProcess::CloseProcess()
 {
+	if (m_hPty != NULL)
+	{
+		// Output not read, close our end first so the pseudo console does not block.
+		m_hChildStd_OUT_Rd.Close();
+		s_closePseudoConsole(m_hPty);
+		m_hPty = NULL;
+	}
+	if (m_piProcInfo.hProcess != NULL)
+		ReadUsage();
 	CloseHandle(m_piProcInfo.hProcess);
 	CloseHandle(m_piProcInfo.hThread);
+	m_piProcInfo.hProcess = m_piProcInfo.hThread = NULL;
+
+	// Processes left in the job keep running, only the limits go away.
+	if (m_job != NULL)
+		CloseHandle(m_job);
+	if (m_jobPort != NULL)
+		CloseHandle(m_jobPort);
+	m_job = m_jobPort = NULL;
+}
+
+// ======================================================================================
+// Child was created suspended, put it in a job with m_limits and let it run.
+// Its children join the job too. Limit breaches are posted to m_jobPort.
+void WinProcess::StartInJob()
+{
+	JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+	ZeroMemory(&limits, sizeof(limits));
+	JOBOBJECT_BASIC_LIMIT_INFORMATION& basic = limits.BasicLimitInformation;
+	if (m_limits.nice != 0)
+	{
+		basic.LimitFlags |= JOB_OBJECT_LIMIT_PRIORITY_CLASS;
+		basic.PriorityClass = (m_limits.nice < 10) ? BELOW_NORMAL_PRIORITY_CLASS : IDLE_PRIORITY_CLASS;
+	}
+	if (m_limits.affinity != 0)
+	{
+		basic.LimitFlags |= JOB_OBJECT_LIMIT_AFFINITY;
+		basic.Affinity = (ULONG_PTR)m_limits.affinity;
+	}
+	if (m_limits.cpuMs != 0)
+	{
+		basic.LimitFlags |= JOB_OBJECT_LIMIT_JOB_TIME;
+		basic.PerJobUserTimeLimit.QuadPart = (LONGLONG)m_limits.cpuMs * 10000;	// 100ns units
+	}
+	if (m_limits.memoryBytes != 0)
+	{
+		basic.LimitFlags |= JOB_OBJECT_LIMIT_JOB_MEMORY;
+		limits.JobMemoryLimit = (SIZE_T)m_limits.memoryBytes;
+	}
+
+	m_job = CreateJobObjectA(NULL, NULL);
+	m_jobPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+	JOBOBJECT_ASSOCIATE_COMPLETION_PORT port;
+	port.CompletionKey = m_job;
+	port.CompletionPort = m_jobPort;
+	bool limited = m_job != NULL && m_jobPort != NULL
+		&& SetInformationJobObject(m_job, JobObjectExtendedLimitInformation, &limits, sizeof(limits))
+		&& SetInformationJobObject(m_job, JobObjectAssociateCompletionPortInformation, &port, sizeof(port))
+		&& AssignProcessToJobObject(m_job, m_piProcInfo.hProcess);
+	if (!limited && !m_headless)
+		std::cerr << "Job limits not applied, error " << GetLastError() << std::endl;
+	ResumeThread(m_piProcInfo.hThread);
+}
+
+// ======================================================================================
+// FILETIME (100ns units) in milliseconds.
+static double FileTimeMs(const FILETIME& time)
+{
+	return (double)(((ULONGLONG)time.dwHighDateTime << 32) | time.dwLowDateTime) / 1e4;
+}
+
+// Times, peak working set and I/O of the child, wall time up to now if still running.
+void WinProcess::ReadUsage()
+{
+	FILETIME createTime, exitTime, kernelTime, userTime;
+	if (!GetProcessTimes(m_piProcInfo.hProcess, &createTime, &exitTime, &kernelTime, &userTime))
+		return;
+
+	m_usage.valid = true;
+	if (WaitForSingleObject(m_piProcInfo.hProcess, 0) == WAIT_OBJECT_0)
+		m_usage.wallMs = FileTimeMs(exitTime) - FileTimeMs(createTime);
+	else
+		m_usage.wallMs = std::chrono::duration<double, std::milli>(Clock::now() - m_startTime).count();
+	m_usage.userMs = FileTimeMs(userTime);
+	m_usage.kernelMs = FileTimeMs(kernelTime);
+
+	PROCESS_MEMORY_COUNTERS memory;
+	if (GetProcessMemoryInfo(m_piProcInfo.hProcess, &memory, sizeof(memory)))
+		m_usage.peakBytes = memory.PeakWorkingSetSize;
+	IO_COUNTERS io;
+	if (GetProcessIoCounters(m_piProcInfo.hProcess, &io))
+	{
+		m_usage.readBytes = io.ReadTransferCount;
+		m_usage.writeBytes = io.WriteTransferCount;
+	}
+
+	DWORD message;
+	ULONG_PTR key;
+	LPOVERLAPPED overlapped;
+	while (m_jobPort != NULL && GetQueuedCompletionStatus(m_jobPort, &message, &key, &overlapped, 0))
+	{
+		if (message == JOB_OBJECT_MSG_END_OF_JOB_TIME || message == JOB_OBJECT_MSG_END_OF_PROCESS_TIME)
+			m_usage.breached |= RunUsage::BREACH_CPU;
+		else if (message == JOB_OBJECT_MSG_JOB_MEMORY_LIMIT || message == JOB_OBJECT_MSG_PROCESS_MEMORY_LIMIT)
+			m_usage.breached |= RunUsage::BREACH_MEMORY;
+	}
 }
 
 // ======================================================================================
@@ -226,28 +499,38 @@ void WinProcess::WriteToPipe(HANDLE inFile)
 	m_hChildStd_IN_Wr.Close();
 }
 
+// ======================================================================================
+void WinProcess::ReadFromPipe(bool echo, std::string* pBuffer)
+{
+	ReadFromPipe(echo ? GetStdHandle(STD_OUTPUT_HANDLE) : INVALID_HANDLE_VALUE, pBuffer);
+}
+
 // ======================================================================================
 // Read output from the child process's pipe for STDOUT
 // and write to the parent process's pipe for STDOUT. 
 // Stop when there is no more data. 
 void WinProcess::ReadFromPipe(HANDLE outHnd, std::string* pBuffer)
 {
-	DWORD dwRead, dwWritten;
+	DWORD dwRead;
 	CHAR chBuf[BUFSIZE];
 	BOOL bSuccess = TRUE;
 	DWORD exitError = STILL_ACTIVE;
 	if (pBuffer)
 		pBuffer->clear();
+	m_bytesRead = 0;
+
+	if (m_outInherited)
+	{
+		// Passthrough or capture file, output did not use the pipe.
+		WaitForSingleObject(m_piProcInfo.hProcess, INFINITE);
+		exitError = 0;
+	}
 
 	while (exitError == STILL_ACTIVE)
 	{
 		bSuccess = ReadFile(m_hChildStd_OUT_Rd, chBuf, BUFSIZE, &dwRead, NULL);
 		if (bSuccess && dwRead != 0)
-		{
-			bSuccess = WriteFile(outHnd, chBuf, dwRead, &dwWritten, NULL);
-			if (pBuffer)
-				pBuffer->append(chBuf, chBuf + dwRead);
-		}
+			AppendOutput(chBuf, dwRead, outHnd, pBuffer);
 
 #if 0
 		exitError = WaitForSingleObject(m_piProcInfo.hProcess, 1000);
@@ -262,10 +545,96 @@ void WinProcess::ReadFromPipe(HANDLE outHnd, std::string* pBuffer)
 		else
 			exitError = m_exitCode;
 	}
+
+	if (m_hPty == NULL && !m_outInherited)
+	{
+		// Output written after the last read is still in the pipe (up to PIPE_SIZE),
+		// drain it. The pipe is non blocking, an empty pipe fails the read.
+		for (;;)
+		{
+			bSuccess = ReadFile(m_hChildStd_OUT_Rd, chBuf, BUFSIZE, &dwRead, NULL);
+			if (!bSuccess || dwRead == 0)
+				break;
+			AppendOutput(chBuf, dwRead, outHnd, pBuffer);
+		}
+	}
+	else if (m_hPty != NULL)
+	{
+		// Closing the pseudo console flushes its last output then breaks the pipe.
+		// Close may block until that output is read, so close on a helper thread.
+		std::thread closer(s_closePseudoConsole, m_hPty);
+		m_hPty = NULL;
+		for (;;)
+		{
+			bSuccess = ReadFile(m_hChildStd_OUT_Rd, chBuf, BUFSIZE, &dwRead, NULL);
+			if (bSuccess && dwRead != 0)
+				AppendOutput(chBuf, dwRead, outHnd, pBuffer);
+			else if (!bSuccess && GetLastError() == ERROR_BROKEN_PIPE)
+				break;
+			else
+				Sleep(1);
+		}
+		closer.join();
+	}
 	
 	GetExitCodeProcess(m_piProcInfo.hProcess, &m_exitCode);
 }
 
+// ======================================================================================
+// Pass one block of child output to outHnd and pBuffer.
+void WinProcess::AppendOutput(char* chBuf, DWORD dwRead, HANDLE outHnd, std::string* pBuffer)
+{
+	DWORD dwWritten;
+	if (m_usePty)
+		dwRead = (DWORD)StripVt(chBuf, dwRead);
+
+	NoteRead(chBuf, dwRead);
+	if (dwRead == 0)
+		return;
+	WriteFile(outHnd, chBuf, dwRead, &dwWritten, NULL);
+	if (pBuffer)
+		pBuffer->append(chBuf, chBuf + dwRead);
+}
+
+// ======================================================================================
+// Remove terminal control sequences (CSI, OSC and two byte ESC) which the pseudo
+// console adds to the child text. Sequences may span reads, state is kept in m_vtState.
+size_t WinProcess::StripVt(char* chBuf, size_t len)
+{
+	enum { TEXT, ESC, CSI, OSC, OSC_ESC };
+	size_t outLen = 0;
+	for (size_t idx = 0; idx != len; idx++)
+	{
+		char chr = chBuf[idx];
+		switch (m_vtState)
+		{
+		case TEXT:
+			if (chr == '\x1b')
+				m_vtState = ESC;
+			else
+				chBuf[outLen++] = chr;
+			break;
+		case ESC:
+			m_vtState = (chr == '[') ? CSI : (chr == ']') ? OSC : TEXT;
+			break;
+		case CSI:
+			if (chr >= 0x40 && chr <= 0x7e)
+				m_vtState = TEXT;
+			break;
+		case OSC:
+			if (chr == '\a')
+				m_vtState = TEXT;
+			else if (chr == '\x1b')
+				m_vtState = OSC_ESC;
+			break;
+		case OSC_ESC:
+			m_vtState = TEXT;
+			break;
+		}
+	}
+	return outLen;
+}
+
 // ======================================================================================
 // Format a readable error message, display a message box, 
 // and exit from the application.
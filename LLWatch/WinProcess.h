@@ -32,35 +32,52 @@
 
 #include <Windows.h>
 #include <string>
+#include <vector>
 
+#include "ChildProcess.h"
 #include "Hnd.h"
 
 // ======================================================================================
-class WinProcess
+class WinProcess : public ChildProcess
 {
 public:
-	WinProcess() { m_extn = NULL;  }
+	WinProcess()
+	{
+		m_hPty = NULL; m_vtState = 0; m_outInherited = false; m_job = m_jobPort = NULL;
+		ZeroMemory(&m_piProcInfo, sizeof(m_piProcInfo));
+	}
 
 	Hnd m_hChildStd_IN_Rd;
 	Hnd m_hChildStd_IN_Wr;
 	Hnd m_hChildStd_OUT_Rd;
 	Hnd m_hChildStd_OUT_Wr;
+	Hnd m_hStdOutDup;		// inheritable copy of our stdout (passthrough) or capture file
+	bool m_outInherited;	// child writes to m_hStdOutDup, not the pipe
 
 	PROCESS_INFORMATION m_piProcInfo;
 	STARTUPINFO			m_siStartInfo;
 
-	const char* m_extn;
-	std::string m_lastExeName;
-
-	DWORD m_exitCode;
+	HANDLE				m_hPty;			// pseudo console (HPCON) when SetPty
+	std::vector<char>	m_attrList;		// PROC_THREAD_ATTRIBUTE_LIST storage
+	int					m_vtState;		// StripVt parse state between reads
+	HANDLE				m_job;			// Job Object applying m_limits, NULL if none
+	HANDLE				m_jobPort;		// its limit messages
 
 	bool Init(void);
-	const char* GetRunExtension(std::string& exeName);
+	bool InitPty(void);
+	static const char* GetRunExtension(const std::string& exeName);
 	std::string WinProcess::GetRunCommand(std::string& fullCommand, const std::string& command);
-	void CreateChildProcess(const std::string& commandLine, unsigned long waitMsec = 10);
+	bool CreateChildProcess(const std::string& commandLine, unsigned long waitMsec = 10);
 	void WriteToPipe(HANDLE inFile);
+	void ReadFromPipe(bool echo, std::string* pBuffer = NULL);
 	void ReadFromPipe(HANDLE outHnd, std::string* pBuffer = NULL);
 	void CloseProcess();
 	void ErrorExit(PTSTR);
+
+private:
+	void StartInJob();
+	void ReadUsage();
+	void AppendOutput(char* chBuf, DWORD dwRead, HANDLE outHnd, std::string* pBuffer);
+	size_t StripVt(char* chBuf, size_t len);
 };
 
@@ -104,7 +104,7 @@ lstring& lstring::trim()
 	pDst--;
 	while (pDst != str && isspace(pDst[-1]))
 		*--pDst = '\0'; // remove trailer
-	resize(pDst - str + 1);
+	resize(pDst - str);
 	return *this;
 }
 
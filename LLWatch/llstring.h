@@ -33,6 +33,7 @@
 
 #include <ctype.h>
 #include <assert.h>
+#include <string.h>
 #include <string>
 #include <vector>
 
@@ -152,11 +153,15 @@ public:
 
         if (pBucket->nextPtr + len >= pBucket->endPtr)
         {
+#ifdef _MSC_VER
         _CrtCheckMemory( );
+#endif
             // Need more room, add another bucket.
             m_buckets.push_back(new Bucket());
             pBucket = m_buckets[m_buckets.size()-1];
+#ifdef _MSC_VER
         _CrtCheckMemory( );
+#endif
         }
 
         if (pObj)
@@ -0,0 +1,209 @@
+// ------------------------------------------------------------------------------------------------
+// BenchCommon.h - Synthetic frames and helpers shared by llbench and llcheck
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "ChildProcess.h"
+#include "llstring.h"
+
+#include <streambuf>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#define ARRAY_CNT(a) (sizeof(a) / sizeof(a[0]))
+
+// ======================================================================================
+// Output sink which discards everything, counting bytes.
+class NullBuf : public std::streambuf
+{
+public:
+	NullBuf() : m_bytes(0) { }
+	size_t m_bytes;
+
+protected:
+	int overflow(int ch)
+	{
+		m_bytes++;
+		return (ch == EOF) ? 0 : ch;
+	}
+
+	std::streamsize xsputn(const char*, std::streamsize cnt)
+	{
+		m_bytes += (size_t)cnt;
+		return cnt;
+	}
+};
+
+// ======================================================================================
+// Reproducible random numbers (xorshift64).
+class Rng
+{
+public:
+	Rng(unsigned long long seed) : m_state(seed) { }
+
+	unsigned Next(unsigned range)
+	{
+		m_state ^= m_state << 13;
+		m_state ^= m_state >> 7;
+		m_state ^= m_state << 17;
+		return (unsigned)(m_state % range);
+	}
+
+private:
+	unsigned long long m_state;
+};
+
+// ======================================================================================
+// Pair of successive frames (previous and current output of a watched command).
+struct Corpus
+{
+	std::string name;
+	lstring prev;
+	lstring curr;
+	unsigned lines;
+};
+
+static const char* s_names[] = { "explorer.exe", "svchost.exe", "Console.exe", "chrome.exe", "llwatch.exe", "System" };
+static const char* s_states[] = { "Running", "Waiting", "Suspended" };
+
+// Tasklist like line: name, pid, memory and state.
+inline void AppendTaskLine(std::string& out, unsigned pid, unsigned mem)
+{
+	char line[128];
+	snprintf(line, sizeof(line), "%-24s %6u %10u K %-10s\n",
+		s_names[pid % ARRAY_CNT(s_names)], pid, mem, s_states[(pid / 7) % ARRAY_CNT(s_states)]);
+	out += line;
+}
+
+// Frames differ by a few memory values out of many lines.
+inline Corpus MakeNearSame(unsigned lines)
+{
+	Corpus corpus;
+	corpus.name = "nearSame";
+	corpus.lines = lines;
+	Rng rng(0x1234);
+	for (unsigned idx = 0; idx != lines; idx++)
+	{
+		unsigned mem = 1000 + rng.Next(900000);
+		AppendTaskLine(corpus.prev, 100 + idx, mem);
+		AppendTaskLine(corpus.curr, 100 + idx, (rng.Next(100) == 0) ? mem + 4 : mem);
+	}
+	return corpus;
+}
+
+// Every line changes between frames.
+inline Corpus MakeChurn(unsigned lines)
+{
+	Corpus corpus;
+	corpus.name = "churn";
+	corpus.lines = lines;
+	Rng rng(0x5678);
+	for (unsigned idx = 0; idx != lines; idx++)
+	{
+		AppendTaskLine(corpus.prev, 100 + idx, 1000 + rng.Next(900000));
+		AppendTaskLine(corpus.curr, 100 + idx, 1000 + rng.Next(900000));
+	}
+	return corpus;
+}
+
+// Few lines, each several KB wide (log like), with sparse character changes.
+inline Corpus MakeLongLines(unsigned lines)
+{
+	Corpus corpus;
+	corpus.name = "longLines";
+	corpus.lines = lines;
+	Rng rng(0x9abc);
+	const unsigned width = 4096;
+	for (unsigned idx = 0; idx != lines; idx++)
+	{
+		size_t start = corpus.prev.length();
+		while (corpus.prev.length() - start < width)
+		{
+			corpus.prev += s_names[rng.Next(ARRAY_CNT(s_names))];
+			corpus.prev += (rng.Next(4) == 0) ? " Running " : " ";
+		}
+		corpus.prev += '\n';
+	}
+	corpus.curr = corpus.prev;
+	for (size_t pos = rng.Next(500); pos < corpus.curr.length(); pos += 1 + rng.Next(1000))
+	{
+		if (corpus.curr[pos] != '\n')
+			corpus.curr[pos] = (char)('0' + rng.Next(10));
+	}
+	return corpus;
+}
+
+// Very many short lines, tail changes.
+inline Corpus MakeHugeCount(unsigned lines)
+{
+	Corpus corpus;
+	corpus.name = "hugeCount";
+	corpus.lines = lines;
+	char line[64];
+	for (unsigned idx = 0; idx != lines; idx++)
+	{
+		snprintf(line, sizeof(line), "line %8u ok\n", idx);
+		corpus.prev += line;
+		snprintf(line, sizeof(line), "line %8u %s\n", idx, (idx > lines - lines / 10) ? "no" : "ok");
+		corpus.curr += line;
+	}
+	return corpus;
+}
+
+// ======================================================================================
+// File in the temporary directory.
+inline std::string TempFile(const char* name)
+{
+#ifdef _WIN32
+	char tmpDir[MAX_PATH];
+	GetTempPathA(sizeof(tmpDir), tmpDir);
+	return std::string(tmpDir) + name;
+#else
+	const char* tmpDir = getenv("TMPDIR");
+	return std::string(tmpDir ? tmpDir : "/tmp") + "/" + name;
+#endif
+}
+
+// ======================================================================================
+// Capture output of 'command', return false if it could not be started.
+inline bool RunChild(ChildProcess& process, const char* command, std::string& output)
+{
+	output.clear();
+	if (!process.CreateChildProcess(command, 0))
+		return false;
+	process.ReadFromPipe(false, &output);
+	process.CloseProcess();
+	return true;
+}
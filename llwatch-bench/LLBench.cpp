@@ -0,0 +1,798 @@
+// ------------------------------------------------------------------------------------------------
+// LLBench - Micro-benchmarks of LLWatch text processing kernels
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// Build:
+//   Windows  llbench.vcxproj (part of llwatch-ms\llwatch.sln)
+//   Linux    cd llwatch-bench
+//            g++ -O2 -std=c++17 -I../LLWatch -o llbench LLBench.cpp ../LLWatch/FrameOps.cpp ../LLWatch/FramePipeline.cpp
+//              ../LLWatch/Colorize.cpp ../LLWatch/llstring.cpp ../LLWatch/PhaseStats.cpp ../LLWatch/GetOpts.cpp
+//              ../LLWatch/ChildProcess.cpp ../LLWatch/PosixProcess.cpp ../LLWatch/ThreadPool.cpp
+//              ../LLWatch/JsonLines.cpp ../LLWatch/ShmRing.cpp ../LLWatch/FrameGovernor.cpp
+//              ../LLWatch/HeatMap.cpp ../LLWatch/Baseline.cpp ../LLWatch/MappedFile.cpp
+//              ../LLWatch/TokenMask.cpp ../LLWatch/FieldRates.cpp ../LLWatch/LineAggregate.cpp -lutil -pthread
+//
+// Output is one JSON object per line (first line describes the run), ex:
+//   {"bench":"showDiffFast","corpus":"nearSame","bytes":570000,"iters":812,"nsPerIter":245871,"nsPerLine":24.6,"mbPerSec":2318.3}
+// Behavior checks of the same components are in LLCheck.cpp.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "BenchCommon.h"
+#include "FieldRates.h"
+#include "FrameGovernor.h"
+#include "FrameOps.h"
+#include "JsonLines.h"
+#include "FramePipeline.h"
+#include "Colorize.h"
+#include "GetOpts.h"
+#include "HeatMap.h"
+#include "LineAggregate.h"
+#include "llstring.h"
+#include "Baseline.h"
+#include "ChildProcess.h"
+#include "ShmRing.h"
+#include "ThreadPool.h"
+#include "TokenMask.h"
+#ifndef _WIN32
+#include "PosixProcess.h"
+#endif
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+const char sUsage[] =
+"\n"
+"LLBench - LLWatch text kernel micro-benchmarks\n"
+"\n"
+"USAGE:\n"
+"  llbench [-f <filter>] [-s <scale>] [-r <reps>] [-m <msec>] [-b <MB>] [-g <llgen>] [-p <MB>] [-o <file>]\n"
+"\n"
+"  -f <filter>  Only run benchmarks whose bench or corpus name contains filter \n"
+"  -s <scale>   Multiply corpus line counts, default 1 \n"
+"  -r <reps>    Repetitions per benchmark, best is reported, default 5 \n"
+"  -m <msec>    Minimum time per repetition, default 200 \n"
+"  -b <MB>      Memory held while timing process spawn, default 256 \n"
+"  -g <path>    llgen executable for time to first byte (ttfb) pipe vs pty \n"
+"  -p <MB>      Output size per run of passthrough benchmark, default 256 \n"
+"  -o <file>    Write JSON lines results to file, default stdout \n"
+"\n";
+
+unsigned m_scale = 1;
+unsigned m_reps = 5;
+unsigned m_minMsec = 200;
+unsigned m_ballastMB = 256;
+unsigned m_passMB = 256;
+#ifdef _WIN32
+std::string m_llgen = "llgen.exe";
+#else
+std::string m_llgen = "./llgen";
+#endif
+const char* m_filter = "";
+
+// Results of benchmarked functions are folded into this so they are not optimized away.
+volatile size_t m_sink = 0;
+
+// ======================================================================================
+// Run 'fn' repeatedly for at least m_minMsec, m_reps times, report best ns per iteration.
+template <typename Fn>
+void RunBench(std::ostream& out, const char* bench, const std::string& corpusName, unsigned lines, size_t bytes, Fn fn)
+{
+	std::string fullName = std::string(bench) + "/" + corpusName;
+	if (fullName.find(m_filter) == std::string::npos)
+		return;
+
+	const Clock::duration minTime = std::chrono::milliseconds(m_minMsec);
+	double bestNs = 0;
+	unsigned long long totalIters = 0;
+	Clock::time_point benchStart = Clock::now();
+
+	for (unsigned rep = 0; rep != m_reps; rep++)
+	{
+		unsigned long long iters = 0;
+		Clock::time_point start = Clock::now();
+		Clock::duration elapsed;
+		do
+		{
+			m_sink += fn();
+			iters++;
+			elapsed = Clock::now() - start;
+		} while (elapsed < minTime);
+
+		double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / iters;
+		if (rep == 0 || ns < bestNs)
+			bestNs = ns;
+		totalIters += iters;
+
+		// Slow kernels on big corpora, don't spend more than 10 seconds.
+		if (Clock::now() - benchStart > std::chrono::seconds(10))
+			break;
+	}
+
+	char buf[512];
+	snprintf(buf, sizeof(buf),
+		"{\"bench\":\"%s\",\"corpus\":\"%s\",\"lines\":%u,\"bytes\":%zu,\"iters\":%llu,\"nsPerIter\":%.0f,\"nsPerLine\":%.1f,\"mbPerSec\":%.1f}\n",
+		bench, corpusName.c_str(), lines, bytes, totalIters, bestNs, (lines != 0) ? bestNs / lines : 0.0,
+		(bestNs > 0) ? (bytes / 1e6) / (bestNs / 1e9) : 0.0);
+	out << buf << std::flush;
+}
+
+template <typename Fn>
+void RunBench(std::ostream& out, const char* bench, const Corpus& corpus, size_t bytes, Fn fn)
+{
+	RunBench(out, bench, corpus.name, corpus.lines, bytes, fn);
+}
+
+// ======================================================================================
+// Colorized text as produced by showDiffFast, color change every few words.
+static std::string MakeColorText(const std::string& text)
+{
+	std::string colored;
+	colored.reserve(text.length() + text.length() / 8);
+	for (size_t pos = 0; pos < text.length(); pos += 40)
+	{
+		colored += (pos % 80 == 0) ? "!07" : "!0e";
+		colored.append(text, pos, 40);
+	}
+	return colored;
+}
+
+// ======================================================================================
+void RunCorpus(std::ostream& out, const Corpus& corpus)
+{
+	NullBuf nullBuf;
+	std::ostream nullOut(&nullBuf);
+	const lstring& curr = corpus.curr;
+	const lstring& prev = corpus.prev;
+	const lstring eol("\n");
+	size_t bytes = curr.length();
+
+	RunBench(out, "copy", corpus, bytes, [&]()
+		{ lstring buffer(curr); return buffer.length(); });
+
+	RunBench(out, "showDiffFast", corpus, bytes, [&]()
+		{ showDiffFast(curr, prev, nullOut); return nullBuf.m_bytes; });
+
+	// Frames alternate curr / prev so every changed cell is stamped each call.
+	HeatMap heatMap(8);
+	unsigned heatTick = 0;
+	RunBench(out, "HeatMap.show", corpus, bytes, [&]()
+		{
+			const lstring& frame = (++heatTick & 1) ? curr : prev;
+			const lstring& last = (heatTick & 1) ? prev : curr;
+			heatMap.Show(frame.c_str(), frame.length(), last.c_str(), last.length(), nullOut);
+			return nullBuf.m_bytes;
+		});
+
+	RunBench(out, "TrimTopBottom.top", corpus, bytes, [&]()
+		{ lstring buffer(curr); return (size_t)TrimTopBottom(buffer, 20, 0); });
+
+	RunBench(out, "TrimTopBottom.bottom", corpus, bytes, [&]()
+		{ lstring buffer(curr); return (size_t)TrimTopBottom(buffer, 20, 20); });
+
+	RunBench(out, "lstring.count", corpus, bytes, [&]()
+		{ return (size_t)curr.count(eol); });
+
+	RunBench(out, "lstring.findCnt", corpus, bytes, [&]()
+		{ return curr.findCnt(eol, 0, corpus.lines / 2); });
+
+	RunBench(out, "Split", corpus, bytes, [&]()
+		{ Split lines(curr, "\n"); return lines.size(); });
+
+#ifdef HAVE_REGEX
+	const std::regex grepPat("Running|ok");
+	RunBench(out, "RegexTrim.grep", corpus, bytes, [&]()
+		{ lstring buffer(curr); RegexTrim(buffer, grepPat, ""); return buffer.length(); });
+
+	const std::regex replacePat("([0-9]+) ");
+	RunBench(out, "RegexTrim.replace", corpus, bytes, [&]()
+		{ lstring buffer(curr); RegexTrim(buffer, replacePat, "<$1> "); return buffer.length(); });
+
+	// regReplace per line on the first 1000 lines.
+	Split lines(curr, "\n");
+	if (lines.size() > 1000)
+		lines.resize(1000);
+	size_t lineBytes = 0;
+	for (size_t idx = 0; idx != lines.size(); idx++)
+		lineBytes += lines[idx].length();
+	RunBench(out, "lstring.regReplace", corpus, lineBytes, [&]()
+		{
+			size_t cnt = 0;
+			for (size_t idx = 0; idx != lines.size(); idx++)
+			{
+				lstring line(lines[idx]);
+				cnt += line.regReplace(replacePat, "<$1> ") ? 1 : 0;
+			}
+			return cnt;
+		});
+#endif
+
+	// Grep + trim + highlight of a frame, fused single pass vs a pass per stage.
+	// fit rows clip lines to an 80 column window (--fit).
+	static const struct { const char* name; const char* grep; const char* replace; unsigned top; unsigned bottom; unsigned cols; } s_pipes[] =
+	{
+		{ "all", NULL, "", 0, 0, 0 },
+		{ "top20", NULL, "", 20, 0, 0 },
+		{ "grep", "Running|ok", "", 0, 0, 0 },
+		{ "grep.top20", "Running|ok", "", 20, 0, 0 },
+		{ "grep.bottom20", "Running|ok", "", 0, 20, 0 },
+		{ "replace", "([0-9]+) ", "<$1> ", 0, 0, 0 },
+		{ "fit.top40", NULL, "", 40, 0, 80 },
+		{ "fit.bottom40", NULL, "", 0, 40, 80 },
+		{ "fit.grep.top40", "Running|ok", "", 40, 0, 80 },
+	};
+	for (unsigned idx = 0; idx != ARRAY_CNT(s_pipes); idx++)
+	{
+		std::regex pipeGrep;
+		if (s_pipes[idx].grep)
+			pipeGrep = s_pipes[idx].grep;
+		const std::regex* grepPtr = s_pipes[idx].grep ? &pipeGrep : NULL;
+		for (int multiPass = 0; multiPass != 2; multiPass++)
+		{
+			FramePipeline pipeline;
+			pipeline.SetMaxCols(s_pipes[idx].cols);
+			pipeline.Configure(grepPtr, s_pipes[idx].replace, s_pipes[idx].top, s_pipes[idx].bottom, NULL, multiPass != 0);
+			lstring filtered;
+			std::string bench = std::string(multiPass ? "pipeline.multiPass." : "pipeline.fused.") + s_pipes[idx].name;
+			RunBench(out, bench.c_str(), corpus, bytes, [&]()
+				{
+					const char* data = curr.c_str();
+					size_t len = curr.length();
+					return (size_t)pipeline.Run(data, len, prev.c_str(), prev.length(), filtered, nullOut);
+				});
+		}
+	}
+
+	// JSON lines encoding of a frame to the null device, hunks alternate curr / prev.
+#ifdef _WIN32
+	const char* nullPath = "NUL";
+#else
+	const char* nullPath = "/dev/null";
+#endif
+	for (int hunks = 0; hunks != 2; hunks++)
+	{
+		JsonLines jsonLines;
+		jsonLines.Open(nullPath);
+		jsonLines.SetHunks(hunks != 0);
+		unsigned tick = 0;
+		RunBench(out, hunks ? "jsonl.hunks" : "jsonl.frame", corpus, bytes, [&]()
+			{
+				const lstring& frame = (++tick & 1) ? curr : prev;
+				jsonLines.Write(tick, 0, 0, 0, frame.c_str(), frame.length());
+				return (size_t)tick;
+			});
+	}
+
+	std::string colored = MakeColorText(curr);
+	RunBench(out, "Colorize.write", corpus, colored.length(), [&]()
+		{ Colorize::write(nullOut, colored.c_str()); return nullBuf.m_bytes; });
+}
+
+// ======================================================================================
+// Parallel grep and diff of a large frame at 1/2/4/8/16 threads (corpus name .t#).
+void RunParallel(std::ostream& out)
+{
+	if (*m_filter != '\0' && strstr(m_filter, "parallel") == NULL)
+		return;
+
+	static const unsigned s_threads[] = { 1, 2, 4, 8, 16 };
+	Corpus corpora[] = { MakeNearSame(200000 * m_scale), MakeChurn(200000 * m_scale) };
+	NullBuf nullBuf;
+	std::ostream nullOut(&nullBuf);
+#ifdef HAVE_REGEX
+	const std::regex grepPat("Running|ok");
+	const std::regex replacePat("([0-9]+) ");
+#endif
+
+	for (unsigned cIdx = 0; cIdx != ARRAY_CNT(corpora); cIdx++)
+	{
+		const Corpus& corpus = corpora[cIdx];
+		const lstring& curr = corpus.curr;
+		const lstring& prev = corpus.prev;
+		size_t bytes = curr.length();
+
+		for (unsigned tIdx = 0; tIdx != ARRAY_CNT(s_threads); tIdx++)
+		{
+			unsigned threads = s_threads[tIdx];
+			std::unique_ptr<ThreadPool> pool;
+			if (threads > 1)
+				pool.reset(new ThreadPool(threads - 1));
+			std::string name = corpus.name + ".t" + std::to_string(threads);
+
+			RunBench(out, "parallel.showDiffFast", name, corpus.lines, bytes, [&]()
+				{ showDiffFast(curr, prev, nullOut, pool.get()); return nullBuf.m_bytes; });
+#ifdef HAVE_REGEX
+			lstring result;
+			RunBench(out, "parallel.RegexTrim.grep", name, corpus.lines, bytes, [&]()
+				{ RegexTrim(curr.c_str(), bytes, result, grepPat, "", pool.get()); return result.length(); });
+			RunBench(out, "parallel.RegexTrim.replace", name, corpus.lines, bytes, [&]()
+				{ RegexTrim(curr.c_str(), bytes, result, replacePat, "<$1> ", pool.get()); return result.length(); });
+#endif
+		}
+	}
+}
+
+// ======================================================================================
+// Spawn + capture rate of a trivial command. The watcher may hold large frames, so
+// spawn is timed while 'ballast' memory is resident (fork has to copy its page tables,
+// posix_spawn/CreateProcess do not).
+void RunSpawn(std::ostream& out)
+{
+	if (*m_filter != '\0' && strstr(m_filter, "spawn") == NULL && strstr(m_filter, "ballast") == NULL)
+		return;
+
+	std::vector<char> ballast((size_t)m_ballastMB << 20);
+	for (size_t pos = 0; pos < ballast.size(); pos += 4096)
+		ballast[pos] = (char)pos;
+	m_sink += ballast.size();
+
+	std::string corpusName = "ballast" + std::to_string(m_ballastMB) + "MB";
+	std::string output;
+
+#ifdef _WIN32
+	static const char s_trivialCmd[] = "cmd /c echo ok";
+#else
+	static const char s_trivialCmd[] = "echo ok";
+#endif
+
+	std::unique_ptr<ChildProcess> process(ChildProcess::Create());
+	RunBench(out, "spawn", corpusName, 1, 3, [&]()
+		{ RunChild(*process, s_trivialCmd, output); return output.length(); });
+
+#ifndef _WIN32
+	PosixProcess forkProcess;
+	forkProcess.m_useFork = true;
+	RunBench(out, "spawn.fork", corpusName, 1, 3, [&]()
+		{ RunChild(forkProcess, s_trivialCmd, output); return output.length(); });
+#endif
+}
+
+// ======================================================================================
+// Time to first byte from a child which prints a few lines with default stdio
+// buffering then sleeps. Through a pipe the output is block buffered and only
+// arrives at exit, through a pseudo terminal it is line buffered and arrives at once.
+void RunTtfb(std::ostream& out)
+{
+	if (*m_filter != '\0' && strstr(m_filter, "ttfb") == NULL)
+		return;
+
+	const unsigned sleepMsec = 500;
+	std::string command = m_llgen + " -l 3 -B -E " + std::to_string(sleepMsec);
+	static const char* s_modes[] = { "pipe", "pty" };
+
+	for (unsigned mode = 0; mode != ARRAY_CNT(s_modes); mode++)
+	{
+		std::unique_ptr<ChildProcess> process(ChildProcess::Create());
+		process->SetPty(mode == 1, 80, 24);
+
+		std::string output;
+		double firstMin = 0, firstTotal = 0, runTotal = 0;
+		unsigned runs = (std::min)(m_reps, 5u);
+		bool started = true;
+		for (unsigned run = 0; run != runs && started; run++)
+		{
+			Clock::time_point start = Clock::now();
+			started = RunChild(*process, command.c_str(), output);
+			double runMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			if (run == 0 || process->m_firstByteMs < firstMin)
+				firstMin = process->m_firstByteMs;
+			firstTotal += process->m_firstByteMs;
+			runTotal += runMs;
+		}
+		if (!started)
+		{
+			std::cerr << "Failed to run " << command << ", set llgen path with -g" << std::endl;
+			return;
+		}
+
+		// Line buffered output should be seen well before the child exits.
+		bool early = firstMin >= 0 && firstMin < sleepMsec / 2;
+		char buf[256];
+		snprintf(buf, sizeof(buf),
+			"{\"bench\":\"ttfb\",\"mode\":\"%s\",\"runs\":%u,\"bytes\":%zu,\"firstByteMinMs\":%.2f,\"firstByteAvgMs\":%.2f,\"runAvgMs\":%.2f,\"early\":%s}\n",
+			s_modes[mode], runs, output.length(), firstMin, firstTotal / runs, runTotal / runs,
+			early ? "true" : "false");
+		out << buf << std::flush;
+	}
+}
+
+// Point our stdout at sinkPath until destroyed, truncate between runs.
+class StdOutRedirect
+{
+public:
+	StdOutRedirect(const char* sinkPath)
+	{
+		std::cout.flush();
+#ifdef _WIN32
+		m_saved = GetStdHandle(STD_OUTPUT_HANDLE);
+		m_sink = CreateFileA(sinkPath, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		SetStdHandle(STD_OUTPUT_HANDLE, m_sink);
+#else
+		m_saved = dup(STDOUT_FILENO);
+		m_sink = open(sinkPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		dup2(m_sink, STDOUT_FILENO);
+#endif
+	}
+
+	~StdOutRedirect()
+	{
+#ifdef _WIN32
+		SetStdHandle(STD_OUTPUT_HANDLE, m_saved);
+		CloseHandle(m_sink);
+#else
+		dup2(m_saved, STDOUT_FILENO);
+		close(m_saved);
+		close(m_sink);
+#endif
+	}
+
+	void Truncate()
+	{
+#ifdef _WIN32
+		LARGE_INTEGER zero;
+		zero.QuadPart = 0;
+		SetFilePointerEx(m_sink, zero, NULL, FILE_BEGIN);
+		SetEndOfFile(m_sink);
+#else
+		if (ftruncate(STDOUT_FILENO, 0) == 0)
+			lseek(STDOUT_FILENO, 0, SEEK_SET);
+#endif
+	}
+
+private:
+#ifdef _WIN32
+	HANDLE m_saved;
+	HANDLE m_sink;
+#else
+	int m_saved;
+	int m_sink;
+#endif
+};
+
+// ======================================================================================
+// Throughput of -d passthrough, child output echoed to our stdout which is redirected
+// to the null device or a log file. POSIX compares splice with the read+write copy,
+// Windows compares handing our stdout to the child with the pipe copy loop.
+void RunPassthrough(std::ostream& out)
+{
+	if (*m_filter != '\0' && strstr(m_filter, "passthrough") == NULL)
+		return;
+
+	// Source text, cat/type of a file is close to free for the child.
+	std::string srcFile = TempFile("llbench_pass.txt");
+	std::ofstream src(srcFile.c_str(), std::ios::binary);
+	std::string block;
+	while (block.length() < (1u << 20))
+		block += "line of passthrough output 0123456789 abcdefghijklmnopqrstuvwxyz\n";
+	block.resize(1u << 20);
+	for (unsigned mb = 0; mb != m_passMB; mb++)
+		src.write(block.data(), block.length());
+	src.close();
+	size_t bytes = (size_t)m_passMB << 20;
+
+#ifdef _WIN32
+	std::string command = "cmd /c type " + srcFile;
+	static const char* s_modes[] = { "passthrough.inherit", "passthrough.pipe" };
+	struct Sink { const char* name; std::string path; } sinks[] =
+		{ { "null", "NUL" }, { "log", TempFile("llbench_pass.log") } };
+#else
+	std::string command = "cat " + srcFile;
+	static const char* s_modes[] = { "passthrough.splice", "passthrough.copy" };
+	struct Sink { const char* name; std::string path; } sinks[] =
+		{ { "null", "/dev/null" }, { "log", TempFile("llbench_pass.log") } };
+#endif
+
+	// Results are held until stdout is restored, it may be 'out'.
+	std::ostringstream results;
+	for (unsigned sinkIdx = 0; sinkIdx != ARRAY_CNT(sinks); sinkIdx++)
+	{
+		StdOutRedirect redirect(sinks[sinkIdx].path.c_str());
+		for (unsigned mode = 0; mode != ARRAY_CNT(s_modes); mode++)
+		{
+			std::unique_ptr<ChildProcess> process(ChildProcess::Create());
+#ifdef _WIN32
+			process->SetPassthrough(mode == 0);
+#else
+			((PosixProcess*)process.get())->m_useSplice = (mode == 0);
+#endif
+			RunBench(results, s_modes[mode], sinks[sinkIdx].name, 0, bytes, [&]()
+				{
+					redirect.Truncate();
+					process->CreateChildProcess(command, 0);
+					process->ReadFromPipe(true);
+					process->CloseProcess();
+					return process->m_bytesRead;
+				});
+		}
+	}
+
+	out << results.str() << std::flush;
+	remove(srcFile.c_str());
+	remove(sinks[1].path.c_str());
+}
+
+// ======================================================================================
+// Shared memory frame ring (llwatch --shm), times publish and read of a nearSame frame.
+void RunShmRing(std::ostream& out)
+{
+	if (*m_filter != '\0' && strstr(m_filter, "shm") == NULL)
+		return;
+
+	char name[64];
+	snprintf(name, sizeof(name), "llbench-%u", (unsigned)Clock::now().time_since_epoch().count());
+	Corpus corpus = MakeNearSame(10000 * m_scale);
+	std::string error;
+	ShmRingWriter writer;
+	if (corpus.curr.length() > (4u << 20) || !writer.Create(name, 4, 4 << 20, error))
+	{
+		std::cerr << "shm ring " << name << " " << error << std::endl;
+		return;
+	}
+
+	ShmRingReader reader;
+	ShmFrame latest;
+	reader.Open(name, error);
+	RunBench(out, "shm.publish", corpus, corpus.curr.length(), [&]()
+		{ writer.Publish(1, 0, corpus.curr.c_str(), corpus.curr.length()); return (size_t)writer.Seq(); });
+	RunBench(out, "shm.read", corpus, corpus.curr.length(), [&]()
+		{ reader.ReadLatest(latest); return latest.data.length(); });
+}
+
+// Render governor (llwatch --max-fps). Frames are submitted every millisecond for a
+// second at a 30 fps cap, reports the paints and the capture to paint latency.
+void RunRender(std::ostream& out)
+{
+	if (*m_filter != '\0' && strstr(m_filter, "render") == NULL)
+		return;
+
+	static const unsigned FPS = 30;
+	NullBuf nullBuf;
+	std::ostream nullOut(&nullBuf);
+	FrameGovernor governor(FPS, false, nullOut);
+	lstring frame;
+	char line[64];
+	unsigned submitted = 0;
+	Clock::time_point start = Clock::now();
+	while (Clock::now() - start < std::chrono::seconds(1))
+	{
+		snprintf(line, sizeof(line), "frame %u\nsame line\n", ++submitted);
+		frame = line;
+		governor.Submit(frame, Clock::now());
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	governor.Flush();
+
+	char buf[256];
+	snprintf(buf, sizeof(buf),
+		"{\"bench\":\"render.coalesce\",\"fps\":%u,\"submitted\":%u,\"painted\":%u,\"latencyP50Ms\":%.2f,\"latencyP99Ms\":%.2f}\n",
+		FPS, governor.Submitted(), governor.Painted(), governor.LatencyMs(50), governor.LatencyMs(99));
+	out << buf << std::flush;
+}
+
+// Golden baseline (llwatch --baseline). The prev frame of a corpus is saved as the
+// baseline, times comparing curr against the indexed baseline and showing it.
+void RunBaseline(std::ostream& out, const Corpus& corpus)
+{
+	if (*m_filter != '\0' && strstr(m_filter, "baseline") == NULL && strstr(corpus.name.c_str(), m_filter) == NULL)
+		return;
+
+	std::string path = TempFile("llbench-baseline.txt");
+	std::string error;
+	Baseline::Save(path.c_str(), corpus.prev.c_str(), corpus.prev.length(), error);
+	Baseline baseline;
+	if (!baseline.Open(path.c_str(), error))
+	{
+		std::cerr << error << std::endl;
+		return;
+	}
+
+	NullBuf nullBuf;
+	std::ostream nullOut(&nullBuf);
+	size_t bytes = corpus.curr.length();
+	RunBench(out, "baseline.compare", corpus, bytes, [&]()
+		{ return baseline.Compare(corpus.curr.c_str(), corpus.curr.length()).changed; });
+	RunBench(out, "baseline.show", corpus, bytes, [&]()
+		{ baseline.Show(corpus.curr.c_str(), corpus.curr.length(), nullOut); return nullBuf.m_bytes; });
+
+	remove(path.c_str());
+	remove((path + ".idx").c_str());
+}
+
+// ======================================================================================
+// Volatile token masking (llwatch --mask). Times building a @number key and the
+// masked pipeline, frames alternate so prev is always the frame kept by the last run.
+void RunMask(std::ostream& out, const Corpus& corpus)
+{
+	if (*m_filter != '\0' && strstr(m_filter, "mask") == NULL && strstr(corpus.name.c_str(), m_filter) == NULL)
+		return;
+
+	NullBuf nullBuf;
+	std::ostream nullOut(&nullBuf);
+	std::string error;
+	TokenMask numberMask;
+	numberMask.Add("@number", error);
+	lstring key;
+	size_t bytes = corpus.curr.length();
+	RunBench(out, "mask.key", corpus, bytes, [&]()
+		{ numberMask.Key(corpus.curr.c_str(), corpus.curr.length(), key); return key.length(); });
+
+	FramePipeline pipeline;
+	pipeline.SetMask(&numberMask);
+	pipeline.Configure(NULL, "", 0, 0);
+	const std::string* frames[2] = { &corpus.prev, &corpus.curr };
+	lstring filtered;
+	unsigned tick = 0;
+	RunBench(out, "pipeline.mask", corpus, bytes, [&]()
+		{
+			const std::string& curr = *frames[tick & 1];
+			const std::string& prev = *frames[++tick & 1];
+			const char* data = curr.c_str();
+			size_t len = curr.length();
+			return (size_t)pipeline.Run(data, len, prev.c_str(), prev.length(), filtered, nullOut);
+		});
+}
+
+// Numeric field rates (llwatch --rates). Times adding the rate column to a frame,
+// pairing by line and by key.
+void RunRates(std::ostream& out, const Corpus& corpus)
+{
+	if (*m_filter != '\0' && strstr(m_filter, "rates") == NULL && strstr(corpus.name.c_str(), m_filter) == NULL)
+		return;
+
+	size_t bytes = corpus.curr.length();
+	const std::string* frames[2] = { &corpus.prev, &corpus.curr };
+	for (int byKey = 0; byKey != 2; byKey++)
+	{
+		FieldRates rates(byKey ? FieldRates::BY_KEY : FieldRates::BY_LINE);
+		unsigned tick = 0;
+		RunBench(out, byKey ? "rates.key" : "rates.line", corpus, bytes, [&]()
+			{
+				const std::string& frame = *frames[tick++ & 1];
+				const char* frameData = frame.c_str();
+				size_t frameLen = frame.length();
+				rates.Apply(frameData, frameLen, Clock::now());
+				return frameLen;
+			});
+	}
+}
+
+// Sort, top-k and uniq (llwatch --sort, --top, --uniq). Times a full sort against
+// top 20 and uniq of a frame, sorted by the numeric column of the corpus descending
+// (sortSpec).
+void RunAggregate(std::ostream& out, const Corpus& corpus, const char* sortSpec)
+{
+	if (*m_filter != '\0' && strstr(m_filter, "aggregate") == NULL && strstr(corpus.name.c_str(), m_filter) == NULL)
+		return;
+
+	std::string error;
+	LineAggregate sortAll;
+	LineAggregate sortTop;
+	LineAggregate uniq;
+	sortAll.SetSort(sortSpec, error);
+	sortTop.SetSort(sortSpec, error);
+	sortTop.SetTop(20);
+	uniq.SetUniq(true);
+
+	size_t bytes = corpus.curr.length();
+	LineAggregate* aggregates[] = { &sortAll, &sortTop, &uniq };
+	static const char* s_benches[] = { "aggregate.sort", "aggregate.top20", "aggregate.uniq" };
+	for (unsigned idx = 0; idx != ARRAY_CNT(aggregates); idx++)
+	{
+		RunBench(out, s_benches[idx], corpus, bytes, [&]()
+			{
+				const char* frameData = corpus.curr.c_str();
+				size_t frameLen = corpus.curr.length();
+				return aggregates[idx]->Apply(frameData, frameLen);
+			});
+	}
+}
+
+int main(int argc, const char* argv[])
+{
+	const char* outFile = NULL;
+	GetOpts<char> getOpts(argc, argv, "b:f:g:m:o:p:r:s:?");
+	while (getOpts.GetOpt())
+	{
+		switch (getOpts.Opt())
+		{
+		case 'b':	m_ballastMB = strtoul(getOpts.OptArg(), NULL, 10); break;
+		case 'f':	m_filter = getOpts.OptArg(); break;
+		case 'g':	m_llgen = getOpts.OptArg(); break;
+		case 'm':	m_minMsec = strtoul(getOpts.OptArg(), NULL, 10); break;
+		case 'p':	m_passMB = (std::max)(1ul, strtoul(getOpts.OptArg(), NULL, 10)); break;
+		case 'o':	outFile = getOpts.OptArg(); break;
+		case 'r':	m_reps = (std::max)(1ul, strtoul(getOpts.OptArg(), NULL, 10)); break;
+		case 's':	m_scale = (std::max)(1ul, strtoul(getOpts.OptArg(), NULL, 10)); break;
+		default:
+		case '?':
+			std::cerr << sUsage;
+			return 0;
+		}
+	}
+	if (getOpts.Error())
+	{
+		std::cerr << sUsage;
+		return -1;
+	}
+
+	std::ofstream outStream;
+	if (outFile)
+	{
+		outStream.open(outFile);
+		if (!outStream)
+		{
+			std::cerr << "Failed to create " << outFile << std::endl;
+			return -1;
+		}
+	}
+	std::ostream& out = outFile ? outStream : std::cout;
+
+	out << "{\"suite\":\"llbench\",\"scale\":" << m_scale << ",\"reps\":" << m_reps
+		<< ",\"minMsec\":" << m_minMsec << ",\"built\":\"" << __DATE__ << "\"}\n";
+
+	RunCorpus(out, MakeNearSame(10000 * m_scale));
+	RunCorpus(out, MakeChurn(10000 * m_scale));
+	RunCorpus(out, MakeLongLines(256 * m_scale));
+	RunCorpus(out, MakeHugeCount(1000000 * m_scale));
+	RunParallel(out);
+	RunSpawn(out);
+	RunTtfb(out);
+	RunPassthrough(out);
+	RunShmRing(out);
+	RunRender(out);
+	RunBaseline(out, MakeNearSame(10000 * m_scale));
+	RunBaseline(out, MakeLongLines(256 * m_scale));
+	RunMask(out, MakeNearSame(10000 * m_scale));
+	RunMask(out, MakeChurn(10000 * m_scale));
+	RunRates(out, MakeNearSame(10000 * m_scale));
+	RunRates(out, MakeChurn(10000 * m_scale));
+	RunAggregate(out, MakeNearSame(10000 * m_scale), "3nr");
+	RunAggregate(out, MakeHugeCount(1000000 * m_scale), "2nr");
+
+	return 0;
+}
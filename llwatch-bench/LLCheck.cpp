@@ -0,0 +1,638 @@
+// ------------------------------------------------------------------------------------------------
+// LLCheck - Behavior checks of LLWatch components
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// Build:
+//   Windows  llcheck.vcxproj (part of llwatch-ms\llwatch.sln), runs llcheck after each build
+//   Linux    cd llwatch-bench
+//            g++ -O2 -std=c++17 -I../LLWatch -o llcheck LLCheck.cpp ../LLWatch/FrameOps.cpp ../LLWatch/FramePipeline.cpp
+//              ../LLWatch/Colorize.cpp ../LLWatch/llstring.cpp ../LLWatch/PhaseStats.cpp ../LLWatch/GetOpts.cpp
+//              ../LLWatch/ChildProcess.cpp ../LLWatch/PosixProcess.cpp ../LLWatch/ThreadPool.cpp
+//              ../LLWatch/ShmRing.cpp ../LLWatch/FrameGovernor.cpp ../LLWatch/HeatMap.cpp
+//              ../LLWatch/Baseline.cpp ../LLWatch/MappedFile.cpp ../LLWatch/TokenMask.cpp
+//              ../LLWatch/FieldRates.cpp ../LLWatch/LineAggregate.cpp -lutil -pthread && ./llcheck
+//
+// Prints failed checks (all with -v) and a summary line, exits with 1 if any check failed.
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "BenchCommon.h"
+#include "Baseline.h"
+#include "FieldRates.h"
+#include "FrameGovernor.h"
+#include "FrameOps.h"
+#include "FramePipeline.h"
+#include "GetOpts.h"
+#include "HeatMap.h"
+#include "LineAggregate.h"
+#include "ShmRing.h"
+#include "ThreadPool.h"
+#include "TokenMask.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <string.h>
+
+typedef std::chrono::steady_clock Clock;
+
+const char sUsage[] =
+"\n"
+"LLCheck - LLWatch behavior checks\n"
+"\n"
+"USAGE:\n"
+"  llcheck [-f <filter>] [-v]\n"
+"\n"
+"  -f <filter>  Only run check groups whose name contains filter \n"
+"               (parallel spawn shm render fit heat baseline mask rates aggregate) \n"
+"  -v           Also list the checks which pass \n"
+"\n";
+
+const char* m_filter = "";
+bool m_verbose = false;
+unsigned m_checks = 0;
+unsigned m_failed = 0;
+
+// ======================================================================================
+static bool Selected(const char* group)
+{
+	return strstr(group, m_filter) != NULL;
+}
+
+static void Check(const std::string& check, unsigned long long expect, unsigned long long got)
+{
+	m_checks++;
+	if (expect != got)
+	{
+		m_failed++;
+		std::cout << "FAIL " << check << " expect " << expect << " got " << got << std::endl;
+	}
+	else if (m_verbose)
+	{
+		std::cout << "ok   " << check << std::endl;
+	}
+}
+
+// ======================================================================================
+// Parallel grep and diff (llwatch --threads) of large frames at 2/4/8 threads produce
+// output identical to the serial path.
+void CheckParallel()
+{
+	if (!Selected("parallel"))
+		return;
+
+	static const unsigned s_threads[] = { 2, 4, 8 };
+	Corpus corpora[] = { MakeNearSame(50000), MakeChurn(50000) };
+	for (unsigned cIdx = 0; cIdx != ARRAY_CNT(corpora); cIdx++)
+	{
+		const Corpus& corpus = corpora[cIdx];
+		const lstring& curr = corpus.curr;
+		std::ostringstream serialDiff;
+		showDiffFast(curr, corpus.prev, serialDiff);
+#ifdef HAVE_REGEX
+		const std::regex grepPat("Running|ok");
+		const std::regex replacePat("([0-9]+) ");
+		lstring serialGrep(curr);
+		RegexTrim(serialGrep, grepPat, "");
+		lstring serialReplace(curr);
+		RegexTrim(serialReplace, replacePat, "<$1> ");
+#endif
+
+		for (unsigned tIdx = 0; tIdx != ARRAY_CNT(s_threads); tIdx++)
+		{
+			ThreadPool pool(s_threads[tIdx] - 1);
+			std::string suffix = "." + corpus.name + ".t" + std::to_string(s_threads[tIdx]);
+			std::ostringstream diffOut;
+			showDiffFast(curr, corpus.prev, diffOut, &pool);
+			Check("parallel.showDiffFast" + suffix, 1, diffOut.str() == serialDiff.str());
+#ifdef HAVE_REGEX
+			lstring result;
+			RegexTrim(curr.c_str(), curr.length(), result, grepPat, "", &pool);
+			Check("parallel.RegexTrim.grep" + suffix, 1, result == serialGrep);
+			RegexTrim(curr.c_str(), curr.length(), result, replacePat, "<$1> ", &pool);
+			Check("parallel.RegexTrim.replace" + suffix, 1, result == serialReplace);
+#endif
+		}
+	}
+}
+
+// ======================================================================================
+// Capture path of the process backend, exit code, output left in the pipe at exit and
+// output larger than the pipe buffer.
+void CheckSpawn()
+{
+	if (!Selected("spawn"))
+		return;
+
+	std::unique_ptr<ChildProcess> process(ChildProcess::Create());
+	std::string output;
+#ifdef _WIN32
+	RunChild(*process, "cmd /c exit 3", output);
+#else
+	RunChild(*process, "sh -c 'exit 3'", output);
+#endif
+	Check("spawn.exitCode", 3, process->m_exitCode);
+
+	// Child which prints more than 64 KB and exits at once, the tail still in the pipe
+	// when the exit is seen must be read.
+	std::string path = TempFile("llcheck-spawn.txt");
+	std::string text;
+	for (unsigned line = 0; text.length() < (256u << 10); line++)
+		text += "line " + std::to_string(line) + " of output written before exit\n";
+	FILE* file = fopen(path.c_str(), "wb");
+	if (file != NULL)
+	{
+		fwrite(text.data(), 1, text.length(), file);
+		fclose(file);
+	}
+#ifdef _WIN32
+	RunChild(*process, ("cmd /c type \"" + path + "\"").c_str(), output);
+#else
+	RunChild(*process, ("cat '" + path + "'").c_str(), output);
+#endif
+	Check("spawn.outputAtExit", 1, output == text);
+	remove(path.c_str());
+
+#ifndef _WIN32
+	const unsigned long long bigBytes = 16ull << 20;
+	RunChild(*process, "head -c 16777216 /dev/zero", output);
+	Check("spawn.largeOutput", bigBytes, output.length());
+	Check("spawn.largeOutputCnt", bigBytes, process->m_bytesRead);
+#endif
+}
+
+// ======================================================================================
+// Frame 'seq' of the shm stress test, a header line with its number and the hash of
+// the lines after it, which vary in count and width so frames end mid slot.
+static void MakeShmFrame(std::string& frame, uint64_t seq)
+{
+	Rng rng(seq * 2654435761ull + 1);
+	std::string body;
+	unsigned lines = 1 + rng.Next(400);
+	for (unsigned line = 0; line != lines; line++)
+	{
+		body.append(1 + rng.Next(120), (char)('a' + (seq + line) % 26));
+		body += '\n';
+	}
+	char head[64];
+	snprintf(head, sizeof(head), "%llu %016llx\n", (unsigned long long)seq,
+		(unsigned long long)HashBytes(body.data(), body.length()));
+	frame = head;
+	frame += body;
+}
+
+// Frame read from the ring must be exactly the frame published as its seq.
+static bool ShmFrameOk(const ShmFrame& frame)
+{
+	unsigned long long seq = 0, hash = 0;
+	size_t eol = frame.data.find('\n');
+	if (eol == std::string::npos || sscanf(frame.data.c_str(), "%llu %llx", &seq, &hash) != 2)
+		return false;
+	return seq == frame.seq && frame.tick == seq && frame.exitCode == (unsigned long)(seq & 0xff)
+		&& hash == HashBytes(frame.data.data() + eol + 1, frame.data.length() - eol - 1);
+}
+
+// Shared memory frame ring (llwatch --shm). One writer publishes as fast as it can
+// into a small ring so it laps slow readers, concurrent readers validate every frame
+// they get (never torn, never older than the last one). A frame larger than a slot
+// is cut after its last whole line.
+void CheckShmRing()
+{
+	if (!Selected("shm"))
+		return;
+
+	char name[64];
+	snprintf(name, sizeof(name), "llcheck-%u", (unsigned)Clock::now().time_since_epoch().count());
+	std::string error;
+	ShmRingWriter writer;
+	if (!writer.Create(name, 4, 64 << 10, error))
+	{
+		std::cout << "shm.create " << error << std::endl;
+		Check("shm.create", 1, 0);
+		return;
+	}
+
+	static const unsigned READERS = 4;
+	std::atomic<bool> done(false);
+	std::atomic<unsigned long long> reads(0), torn(0), backwards(0);
+	std::vector<std::thread> readers;
+	for (unsigned idx = 0; idx != READERS; idx++)
+	{
+		readers.push_back(std::thread([&]()
+			{
+				ShmRingReader reader;
+				std::string readError;
+				if (!reader.Open(name, readError))
+				{
+					torn++;
+					return;
+				}
+				ShmFrame frame;
+				uint64_t lastSeq = 0;
+				while (!done)
+				{
+					if (!reader.ReadLatest(frame, lastSeq))
+					{
+						std::this_thread::yield();
+						continue;
+					}
+					if (!ShmFrameOk(frame))
+						torn++;
+					if (frame.seq <= lastSeq)
+						backwards++;
+					lastSeq = frame.seq;
+					reads++;
+				}
+			}));
+	}
+
+	std::string frame;
+	uint64_t seq = 0;
+	Clock::time_point start = Clock::now();
+	while (Clock::now() - start < std::chrono::milliseconds(500))
+	{
+		MakeShmFrame(frame, ++seq);
+		writer.Publish(seq, (unsigned long)(seq & 0xff), frame.data(), frame.length());
+	}
+	done = true;
+	for (unsigned idx = 0; idx != READERS; idx++)
+		readers[idx].join();
+	Check("shm.torn", 0, torn);
+	Check("shm.backwards", 0, backwards);
+
+	ShmRingReader reader;
+	ShmFrame latest;
+	std::string big;
+	while (big.length() < writer.SlotBytes() + 1000)
+		big += "line longer than the slot when repeated\n";
+	writer.Publish(++seq, 0, big.data(), big.length());
+	reader.Open(name, error);
+	reader.ReadLatest(latest);
+	Check("shm.truncated", 1, latest.truncated && !latest.data.empty() && latest.data.back() == '\n'
+		&& big.compare(0, latest.data.length(), latest.data) == 0);
+}
+
+// ======================================================================================
+// Render governor (llwatch --max-fps). Frames submitted every millisecond at a 30 fps
+// cap are painted under the cap and the last frame is the one on screen after Flush.
+void CheckRender()
+{
+	if (!Selected("render"))
+		return;
+
+	static const unsigned FPS = 30;
+	std::ostringstream screen;
+	FrameGovernor governor(FPS, false, screen);
+	lstring frame;
+	char line[64];
+	unsigned submitted = 0;
+	Clock::time_point start = Clock::now();
+	while (Clock::now() - start < std::chrono::milliseconds(500))
+	{
+		snprintf(line, sizeof(line), "frame %u\nsame line\n", ++submitted);
+		frame = line;
+		governor.Submit(frame, Clock::now());
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	double sec = std::chrono::duration<double>(Clock::now() - start).count();
+	governor.Flush();
+
+	Check("render.underCap", 1, governor.Painted() <= (unsigned)(sec * FPS) + 2);
+	std::string shown = screen.str();
+	size_t len = strlen(line);
+	Check("render.latest", 1, shown.length() >= len && shown.compare(shown.length() - len, len, line) == 0);
+}
+
+// ======================================================================================
+// Console fit (llwatch --fit). Lines cut to the window width by the fused pipeline
+// and the pass per stage are identical, no longer than the width and never end in a
+// split UTF-8 character.
+void CheckFit()
+{
+	if (!Selected("fit"))
+		return;
+
+	static const unsigned COLS = 21;
+	lstring frame;
+	for (unsigned line = 0; line != 200; line++)
+	{
+		char text[64];
+		snprintf(text, sizeof(text), "%*u \xc3\xa9\xc3\xa9\xc3\xa9 tail of a long line\n", (int)(line % 24), line);
+		frame += text;
+	}
+
+	std::string outputs[2];
+	for (int multiPass = 0; multiPass != 2; multiPass++)
+	{
+		FramePipeline pipeline;
+		pipeline.SetMaxCols(COLS);
+		pipeline.Configure(NULL, "", 0, 50, NULL, multiPass != 0);
+		std::ostringstream screen;
+		lstring filtered;
+		const char* data = frame.c_str();
+		size_t len = frame.length();
+		pipeline.Run(data, len, NULL, 0, filtered, screen);
+		outputs[multiPass] = screen.str();
+	}
+	Check("fit.fusedSame", 1, outputs[0] == outputs[1]);
+
+	unsigned long long tooWide = 0;
+	unsigned long long splitChars = 0;
+	Split lines(outputs[0], "\n");
+	for (size_t idx = 0; idx != lines.size(); idx++)
+	{
+		const std::string& line = lines[idx];
+		if (line.length() > COLS)
+			tooWide++;
+		if (!line.empty() && (unsigned char)line.back() == 0xc3)
+			splitChars++;
+	}
+	Check("fit.tooWide", 0, tooWide);
+	Check("fit.splitChars", 0, splitChars);
+}
+
+// ======================================================================================
+// Cumulative heatmap (llwatch --cumulative). A cell changed once fades through the
+// levels over the fade ticks and then counts as unchanged, stamps survive the 16 bit
+// tick wrapping and never cover more than maxCells cells.
+void CheckHeat()
+{
+	if (!Selected("heat"))
+		return;
+
+	static const unsigned FADE = 8;
+	NullBuf nullBuf;
+	std::ostream nullOut(&nullBuf);
+	HeatMap heatMap(FADE, 64);
+	std::string frames[2] = { std::string(100, '.'), std::string(100, '.') };
+	frames[1][10] = 'x';
+
+	// Changed at tick 1, then unchanged.
+	heatMap.Show(frames[1].c_str(), frames[1].length(), frames[0].c_str(), frames[0].length(), nullOut);
+	unsigned long long fadeOk = 1;
+	size_t counts[HeatMap::LEVELS];
+	for (unsigned tick = 1; tick <= FADE + 1; tick++)
+	{
+		heatMap.Counts(counts, HeatMap::LEVELS);
+		size_t warm = counts[0] + counts[1] + counts[2] + counts[3];
+		if (warm != ((tick <= FADE) ? 1u : 0u))
+			fadeOk = 0;
+		heatMap.Show(frames[1].c_str(), frames[1].length(), frames[1].c_str(), frames[1].length(), nullOut);
+	}
+	Check("heat.fade", 1, fadeOk);
+	Check("heat.bounded", 64, heatMap.Cells());
+
+	// Past the tick wrap a cell changed in the last frame is still the hottest.
+	for (unsigned tick = 0; tick != 70000; tick++)
+		heatMap.Show(frames[tick & 1].c_str(), 100, frames[(tick + 1) & 1].c_str(), 100, nullOut);
+	heatMap.Counts(counts, HeatMap::LEVELS);
+	Check("heat.wrap", 1, counts[0]);
+}
+
+// ======================================================================================
+// Golden baseline (llwatch --baseline). The prev frame of a corpus is saved as the
+// baseline, the second open must use the sidecar index and the deviations of curr
+// must match a plain line by line comparison. A sidecar left by other text of the
+// same size is rebuilt.
+void CheckBaseline(const Corpus& corpus)
+{
+	if (!Selected("baseline"))
+		return;
+
+	std::string path = TempFile("llcheck-baseline.txt");
+	std::string error;
+	Baseline::Save(path.c_str(), corpus.prev.c_str(), corpus.prev.length(), error);
+	Baseline baseline;
+	bool opened = baseline.Open(path.c_str(), error);
+	Check("baseline.open." + corpus.name, 1, opened);
+	if (opened)
+	{
+		Check("baseline.indexLoaded." + corpus.name, 1, baseline.IndexLoaded());
+
+		Split currLines(corpus.curr, "\n");
+		Split prevLines(corpus.prev, "\n");
+		unsigned long long expect = 0;
+		for (size_t idx = 0; idx != currLines.size() && idx != prevLines.size(); idx++)
+			expect += (currLines[idx] != prevLines[idx]) ? 1 : 0;
+		Baseline::Deviation deviation = baseline.Compare(corpus.curr.c_str(), corpus.curr.length());
+		Check("baseline.changed." + corpus.name, expect, deviation.changed);
+	}
+
+	// Snapshot rewritten at once with text of the same size (same file, times within a
+	// clock tick), the sidecar of the old text must not be used.
+	FILE* file = fopen(path.c_str(), "wb");
+	if (file != NULL)
+	{
+		fwrite(corpus.curr.c_str(), 1, corpus.curr.length(), file);
+		fclose(file);
+	}
+	Baseline rewritten;
+	bool staleIgnored = corpus.curr.length() == corpus.prev.length() && rewritten.Open(path.c_str(), error)
+		&& !rewritten.IndexLoaded() && rewritten.Compare(corpus.curr.c_str(), corpus.curr.length()).changed == 0;
+	Check("baseline.staleIndex." + corpus.name, 1, staleIgnored);
+
+	remove(path.c_str());
+	remove((path + ".idx").c_str());
+}
+
+// ======================================================================================
+// Volatile token masking (llwatch --mask). The key keeps the text length, a frame
+// whose only change is a masked token has no changed cells (counted by a heatmap on
+// the fused pipeline) and is not painted again by the governor, a real change is.
+void CheckMask()
+{
+	if (!Selected("mask"))
+		return;
+
+	NullBuf nullBuf;
+	std::ostream nullOut(&nullBuf);
+	TokenMask timeMask;
+	std::string error;
+	timeMask.Add("@time", error);
+	lstring key;
+	const char* text = "at 12:00:01 up 3\n";
+	timeMask.Key(text, strlen(text), key);
+	Check("mask.key", 1, key == "at ######## up 3\n");
+
+	static const char* s_frames[] = { "at 12:00:01 up 3\nidle\n", "at 12:00:02 up 3\nidle\n", "at 12:00:03 up 4\nidle\n" };
+	HeatMap heatMap(4);
+	FramePipeline heatPipeline;
+	heatPipeline.SetHeatMap(&heatMap);
+	heatPipeline.SetMask(&timeMask);
+	heatPipeline.Configure(NULL, "", 0, 0);
+	FrameGovernor governor(1000, true, nullOut);
+	governor.SetMask(&timeMask);
+	size_t changed[ARRAY_CNT(s_frames)];
+	lstring filtered;
+	for (unsigned idx = 0; idx != ARRAY_CNT(s_frames); idx++)
+	{
+		const char* data = s_frames[idx];
+		size_t len = strlen(data);
+		const char* prev = (idx == 0) ? "" : s_frames[idx - 1];
+		heatPipeline.Run(data, len, prev, strlen(prev), filtered, nullOut);
+		size_t counts[HeatMap::LEVELS];
+		heatMap.Counts(counts, HeatMap::LEVELS);
+		changed[idx] = counts[0];
+
+		lstring frame(s_frames[idx]);
+		governor.Submit(frame, Clock::now());
+		governor.Flush();
+	}
+	Check("mask.unchanged", 0, changed[1]);
+	Check("mask.realChange", 1, changed[2]);
+	Check("mask.governor", 2, governor.Painted());
+}
+
+// ======================================================================================
+// Numeric field rates (llwatch --rates). Only number tokens are fields, a change is
+// shown with its per second rate, lines which swap places keep their pairing by key.
+void CheckRates()
+{
+	if (!Selected("rates"))
+		return;
+
+	std::vector<double> values;
+	const char* text = "eth0 RX 81234 pkts 12ms 45% 0x1f 1.2.3 12:30:00 -7";
+	size_t fields = FieldRates::ParseFields(text, strlen(text), values);
+	Check("rates.fields", 4, fields == 4 && values[0] == 81234 && values[1] == 12 && values[3] == -7 ? 4 : fields);
+
+	Clock::time_point at = Clock::now();
+	FieldRates lineRates(FieldRates::BY_LINE);
+	const char* data = "x 100\n";
+	size_t len = strlen(data);
+	lineRates.Apply(data, len, at);
+	data = "x 350\n";
+	len = strlen(data);
+	lineRates.Apply(data, len, at + std::chrono::milliseconds(500));
+	std::string shown(data, len);
+	Check("rates.delta", 1, shown.find("+250") != std::string::npos && shown.find(" 500/s") != std::string::npos);
+
+	FieldRates keyRates(FieldRates::BY_KEY);
+	data = "a 1\nb 10\n";
+	len = strlen(data);
+	keyRates.Apply(data, len, at);
+	data = "b 20\na 2\n";
+	len = strlen(data);
+	keyRates.Apply(data, len, at + std::chrono::seconds(1));
+	shown.assign(data, len);
+	Check("rates.byKey", 1, keyRates.Paired() == 2 && shown.find("+10") < shown.find('\n')
+		&& shown.find("+1 ") > shown.find('\n'));
+}
+
+// ======================================================================================
+// Sort, top-k and uniq (llwatch --sort, --top, --uniq). The heap top-k is the head of
+// the full sort by the numeric column sortSpec of a corpus, duplicates are counted
+// like uniq -c and lines without the column stay on top.
+void CheckTopIsSortHead(const Corpus& corpus, const char* sortSpec)
+{
+	static const unsigned TOP_K = 20;
+	std::string error;
+	LineAggregate sortAll;
+	LineAggregate sortTop;
+	sortAll.SetSort(sortSpec, error);
+	sortTop.SetSort(sortSpec, error);
+	sortTop.SetTop(TOP_K);
+	const char* data = corpus.curr.c_str();
+	size_t len = corpus.curr.length();
+	sortAll.Apply(data, len);
+	std::string all(data, len);
+	data = corpus.curr.c_str();
+	len = corpus.curr.length();
+	sortTop.Apply(data, len);
+	size_t head = 0;
+	for (unsigned line = 0; line != TOP_K && head != std::string::npos; line++)
+		head = all.find('\n', head + (line != 0));
+	Check("aggregate.topIsSortHead." + corpus.name, 1, head != std::string::npos && all.compare(0, head + 1, data, len) == 0);
+}
+
+void CheckAggregate()
+{
+	if (!Selected("aggregate"))
+		return;
+
+	CheckTopIsSortHead(MakeNearSame(10000), "3nr");
+	CheckTopIsSortHead(MakeHugeCount(100000), "2nr");
+
+	std::string error;
+	LineAggregate uniq;
+	uniq.SetUniq(true);
+	const char* data = "b\na\nb\n";
+	size_t len = strlen(data);
+	uniq.Apply(data, len);
+	Check("aggregate.uniq", 1, std::string(data, len) == "      2 b\n      1 a\n");
+
+	LineAggregate header;
+	header.SetSort("2n", error);
+	data = "name size\nx 9\ny 3\nz 3\n";
+	len = strlen(data);
+	header.Apply(data, len);
+	Check("aggregate.headerStable", 1, std::string(data, len) == "name size\ny 3\nz 3\nx 9\n");
+}
+
+int main(int argc, const char* argv[])
+{
+	GetOpts<char> getOpts(argc, argv, "f:v?");
+	while (getOpts.GetOpt())
+	{
+		switch (getOpts.Opt())
+		{
+		case 'f':	m_filter = getOpts.OptArg(); break;
+		case 'v':	m_verbose = true; break;
+		default:
+		case '?':
+			std::cerr << sUsage;
+			return 0;
+		}
+	}
+	if (getOpts.Error())
+	{
+		std::cerr << sUsage;
+		return -1;
+	}
+
+	CheckParallel();
+	CheckSpawn();
+	CheckShmRing();
+	CheckRender();
+	CheckFit();
+	CheckHeat();
+	CheckBaseline(MakeNearSame(10000));
+	CheckBaseline(MakeLongLines(256));
+	CheckMask();
+	CheckRates();
+	CheckAggregate();
+
+	std::cout << "llcheck " << m_checks << " checks, " << m_failed << " failed" << std::endl;
+	return (m_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,195 @@
+// ------------------------------------------------------------------------------------------------
+// LLGen - Synthetic child program for LLWatch load testing
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// Emits a reproducible frame of text each run. Lines which 'churn' change from one
+// run to the next, the rest are identical, so llwatch sees a controlled change rate.
+//
+// Build:
+//   Windows  llgen.vcxproj (part of llwatch-ms\llwatch.sln)
+//   Linux    cd llwatch-bench
+//            g++ -O2 -std=c++17 -I../LLWatch -o llgen LLGen.cpp ../LLWatch/GetOpts.cpp
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "GetOpts.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+const char sUsage[] =
+"\n"
+"LLGen - synthetic command output for llwatch load tests\n"
+"\n"
+"USAGE:\n"
+"  llgen [-l lines] [-w min[,max]] [-c churn%] [-k chunkBytes] [-d msec] [-D msec] [-E msec] [-B] [-S stateFile] [-x exitCode]\n"
+"\n"
+"  -l <lines>      Lines per run, default 100 \n"
+"  -w <min,max>    Line width range, default 60,60 \n"
+"  -c <percent>    Percent of lines which change between runs, default 5 \n"
+"  -k <bytes>      Write output in chunks of this many bytes, default 4096 \n"
+"  -d <msec>       Delay between chunks, default 0 \n"
+"  -D <msec>       Delay before first output, default 0 \n"
+"  -E <msec>       Delay after last output before exit, default 0 \n"
+"  -B              Buffered, no flush per chunk (stdio default: line buffered on a \n"
+"                  terminal, block buffered on a pipe, like most programs) \n"
+"  -S <file>       Run counter file, default run number is current time in seconds \n"
+"  -x <code>       Exit code, default 0 \n"
+"\n";
+
+// ======================================================================================
+// Hash used to pick churning lines and filler text reproducibly.
+static unsigned Mix(unsigned long long value)
+{
+	value ^= value >> 33;
+	value *= 0xff51afd7ed558ccdULL;
+	value ^= value >> 33;
+	value *= 0xc4ceb9fe1a85ec53ULL;
+	value ^= value >> 33;
+	return (unsigned)value;
+}
+
+// ======================================================================================
+// Read, increment and save run counter.
+static unsigned NextRun(const char* stateFile)
+{
+	if (stateFile == NULL)
+		return (unsigned)time(NULL);
+
+	unsigned run = 0;
+	FILE* file = fopen(stateFile, "r");
+	if (file)
+	{
+		if (fscanf(file, "%u", &run) != 1)
+			run = 0;
+		fclose(file);
+	}
+	file = fopen(stateFile, "w");
+	if (file)
+	{
+		fprintf(file, "%u\n", run + 1);
+		fclose(file);
+	}
+	return run;
+}
+
+// ======================================================================================
+int main(int argc, const char* argv[])
+{
+	unsigned lines = 100;
+	unsigned minWidth = 60;
+	unsigned maxWidth = 60;
+	unsigned churn = 5;
+	unsigned chunkBytes = 4096;
+	unsigned chunkDelayMsec = 0;
+	unsigned startDelayMsec = 0;
+	unsigned endDelayMsec = 0;
+	bool flushChunks = true;
+	int exitCode = 0;
+	const char* stateFile = NULL;
+
+	GetOpts<char> getOpts(argc, argv, "Bc:d:D:E:k:l:S:w:x:?");
+	char* endPtr;
+	while (getOpts.GetOpt())
+	{
+		switch (getOpts.Opt())
+		{
+		case 'B':	flushChunks = false; break;
+		case 'c':	churn = strtoul(getOpts.OptArg(), NULL, 10); break;
+		case 'd':	chunkDelayMsec = strtoul(getOpts.OptArg(), NULL, 10); break;
+		case 'D':	startDelayMsec = strtoul(getOpts.OptArg(), NULL, 10); break;
+		case 'E':	endDelayMsec = strtoul(getOpts.OptArg(), NULL, 10); break;
+		case 'k':	chunkBytes = strtoul(getOpts.OptArg(), NULL, 10); break;
+		case 'l':	lines = strtoul(getOpts.OptArg(), NULL, 10); break;
+		case 'S':	stateFile = getOpts.OptArg(); break;
+		case 'x':	exitCode = atoi(getOpts.OptArg()); break;
+		case 'w':
+			minWidth = maxWidth = strtoul(getOpts.OptArg(), &endPtr, 10);
+			if (*endPtr == ',')
+				maxWidth = strtoul(endPtr + 1, NULL, 10);
+			break;
+		default:
+		case '?':
+			std::cerr << sUsage;
+			return 0;
+		}
+	}
+	if (getOpts.Error())
+	{
+		std::cerr << sUsage;
+		return -1;
+	}
+	if (maxWidth < minWidth)
+		maxWidth = minWidth;
+	if (chunkBytes == 0)
+		chunkBytes = 4096;
+
+	unsigned run = NextRun(stateFile);
+
+	// Build entire frame, then emit it in chunks.
+	static const char filler[] = "abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ 0123456789 ";
+	std::string frame;
+	char head[64];
+	for (unsigned idx = 0; idx != lines; idx++)
+	{
+		bool churns = (Mix(((unsigned long long)run << 32) | idx) % 100) < churn;
+		unsigned width = minWidth + Mix(idx) % (maxWidth - minWidth + 1);
+		size_t start = frame.length();
+		snprintf(head, sizeof(head), "line %06u v%-10u ", idx, churns ? run : 0);
+		frame += head;
+		unsigned seed = Mix(idx);
+		while (frame.length() - start < width)
+			frame += filler[(seed++) % (sizeof(filler) - 1)];
+		frame.resize(start + width);
+		frame += '\n';
+	}
+
+	if (startDelayMsec != 0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(startDelayMsec));
+
+	for (size_t pos = 0; pos < frame.length(); pos += chunkBytes)
+	{
+		if (pos != 0 && chunkDelayMsec != 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(chunkDelayMsec));
+		size_t len = (frame.length() - pos < chunkBytes) ? frame.length() - pos : chunkBytes;
+		fwrite(frame.data() + pos, 1, len, stdout);
+		if (flushChunks)
+			fflush(stdout);
+	}
+
+	if (endDelayMsec != 0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(endDelayMsec));
+
+	return exitCode;
+}
@@ -0,0 +1,365 @@
+// ------------------------------------------------------------------------------------------------
+// LLLoad - End-to-end load harness, runs llwatch against llgen for N ticks
+//
+// Author: Dennis Lang - 2016
+// http://LanDenLabs.com/
+//
+// This file is part of LLWatch project.
+//
+// Runs:  llwatch -v --count <ticks> -n 0 --trace <traceFile> <llwatch options> -- llgen <llgen options>
+// llwatch stdout is drained and counted by the harness (like a terminal would consume it).
+// Per tick wall time, own cpu and peak memory come from the llwatch trace, totals for the
+// whole run come from the OS (process times, peak working set / max rss).
+//
+// Output is JSON lines, one per tick followed by a summary:
+//   {"tick":3,"wallMs":12.410,"cpuMs":3.125,"peakRssKB":4212,"bytesOut":6100}
+//   {"summary":"llload","ticks":100,"wallMs":..,"tickMsAvg":..,"tickMsP50":..,"tickMsP99":..,
+//    "cpuUserMs":..,"cpuKernelMs":..,"peakRssKB":..,"outBytes":..,"exitCode":0}
+//
+// Build:
+//   Windows  llload.vcxproj (part of llwatch-ms\llwatch.sln)
+//   Linux    cd llwatch-bench
+//            g++ -O2 -std=c++17 -I../LLWatch -o llload LLLoad.cpp ../LLWatch/GetOpts.cpp
+//
+// ----- License ----
+//
+// Copyright (c) 2016 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// ------------------------------------------------------------------------------------------------
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "GetOpts.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+typedef std::chrono::steady_clock Clock;
+typedef std::vector<std::string> StringList;
+
+const char sUsage[] =
+"\n"
+"LLLoad - run llwatch against llgen and trace each tick\n"
+"\n"
+"USAGE:\n"
+"  llload [-t ticks] [-w llwatch] [-g llgen] [-x \"llwatch options\"] [-T traceFile] [-o file] [-- llgen options]\n"
+"\n"
+"  -t <ticks>    Number of llwatch runs, default 100 \n"
+"  -w <path>     llwatch executable \n"
+"  -g <path>     llgen executable \n"
+"  -x <options>  Extra llwatch options, ex: \"-t 0 -g line\" \n"
+"  -T <file>     llwatch trace file, default llload.trace \n"
+"  -o <file>     Write JSON lines results to file, default stdout \n"
+"\n"
+"EXAMPLE:\n"
+"  llload -t 200 -- -l 5000 -c 10 -k 512 \n"
+"\n";
+
+// Usage of the llwatch process for its entire run.
+struct RunUsage
+{
+	double wallMs;
+	double userMs;
+	double kernelMs;
+	unsigned long long peakRssKB;
+	unsigned long long outBytes;
+	int exitCode;
+};
+
+// ======================================================================================
+static StringList SplitArgs(const char* str)
+{
+	StringList args;
+	std::string arg;
+	for (; *str; str++)
+	{
+		if (*str == ' ')
+		{
+			if (!arg.empty())
+				args.push_back(arg);
+			arg.clear();
+		}
+		else
+			arg += *str;
+	}
+	if (!arg.empty())
+		args.push_back(arg);
+	return args;
+}
+
+#ifdef _WIN32
+// ======================================================================================
+static double FileTimeMs(const FILETIME& fileTime)
+{
+	return (((ULONGLONG)fileTime.dwHighDateTime << 32) | fileTime.dwLowDateTime) / 1e4;
+}
+
+// ======================================================================================
+// Run args[0] with stdout drained into a byte counter.
+static bool RunChild(const StringList& args, RunUsage& usage)
+{
+	std::string cmdLine;
+	for (size_t idx = 0; idx != args.size(); idx++)
+	{
+		bool quote = (args[idx].find(' ') != std::string::npos);
+		cmdLine += (idx == 0) ? "" : " ";
+		cmdLine += quote ? "\"" + args[idx] + "\"" : args[idx];
+	}
+
+	SECURITY_ATTRIBUTES saAttr;
+	saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
+	saAttr.bInheritHandle = TRUE;
+	saAttr.lpSecurityDescriptor = NULL;
+
+	HANDLE outRd, outWr;
+	if (!CreatePipe(&outRd, &outWr, &saAttr, 0))
+		return false;
+	SetHandleInformation(outRd, HANDLE_FLAG_INHERIT, 0);
+
+	STARTUPINFOA startInfo;
+	ZeroMemory(&startInfo, sizeof(startInfo));
+	startInfo.cb = sizeof(startInfo);
+	startInfo.hStdOutput = outWr;
+	startInfo.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+	startInfo.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+	startInfo.dwFlags |= STARTF_USESTDHANDLES;
+
+	PROCESS_INFORMATION procInfo;
+	ZeroMemory(&procInfo, sizeof(procInfo));
+	if (!CreateProcessA(NULL, (char*)cmdLine.c_str(), NULL, NULL, TRUE, 0, NULL, NULL, &startInfo, &procInfo))
+	{
+		std::cerr << "Failed to run " << cmdLine << std::endl;
+		CloseHandle(outRd);
+		CloseHandle(outWr);
+		return false;
+	}
+	CloseHandle(outWr);
+
+	char buf[65536];
+	DWORD dwRead;
+	usage.outBytes = 0;
+	while (ReadFile(outRd, buf, sizeof(buf), &dwRead, NULL) && dwRead != 0)
+		usage.outBytes += dwRead;
+	CloseHandle(outRd);
+
+	WaitForSingleObject(procInfo.hProcess, INFINITE);
+
+	FILETIME createTime, exitTime, kernelTime, userTime;
+	GetProcessTimes(procInfo.hProcess, &createTime, &exitTime, &kernelTime, &userTime);
+	usage.userMs = FileTimeMs(userTime);
+	usage.kernelMs = FileTimeMs(kernelTime);
+
+	PROCESS_MEMORY_COUNTERS memCounters;
+	memCounters.cb = sizeof(memCounters);
+	GetProcessMemoryInfo(procInfo.hProcess, &memCounters, sizeof(memCounters));
+	usage.peakRssKB = memCounters.PeakWorkingSetSize / 1024;
+
+	DWORD exitCode = 0;
+	GetExitCodeProcess(procInfo.hProcess, &exitCode);
+	usage.exitCode = (int)exitCode;
+
+	CloseHandle(procInfo.hProcess);
+	CloseHandle(procInfo.hThread);
+	return true;
+}
+#else
+// ======================================================================================
+// Run args[0] with stdout drained into a byte counter.
+static bool RunChild(const StringList& args, RunUsage& usage)
+{
+	int fds[2];
+	if (pipe(fds) != 0)
+		return false;
+
+	std::vector<char*> argv;
+	for (size_t idx = 0; idx != args.size(); idx++)
+		argv.push_back((char*)args[idx].c_str());
+	argv.push_back(NULL);
+
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		execvp(argv[0], &argv[0]);
+		perror(argv[0]);
+		_exit(127);
+	}
+	close(fds[1]);
+	if (pid < 0)
+	{
+		close(fds[0]);
+		return false;
+	}
+
+	char buf[65536];
+	ssize_t rdLen;
+	usage.outBytes = 0;
+	while ((rdLen = read(fds[0], buf, sizeof(buf))) > 0)
+		usage.outBytes += rdLen;
+	close(fds[0]);
+
+	int status = 0;
+	struct rusage rusage;
+	wait4(pid, &status, 0, &rusage);
+	usage.userMs = rusage.ru_utime.tv_sec * 1e3 + rusage.ru_utime.tv_usec / 1e3;
+	usage.kernelMs = rusage.ru_stime.tv_sec * 1e3 + rusage.ru_stime.tv_usec / 1e3;
+	usage.peakRssKB = (unsigned long long)rusage.ru_maxrss;
+	usage.exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+	return true;
+}
+#endif
+
+// ======================================================================================
+// Return numeric value of "key": in a JSON line, 0 if missing.
+static double JsonNumber(const std::string& line, const char* key)
+{
+	std::string tag = std::string("\"") + key + "\":";
+	size_t pos = line.find(tag);
+	return (pos == std::string::npos) ? 0 : strtod(line.c_str() + pos + tag.length(), NULL);
+}
+
+// ======================================================================================
+int main(int argc, const char* argv[])
+{
+	unsigned ticks = 100;
+#ifdef _WIN32
+	std::string llwatch = "llwatch.exe";
+	std::string llgen = "llgen.exe";
+#else
+	std::string llwatch = "./llwatch";
+	std::string llgen = "./llgen";
+#endif
+	const char* extraOpts = "";
+	const char* traceFile = "llload.trace";
+	const char* outFile = NULL;
+
+	GetOpts<char> getOpts(argc, argv, "g:o:t:T:w:x:?");
+	while (getOpts.GetOpt())
+	{
+		switch (getOpts.Opt())
+		{
+		case 'g':	llgen = getOpts.OptArg(); break;
+		case 'o':	outFile = getOpts.OptArg(); break;
+		case 't':	ticks = strtoul(getOpts.OptArg(), NULL, 10); break;
+		case 'T':	traceFile = getOpts.OptArg(); break;
+		case 'w':	llwatch = getOpts.OptArg(); break;
+		case 'x':	extraOpts = getOpts.OptArg(); break;
+		default:
+		case '?':
+			std::cerr << sUsage;
+			return 0;
+		}
+	}
+	if (getOpts.Error())
+	{
+		std::cerr << sUsage;
+		return -1;
+	}
+
+	char tickStr[32];
+	snprintf(tickStr, sizeof(tickStr), "%u", ticks);
+
+	StringList args;
+	args.push_back(llwatch);
+	args.push_back("-v");
+	args.push_back("--count");
+	args.push_back(tickStr);
+	args.push_back("-n");
+	args.push_back("0");
+	args.push_back("--trace");
+	args.push_back(traceFile);
+	StringList extra = SplitArgs(extraOpts);
+	args.insert(args.end(), extra.begin(), extra.end());
+	args.push_back("--");
+	args.push_back(llgen);
+	for (int idx = getOpts.NextIdx(); idx < argc; idx++)
+		args.push_back(argv[idx]);
+
+	RunUsage usage;
+	Clock::time_point start = Clock::now();
+	if (!RunChild(args, usage))
+	{
+		std::cerr << "Failed to run " << llwatch << std::endl;
+		return -1;
+	}
+	usage.wallMs = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count() / 1e3;
+
+	std::ofstream outStream;
+	if (outFile)
+		outStream.open(outFile);
+	std::ostream& out = outFile ? outStream : std::cout;
+
+	// Per tick records from llwatch trace.
+	std::ifstream trace(traceFile);
+	std::string line;
+	std::vector<double> tickMs;
+	double prevCpuMs = 0;
+	char buf[512];
+	while (std::getline(trace, line))
+	{
+		double cpuMs = JsonNumber(line, "cpuMs");
+		double wallMs = JsonNumber(line, "tickNs") / 1e6;
+		tickMs.push_back(wallMs);
+		snprintf(buf, sizeof(buf), "{\"tick\":%.0f,\"wallMs\":%.3f,\"firstOutMs\":%.3f,\"cpuMs\":%.3f,\"peakRssKB\":%.0f,\"bytesOut\":%.0f}\n",
+			JsonNumber(line, "tick"), wallMs, JsonNumber(line, "firstOutNs") / 1e6, cpuMs - prevCpuMs,
+			JsonNumber(line, "peakRssKB"), JsonNumber(line, "bytesOut"));
+		out << buf;
+		prevCpuMs = cpuMs;
+	}
+
+	double avgMs = 0, p50Ms = 0, p99Ms = 0;
+	if (!tickMs.empty())
+	{
+		for (size_t idx = 0; idx != tickMs.size(); idx++)
+			avgMs += tickMs[idx];
+		avgMs /= tickMs.size();
+		std::sort(tickMs.begin(), tickMs.end());
+		p50Ms = tickMs[tickMs.size() / 2];
+		p99Ms = tickMs[(std::min)(tickMs.size() - 1, tickMs.size() * 99 / 100)];
+	}
+
+	snprintf(buf, sizeof(buf),
+		"{\"summary\":\"llload\",\"ticks\":%u,\"wallMs\":%.3f,\"tickMsAvg\":%.3f,\"tickMsP50\":%.3f,\"tickMsP99\":%.3f,"
+		"\"cpuUserMs\":%.3f,\"cpuKernelMs\":%.3f,\"peakRssKB\":%llu,\"outBytes\":%llu,\"exitCode\":%d}\n",
+		(unsigned)tickMs.size(), usage.wallMs, avgMs, p50Ms, p99Ms,
+		usage.userMs, usage.kernelMs, usage.peakRssKB, usage.outBytes, usage.exitCode);
+	out << buf;
+
+	return (tickMs.size() == ticks) ? 0 : 1;
+}